@@ -5,6 +5,10 @@
 //
 // Author:     Haris Wang (dynmiw@gmail.com)
 // 
+// 2021: The bits are kept in 64-bit words.  Searches and counts go a
+//       word at a time with the bit scan and popcount builtins; the
+//       static versions do the same on slot maps inside pinned pages.
+//
 
 #include <cstdio>
 #include <cstring>
@@ -16,22 +20,53 @@
 #include "rm.h"
 
 
+//
+// read the 'n' <= 8 bytes at 'p' as a word, byte i in bits 8i..8i+7
+//
+static inline unsigned long long load_word(const char *p, int n)
+{
+    unsigned long long w = 0;
+    memcpy(&w, p, n);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+
+//
+// write the low 'n' <= 8 bytes of 'w' to 'p', the inverse of load_word
+//
+static inline void store_word(char *p, unsigned long long w, int n)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    memcpy(p, &w, n);
+}
+
+
 //
 // allocate memory space for buffer
 //
 bitmap::bitmap(int numBits, char *buf)
 {
     size = numBits;
-    NumChars = ceil(1.0 * size / 8);
-    buffer = new char[NumChars];
+    NumChars = (size + 7) / 8;
+    NumWords = (size + 63) / 64;
+    words = new unsigned long long[NumWords];
 
     if(buf==NULL)
     {
-        memset((void*)buffer, 0 , NumChars);
+        memset((void*)words, 0, NumWords * sizeof(*words));
     }
     else
     {
-        memcpy(buffer, buf, NumChars);
+        for (unsigned int i = 0; i < NumWords; i++)
+        {
+            int n = NumChars - i * 8 < 8 ? NumChars - i * 8 : 8;
+            words[i] = load_word(buf + i * 8, n);
+        }
     }
     
 }
@@ -42,7 +77,7 @@ bitmap::bitmap(int numBits, char *buf)
 //
 bitmap::~bitmap()
 {
-    delete [] buffer;
+    delete [] words;
 }
 
 
@@ -53,7 +88,11 @@ RC bitmap::to_char_buf(char * buf, int len) const
 {
     assert( buf!=NULL && len==NumChars );
 
-    memcpy((void*)buf, buffer, len);
+    for (unsigned int i = 0; i < NumWords; i++)
+    {
+        int n = NumChars - i * 8 < 8 ? NumChars - i * 8 : 8;
+        store_word(buf + i * 8, words[i], n);
+    }
     return 0;
 }
 
@@ -63,37 +102,23 @@ RC bitmap::to_char_buf(char * buf, int len) const
 //
 void bitmap::set(unsigned int pos, bool sign)
 {
-    int byte, offset;
-    
     if (pos != UINT_MAX)
     {
         assert(pos < size);
         // set given bit to 1/0
-        byte = pos / 8;
-        offset = pos % 8;  
         if(sign)
         {
-            buffer[byte] |= (1 << offset); 
+            words[pos / 64] |= 1ULL << (pos % 64);
         }
         else
         {
-            buffer[byte] &= ~(1 << offset);
+            words[pos / 64] &= ~(1ULL << (pos % 64));
         }
     }else {
-        // set all bits to 1/0
-        for(pos = 0; pos < size; pos++)
-        {
-            byte = pos / 8;
-            offset = pos % 8;  
-            if(sign)
-            {
-                buffer[byte] |= (1 << offset); 
-            }
-            else
-            {
-                buffer[byte] &= ~(1 << offset);
-            }
-        }
+        // set all bits to 1/0, keeping the bits past 'size' clear
+        memset((void*)words, sign ? 0xFF : 0, NumWords * sizeof(*words));
+        if (sign && size % 64 != 0)
+            words[NumWords - 1] = (1ULL << (size % 64)) - 1;
     }
     
 }
@@ -107,8 +132,103 @@ RC bitmap::getSize() const
 bool bitmap::test(unsigned int bitNumber) const
 {
     assert(bitNumber <= size - 1);
-    int byte = bitNumber/8;
-    int offset = bitNumber%8;
+    return (words[bitNumber / 64] >> (bitNumber % 64)) & 1;
+}
+
+
+int bitmap::firstClear(unsigned int from) const
+{
+    for (unsigned int i = from / 64; i < NumWords; i++)
+    {
+        unsigned long long w = ~words[i];
+        if (i == from / 64)
+            w &= ~0ULL << (from % 64);
+        if (w != 0)
+        {
+            unsigned int bit = i * 64 + __builtin_ctzll(w);
+            return bit < size ? (int)bit : -1;
+        }
+    }
+    return -1;
+}
+
+
+int bitmap::firstSet(unsigned int from) const
+{
+    for (unsigned int i = from / 64; i < NumWords; i++)
+    {
+        unsigned long long w = words[i];
+        if (i == from / 64)
+            w &= ~0ULL << (from % 64);
+        if (w != 0)
+        {
+            unsigned int bit = i * 64 + __builtin_ctzll(w);
+            return bit < size ? (int)bit : -1;
+        }
+    }
+    return -1;
+}
+
+
+int bitmap::count() const
+{
+    int cnt = 0;
+    for (unsigned int i = 0; i < NumWords; i++)
+        cnt += __builtin_popcountll(words[i]);
+    return cnt;
+}
+
+
+//
+// first bit at or after 'from' in 'map' that is set, or clear if
+// 'bClear', -1 if none
+//
+static int find_bit(const char *map, int numBits, int from, bool bClear)
+{
+    int numBytes = (numBits + 7) / 8;
+    if (from < 0)
+        from = 0;
+    for (int off = from / 64 * 8; off < numBytes; off += 8)
+    {
+        int n = numBytes - off < 8 ? numBytes - off : 8;
+        unsigned long long w = load_word(map + off, n);
+        if (bClear)
+            w = ~w;
+        if (off == from / 64 * 8)
+            w &= ~0ULL << (from % 64);
+        if (w != 0)
+        {
+            int bit = off * 8 + __builtin_ctzll(w);
+            return bit < numBits ? bit : -1;
+        }
+    }
+    return -1;
+}
+
+
+int bitmap::FindClear(const char *map, int numBits, int from)
+{
+    return find_bit(map, numBits, from, true);
+}
+
 
-    return buffer[byte] & (1 << offset);
-}
\ No newline at end of file
+int bitmap::FindSet(const char *map, int numBits, int from)
+{
+    return find_bit(map, numBits, from, false);
+}
+
+
+int bitmap::CountSet(const char *map, int numBits)
+{
+    int numBytes = (numBits + 7) / 8;
+    int cnt = 0;
+    for (int off = 0; off < numBytes; off += 8)
+    {
+        int n = numBytes - off < 8 ? numBytes - off : 8;
+        unsigned long long w = load_word(map + off, n);
+        if (numBits - off * 8 < 64)
+            w &= (1ULL << (numBits - off * 8)) - 1;
+        cnt += __builtin_popcountll(w);
+    }
+    return cnt;
+}
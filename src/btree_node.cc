@@ -9,14 +9,23 @@
 #include <iostream>
 #include <string.h>
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "btree_node.h"
 
+// FindKey binary searches until this many keys are left, then scans them
+#define BTREE_SCAN_KEYS 16
+
+template <>
+int BtreeNode::FindKeyT<char *>(void *key) const;
+
 
 // 
 // the page musted be pinned before any call to BtreeNode 
 //
 BtreeNode::BtreeNode(AttrType _attrType, int _attrLength,
-                PF_PageHandle& ph, bool fromDisk = true, int pageSize = 4092)
+                PF_PageHandle& ph, bool fromDisk = true, int pageSize = IX_PAGE_SIZE)
 {
     maxKeys = (pageSize - sizeof(numKeys) - 2*sizeof(PageNum))
                 / (sizeof(RID)+_attrLength); 
@@ -29,6 +38,22 @@ BtreeNode::BtreeNode(AttrType _attrType, int _attrLength,
     keys = pData;
     rids = (RID*) (pData + _attrLength * maxKeys);
 
+    switch (attrType)
+    {
+    case INT:{
+        cmpKeyFn = CmpKeyT<int>;
+        findKeyFn = &BtreeNode::FindKeyT<int>;
+        }break;
+    case FLOAT:{
+        cmpKeyFn = CmpKeyT<float>;
+        findKeyFn = &BtreeNode::FindKeyT<float>;
+        }break;
+    default:{
+        cmpKeyFn = CmpKeyT<char *>;
+        findKeyFn = &BtreeNode::FindKeyT<char *>;
+        }break;
+    }
+
     //
     // Page Layout
     //  maxKeys * key - takes up maxKeys * attrLength
@@ -157,35 +182,61 @@ int BtreeNode::SetRid(int pos, const RID rid)
 
 //
 // compare key a and key b
-// return 1 if a > b
+// return >0 if a > b
 // return 0 if a = b
-// return -1 if a < b
+// return <0 if a < b
 //
 int BtreeNode::CmpKey(void *a, void *b) const
 {
-    switch (attrType)
+    return cmpKeyFn(a, b);
+}
+
+
+//
+// number of keys in [lo, hi) less than 'key', keys being sorted
+//
+template <typename KeyT>
+static inline int scan_less(const KeyT *keys, int lo, int hi, KeyT key)
+{
+    while (lo < hi && keys[lo] < key)
+        lo++;
+    return lo;
+}
+
+#ifdef __SSE2__
+// keys less than 'key' form a prefix of each group of four
+template <>
+inline int scan_less<int>(const int *keys, int lo, int hi, int key)
+{
+    __m128i vk = _mm_set1_epi32(key);
+    for (; lo + 4 <= hi; lo += 4)
     {
-    case STRING:{
-        return strcmp((char *)a, (char *)b);
-        }break;
-    case FLOAT:{
-        float fa = *(float *)a;
-        float fb = *(float *)b;
-        if (fa >  fb) return 1;
-        if (fa == fb) return 0;
-        if (fa <  fb) return -1;
-        }break;
-    case INT:{
-        int fa = *(int *)a;
-        int fb = *(int *)b;
-        if (fa >  fb) return 1;
-        if (fa == fb) return 0;
-        if (fa <  fb) return -1;
-        }break;
+        __m128i v = _mm_loadu_si128((const __m128i *)(keys + lo));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, vk)));
+        if (mask != 0xF)
+            return lo + __builtin_popcount(mask);
     }
+    while (lo < hi && keys[lo] < key)
+        lo++;
+    return lo;
+}
 
-    return 0;
+template <>
+inline int scan_less<float>(const float *keys, int lo, int hi, float key)
+{
+    __m128 vk = _mm_set1_ps(key);
+    for (; lo + 4 <= hi; lo += 4)
+    {
+        __m128 v = _mm_loadu_ps(keys + lo);
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(v, vk));
+        if (mask != 0xF)
+            return lo + __builtin_popcount(mask);
+    }
+    while (lo < hi && keys[lo] < key)
+        lo++;
+    return lo;
 }
+#endif
 
 
 //
@@ -194,14 +245,45 @@ int BtreeNode::CmpKey(void *a, void *b) const
 //
 int BtreeNode::FindKey(void *key) const
 {
-    int i = 0;
-    while (i < numKeys)
+    return (this->*findKeyFn)(key);
+}
+
+
+//
+// keys are sorted, so the position of given key is the number of keys
+// less than it
+//
+template <typename KeyT>
+int BtreeNode::FindKeyT(void *key) const
+{
+    KeyT k = *(KeyT *)key;
+    KeyT *tkeys = (KeyT *)keys;
+    int lo = 0, hi = numKeys;
+    while (hi - lo > BTREE_SCAN_KEYS)
     {
-        if (CmpKey(key, (void *)(keys + attrLength * i)) <= 0)
-            break;
-        i++;
+        int mid = (lo + hi) / 2;
+        if (k <= tkeys[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return scan_less<KeyT>(tkeys, lo, hi, k);
+}
+
+// STRING keys are attrLength bytes apart
+template <>
+int BtreeNode::FindKeyT<char *>(void *key) const
+{
+    int lo = 0, hi = numKeys;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (CmpKeyT<char *>(key, keys + attrLength * mid) <= 0)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
-    return i;
+    return lo;
 }
 
 
@@ -220,15 +302,9 @@ int BtreeNode::Insert(void* newKey, const RID& newRid, int pos)
 
     if (pos < numKeys)
     {
-        for (int p = attrLength * numKeys - 1; 
-                p >= attrLength * pos; p--)
-        {
-            keys[p+attrLength] = keys[p];
-        }
-        for (int p = numKeys; p > pos; p--)
-        {
-            rids[p] = rids[p-1];
-        }
+        memmove(keys + attrLength * (pos + 1), keys + attrLength * pos,
+                attrLength * (numKeys - pos));
+        memmove(rids + pos + 1, rids + pos, sizeof(RID) * (numKeys - pos));
     }
 
     SetKey(pos, newKey);
@@ -270,10 +346,9 @@ int BtreeNode::Remove(int pos)
     {
         return -2;
     }else {
-        for (int p = attrLength * pos; p <= attrLength * (numKeys - 1) - 1; p++)
-            keys[p] = keys[p + attrLength];
-        for (int p = pos; p < numKeys - 1; p++)
-            rids[p] = rids[p + 1];
+        memmove(keys + attrLength * pos, keys + attrLength * (pos + 1),
+                attrLength * (numKeys - pos - 1));
+        memmove(rids + pos, rids + pos + 1, sizeof(RID) * (numKeys - pos - 1));
     }
     
     SetNumKeys(GetNumKeys() - 1);
@@ -6,12 +6,42 @@
 // Author:     Haris Wang (dynmiw@gmail.com)
 //
 
+#include <string.h>
 #include "wsql.h"
 #include "pf.h"
 #include "rm_rid.h"
 #include "ix_error.h"
 
 
+// # of bytes of an index page unless given otherwise: a PF page of one
+// device block, less its PF_PageHdr
+const int IX_PAGE_SIZE = PF_FRAME_ALIGN - sizeof(PF_PageHdr);
+
+
+//
+// compare key a and key b of type KeyT
+// return >0 if a > b
+// return 0 if a = b
+// return <0 if a < b
+// The keys may be unaligned, e.g. records read in place in RM pages.
+//
+template <typename KeyT>
+inline int CmpKeyT(const void *a, const void *b)
+{
+    KeyT ka, kb;
+    memcpy(&ka, a, sizeof(KeyT));
+    memcpy(&kb, b, sizeof(KeyT));
+    return (ka > kb) - (ka < kb);
+}
+
+// STRING keys are null-terminated
+template <>
+inline int CmpKeyT<char *>(const void *a, const void *b)
+{
+    return strcmp((const char *)a, (const char *)b);
+}
+
+
 class BtreeNode {
 private:
     char     *keys;
@@ -22,6 +52,12 @@ private:
     PageNum  pageId;
     int      maxKeys;
 
+    // comparison and search for the key type, chosen when the node is built
+    int (*cmpKeyFn)(const void *a, const void *b);
+    int (BtreeNode::*findKeyFn)(void *key) const;
+    template <typename KeyT>
+    int FindKeyT(void *key) const;
+
 public:
     BtreeNode(AttrType _attrType, int _attrLength,
                 PF_PageHandle& ph, bool fromDisk, int pageSize);
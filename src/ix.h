@@ -30,11 +30,17 @@ struct IX_FileHdr {
 
 
 
+class IX_BulkLoader;
+
+// If 'entries' is given, the new index is built from them in one pass
 RC CreateIXFile(const char *fileName,
-                AttrType attrType, int attrLength, int pageSize = 4092);
+                AttrType attrType, int attrLength, int pageSize = IX_PAGE_SIZE,
+                IX_BulkLoader *entries = NULL);
 
 RC DestroyIXFile(const char *fileName);
 
+void IX_PrintError(RC rc);
+
 
 class IX_IndexHandle {
 private:
@@ -76,4 +82,60 @@ public:
 };
 
 
+
+// Default fraction of each node filled by IX_BulkLoader
+#define IX_BULK_FILL 0.9
+// Bytes of (key, RID) pairs IX_BulkLoader sorts in memory at a time
+#define IX_SORT_BUF_SIZE (4 << 20)
+
+
+//
+// IX_BulkLoader: build an index bottom-up from (key, RID) pairs
+//
+// Pairs are added in any order.  They are sorted in memory, and when
+// more than IX_SORT_BUF_SIZE bytes are added, sorted runs are spilled to
+// temporary files and merged.  Build() then packs the sorted pairs into
+// leaves filled to 'fillFactor' and builds each internal level from the
+// level below, writing every page once.
+//
+class IX_BulkLoader {
+private:
+    AttrType attrType;
+    int      attrLength;
+    int      entrySize;           // attrLength + sizeof(RID)
+    float    fillFactor;
+    int      (*cmpKeyFn)(const void *a, const void *b);
+
+    char     *buf;                // pairs not written to a run yet
+    int      numBuf;
+    int      maxBuf;
+    FILE     **runs;              // sorted runs on disk
+    int      numRuns;
+    long long numEntries;
+
+    RC  SortBuf();
+    RC  SpillBuf();
+    RC  BuildLevel(PF_FileHandle &pfh, IX_FileHdr &hdr, char *&level,
+                   int &numLevel, bool bLeaf);
+    RC  NextEntry(char *&entry);
+    RC  OpenMerge();
+
+    // merge state
+    char     *runHeads;           // current pair of each run
+    bool     *runLive;
+    int      bufPos;
+
+public:
+    IX_BulkLoader(AttrType _attrType, int _attrLength,
+                  float _fillFactor = IX_BULK_FILL);
+    ~IX_BulkLoader();
+
+    RC AddEntry(void *key, const RID &rid);
+    long long GetNumEntries() const { return numEntries; }
+
+    // Build the tree in an empty index file, called by CreateIXFile
+    RC Build(PF_FileHandle &pfh, IX_FileHdr &hdr);
+};
+
+
 #endif
\ No newline at end of file
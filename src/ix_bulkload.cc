@@ -0,0 +1,347 @@
+//
+// File:        ix_bulkload.cc
+//
+// Description: IX_BulkLoader class implementation
+//
+// Author:     Haris Wang (dynmiw@gmail.com)
+//
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "ix.h"
+using namespace std;
+
+
+IX_BulkLoader::IX_BulkLoader(AttrType _attrType, int _attrLength,
+                             float _fillFactor)
+{
+    attrType = _attrType;
+    attrLength = _attrLength;
+    entrySize = attrLength + sizeof(RID);
+    fillFactor = _fillFactor;
+    switch (attrType)
+    {
+    case INT:   cmpKeyFn = CmpKeyT<int>; break;
+    case FLOAT: cmpKeyFn = CmpKeyT<float>; break;
+    default:    cmpKeyFn = CmpKeyT<char *>; break;
+    }
+
+    maxBuf = max(IX_SORT_BUF_SIZE / entrySize, 1);
+    buf = new char[maxBuf * entrySize];
+    numBuf = 0;
+    runs = NULL;
+    numRuns = 0;
+    numEntries = 0;
+    runHeads = NULL;
+    runLive = NULL;
+    bufPos = 0;
+}
+
+
+IX_BulkLoader::~IX_BulkLoader()
+{
+    for (int i = 0; i < numRuns; i++)
+        fclose(runs[i]);
+    delete[] runs;
+    delete[] runHeads;
+    delete[] runLive;
+    delete[] buf;
+}
+
+
+//
+// add pair (key, rid) to the index to be built
+// return 0 if success
+//
+RC IX_BulkLoader::AddEntry(void *key, const RID &rid)
+{
+    RC rc;
+    if (numBuf == maxBuf && (rc = SpillBuf()))
+        return rc;
+
+    char *entry = buf + numBuf * entrySize;
+    memcpy(entry, key, attrLength);
+    memcpy(entry + attrLength, &rid, sizeof(RID));
+    numBuf++;
+    numEntries++;
+    return 0;
+}
+
+
+//
+// sort the pairs in buf by key, then by RID
+//
+RC IX_BulkLoader::SortBuf()
+{
+    vector<int> order(numBuf);
+    for (int i = 0; i < numBuf; i++)
+        order[i] = i;
+
+    sort(order.begin(), order.end(), [this](int a, int b) {
+        char *ea = buf + a * entrySize;
+        char *eb = buf + b * entrySize;
+        int res = cmpKeyFn(ea, eb);
+        if (res != 0)
+            return res < 0;
+        RID *ra = (RID *)(ea + attrLength);
+        RID *rb = (RID *)(eb + attrLength);
+        if (ra->page != rb->page)
+            return ra->page < rb->page;
+        return ra->slot < rb->slot;
+    });
+
+    char *sorted = new char[maxBuf * entrySize];
+    for (int i = 0; i < numBuf; i++)
+        memcpy(sorted + i * entrySize, buf + order[i] * entrySize, entrySize);
+    delete[] buf;
+    buf = sorted;
+    return 0;
+}
+
+
+//
+// write the pairs in buf to a new sorted run
+//
+RC IX_BulkLoader::SpillBuf()
+{
+    RC rc;
+    if ((rc = SortBuf()))
+        return rc;
+
+    FILE *fp = tmpfile();
+    if (fp == NULL)
+        return IX_UNIX;
+    if (fwrite(buf, entrySize, numBuf, fp) != (size_t)numBuf)
+    {
+        fclose(fp);
+        return IX_UNIX;
+    }
+
+    FILE **newRuns = new FILE*[numRuns + 1];
+    memcpy(newRuns, runs, numRuns * sizeof(FILE *));
+    delete[] runs;
+    runs = newRuns;
+    runs[numRuns++] = fp;
+    numBuf = 0;
+    return 0;
+}
+
+
+//
+// rewind every run and read its first pair
+//
+RC IX_BulkLoader::OpenMerge()
+{
+    runHeads = new char[numRuns * entrySize];
+    runLive = new bool[numRuns];
+    for (int i = 0; i < numRuns; i++)
+    {
+        rewind(runs[i]);
+        runLive[i] = fread(runHeads + i * entrySize, entrySize, 1, runs[i]) == 1;
+    }
+    return 0;
+}
+
+
+//
+// point entry to the next pair in sorted order
+// return 0 if success
+// return IX_EOF if there is no more pair
+//
+RC IX_BulkLoader::NextEntry(char *&entry)
+{
+    if (numRuns == 0)
+    {
+        if (bufPos == numBuf)
+            return IX_EOF;
+        entry = buf + bufPos * entrySize;
+        bufPos++;
+        return 0;
+    }
+
+    // merge the runs, buf is free to hold the pair returned
+    int best = -1;
+    for (int i = 0; i < numRuns; i++)
+    {
+        if (!runLive[i])
+            continue;
+        if (best == -1)
+        {
+            best = i;
+            continue;
+        }
+        char *ea = runHeads + i * entrySize;
+        char *eb = runHeads + best * entrySize;
+        int res = cmpKeyFn(ea, eb);
+        RID *ra = (RID *)(ea + attrLength);
+        RID *rb = (RID *)(eb + attrLength);
+        if (res < 0
+            || (res == 0 && (ra->page < rb->page
+                             || (ra->page == rb->page && ra->slot < rb->slot))))
+            best = i;
+    }
+    if (best == -1)
+        return IX_EOF;
+
+    char *head = runHeads + best * entrySize;
+    memcpy(buf, head, entrySize);
+    runLive[best] = fread(head, entrySize, 1, runs[best]) == 1;
+    entry = buf;
+    return 0;
+}
+
+
+//
+// pack one level of the tree into nodes, left to right.
+// Leaves take the sorted pairs; an internal level takes 'level', the
+// (largest key, child page) pairs of the level below.  On return,
+// 'level' holds the pairs of the nodes just written.
+// return 0 if success
+//
+RC IX_BulkLoader::BuildLevel(PF_FileHandle &pfh, IX_FileHdr &hdr,
+                             char *&level, int &numLevel, bool bLeaf)
+{
+    RC rc = 0;
+    PF_PageHandle ph;
+    BtreeNode *node = NULL, *prev = NULL;
+    int perNode = -1;
+
+    int maxUpper = bLeaf ? 16 : numLevel / 2 + 1;
+    char *upper = new char[maxUpper * entrySize];
+    int numUpper = 0;
+
+    int pos = 0;
+    char *entry;
+    while (1)
+    {
+        if (bLeaf)
+        {
+            rc = NextEntry(entry);
+            if (rc == IX_EOF)
+                break;
+            if (rc != 0)
+                goto err;
+        }else {
+            if (pos == numLevel)
+                break;
+            entry = level + pos * entrySize;
+            pos++;
+        }
+
+        if (node == NULL || node->GetNumKeys() == perNode)
+        {
+            // keep at most two nodes of the level pinned
+            if (prev != NULL)
+            {
+                pfh.MarkDirty(prev->GetPageId());
+                pfh.UnpinPage(prev->GetPageId());
+                delete prev;
+                prev = NULL;
+            }
+            if ((rc = pfh.AllocatePage(ph)))
+                goto err;
+            BtreeNode *newNode = new BtreeNode(attrType, attrLength, ph,
+                                               false, hdr.pageSize);
+            hdr.numPages++;
+            if (perNode == -1)
+            {
+                hdr.maxKeys = newNode->GetMaxKeys();
+                perNode = (int)(hdr.maxKeys * fillFactor);
+                perNode = max(min(perNode, hdr.maxKeys), 2);
+            }
+
+            if (node != NULL)
+            {
+                // node is full, link it and pass its largest key up
+                node->SetRight(newNode->GetPageId());
+                newNode->SetLeft(node->GetPageId());
+                prev = node;
+            }
+            node = newNode;
+        }
+
+        node->Insert(entry, *(RID *)(entry + attrLength), node->GetNumKeys());
+
+        // the last pair of a node is its largest key
+        if (node->GetNumKeys() == 1)
+        {
+            if (numUpper == maxUpper)
+            {
+                char *grown = new char[2 * maxUpper * entrySize];
+                memcpy(grown, upper, numUpper * entrySize);
+                delete[] upper;
+                upper = grown;
+                maxUpper *= 2;
+            }
+            RID child(node->GetPageId(), -1);
+            memcpy(upper + numUpper * entrySize + attrLength, &child, sizeof(RID));
+            numUpper++;
+        }
+        memcpy(upper + (numUpper - 1) * entrySize, entry, attrLength);
+    }
+    rc = 0;
+
+err:
+    if (prev != NULL)
+    {
+        pfh.MarkDirty(prev->GetPageId());
+        pfh.UnpinPage(prev->GetPageId());
+        delete prev;
+    }
+    if (node != NULL)
+    {
+        pfh.MarkDirty(node->GetPageId());
+        pfh.UnpinPage(node->GetPageId());
+        delete node;
+    }
+
+    delete[] level;
+    level = upper;
+    numLevel = numUpper;
+    return rc;
+}
+
+
+//
+// write the tree of all added pairs to the empty index file pfh,
+// update hdr accordingly.  Nothing is written if no pair was added.
+// return 0 if success
+//
+RC IX_BulkLoader::Build(PF_FileHandle &pfh, IX_FileHdr &hdr)
+{
+    RC rc;
+    if (numEntries == 0)
+        return 0;
+
+    if (numRuns == 0)
+    {
+        if ((rc = SortBuf()))
+            return rc;
+    }else {
+        if ((numBuf > 0 && (rc = SpillBuf()))
+            || (rc = OpenMerge()))
+            return rc;
+    }
+    bufPos = 0;
+
+    char *level = NULL;
+    int numLevel = 0;
+    hdr.height = 0;
+    bool bLeaf = true;
+    do {
+        if ((rc = BuildLevel(pfh, hdr, level, numLevel, bLeaf)))
+        {
+            delete[] level;
+            return rc;
+        }
+        hdr.height++;
+        bLeaf = false;
+    } while (numLevel > 1);
+
+    hdr.rootPage = ((RID *)(level + attrLength))->page;
+    delete[] level;
+    return 0;
+}
@@ -0,0 +1,68 @@
+//
+// File:        ix_error.cc
+// Description: IX_PrintError function
+//
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "ix.h"
+
+using namespace std;
+
+//
+// Error table
+//
+static char *IX_WarnMsg[] = {
+  (char*)"key not found",
+  (char*)"invalid key size",
+  (char*)"entry already exists",
+  (char*)"no such entry"
+};
+
+static char *IX_ErrorMsg[] = {
+  (char*)"key size too big",
+  (char*)"error in PF",
+  (char*)"bad index page",
+  (char*)"cannot create index file",
+  (char*)"index handle already open",
+  (char*)"cannot open index file",
+  (char*)"index file not open",
+  (char*)"invalid rid",
+  (char*)"invalid key",
+  (char*)"end of index file"
+};
+
+//
+// IX_PrintError
+//
+// Desc: Send a message corresponding to an IX return code to cerr,
+//       PF return codes are passed on to PF_PrintError
+//       Assumes IX_UNIX is last valid IX return code
+// In:   rc - return code for which a message is desired
+//
+void IX_PrintError(RC rc)
+{
+  // Check the return code is within proper limits
+  if (rc >= START_IX_WARN && rc <= IX_LASTWARN)
+    // Print warning
+    cerr << "IX warning: " << IX_WarnMsg[rc - START_IX_WARN] << "\n";
+  // Error codes are negative, so invert everything
+  else if (-rc >= -START_IX_ERR && -rc < -IX_LASTERROR)
+    // Print error
+    cerr << "IX error: " << IX_ErrorMsg[-rc + START_IX_ERR] << "\n";
+  else if (rc == IX_UNIX)
+#ifdef PC
+      cerr << "OS error\n";
+#else
+      cerr << strerror(errno) << "\n";
+#endif
+  else if ((rc >= START_PF_WARN && rc < START_RM_WARN)
+           || (rc <= START_PF_ERR && rc > START_RM_ERR))
+    PF_PrintError(rc);
+  else if (rc == 0)
+    cerr << "IX_PrintError called with return code of 0\n";
+  else
+    cerr << "IX error: " << rc << " is out of bounds\n";
+}
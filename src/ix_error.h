@@ -12,7 +12,7 @@
 #define IX_INVALIDSIZE (START_IX_WARN + 1)
 #define IX_ENTRYEXISTS (START_IX_WARN + 2)
 #define IX_NOSUCHENTRY (START_IX_WARN + 3)
-#define IX_LASTWARN IX_ENTRYEXISTS
+#define IX_LASTWARN IX_NOSUCHENTRY
 
 #define IX_SIZETOOBIG      (START_IX_ERR - 0)  // key size too big
 #define IX_PF              (START_IX_ERR - 1)  // error in PF
@@ -24,7 +24,8 @@
 #define IX_BADRID          (START_IX_ERR - 7)
 #define IX_BADKEY          (START_IX_ERR - 8)
 #define IX_EOF             (START_IX_ERR - 9)  // end of file
+#define IX_UNIX            (START_IX_ERR - 10) // Unix error
 
-#define IX_LASTERROR IX_EOF
+#define IX_LASTERROR IX_UNIX
 
 #endif
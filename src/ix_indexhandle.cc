@@ -29,11 +29,14 @@ void IX_FileHdr::print()
 
 //
 // create index file with given name on disk, 
-// initialize its FileHeader in page 0
+// initialize its FileHeader in page 0.
+// If 'entries' is given, build the tree from them.
+// The file is removed again if it cannot be completed.
 // return 0 if success
 //
 RC CreateIXFile(const char *fileName, 
-                AttrType attrType, int attrLength, int pageSize)
+                AttrType attrType, int attrLength, int pageSize,
+                IX_BulkLoader *entries)
 {
     // check the attrType & attrLength valid or not
     switch (attrType)
@@ -59,14 +62,22 @@ RC CreateIXFile(const char *fileName,
     PF_FileHandle *pfh = new PF_FileHandle;
     PF_PageHandle *headerPage = new PF_PageHandle;
     char *pData;
-    if ((rc = PF_CreateFile(fileName, pageSize))
-        || (rc = pfh->OpenFile(fileName))
+    if ((rc = PF_CreateFile(fileName, pageSize)))
+    {
+        delete headerPage;
+        delete pfh;
+        IX_PrintError(rc);
+        return rc;
+    }
+    if ((rc = pfh->OpenFile(fileName))
         || (rc = pfh->AllocatePage(*headerPage))
         || (rc = headerPage->GetData(pData)))
     {
         delete headerPage;
+        pfh->CloseFile();
         delete pfh;
-        PF_PrintError(rc);
+        PF_DestroyFile(fileName);
+        IX_PrintError(rc);
         return rc;
     }
     delete headerPage;
@@ -79,6 +90,16 @@ RC CreateIXFile(const char *fileName,
     hdr->height = 0;
     hdr->attrType = attrType;
     hdr->attrLength = attrLength;
+    if (entries != NULL && (rc = entries->Build(*pfh, *hdr)))
+    {
+        delete hdr;
+        pfh->UnpinPage(0);
+        pfh->CloseFile();
+        delete pfh;
+        PF_DestroyFile(fileName);
+        IX_PrintError(rc);
+        return rc;
+    }
     memcpy(pData, hdr, sizeof(IX_FileHdr));
     delete hdr;
 
@@ -87,7 +108,8 @@ RC CreateIXFile(const char *fileName,
         || (rc = pfh->CloseFile()))
     {
         delete pfh;
-        PF_PrintError(rc);
+        PF_DestroyFile(fileName);
+        IX_PrintError(rc);
         return rc;
     }
     delete pfh;
@@ -595,6 +617,15 @@ RC IX_IndexHandle::SetCurrNode(PageNum page)
     pfh->UnpinPage(currNode->GetPageId());
     delete currNode;
     currNode = GetNewNode(&ph, page);
+
+    // a scan on a leaf goes on to its sibling next, ask for it early
+    if (currNode->GetNumKeys() > 0 && currNode->GetRidAt(0)->slot != -1)
+    {
+        PageNum next = (cmpOp == LT_OP || cmpOp == LE_OP) ? currNode->GetLeft()
+                                                          : currNode->GetRight();
+        if (next != -1)
+            pfh->PrefetchPage(next);
+    }
     return 0;
 }
 
@@ -16,6 +16,20 @@
 //
 // 2021: Change fixed page size to customed page size
 //
+// 2021: Pages may be pinned read-only, which lets the pages of a mapped
+//       file be used in place, see PF_SetMappedReads.
+// 2021: Files may be opened for direct I/O, so that their pages are only
+//       cached by the buffer pool, see OpenFile.  Pages on disk must be
+//       a multiple of PF_FRAME_ALIGN bytes for that.
+// 2021: Version 2 of the file format.  The file header carries a magic
+//       number and a version, and pages are laid out on disk every
+//       pageStride bytes, pageSize rounded up to PF_FRAME_ALIGN, so that
+//       no page straddles a device block.  Version 1 files are still
+//       read; PF_UpgradeFile converts them.
+// 2021: Threads may share the buffer pool and the files.  A page pinned
+//       by several threads is latched to be read or changed, see
+//       LatchPage.
+//
 
 #ifndef PF_H
 #define PF_H
@@ -64,7 +78,11 @@ private:
 struct PF_FileHdr {
    int firstFree;     // first free page in the linked list
    int numPages;      // # of pages in the file
-   int pageSize;      // exact size of page on disk
+   int pageSize;      // exact size of page, with its PF_PageHdr
+   int magic;         // PF_FILE_MAGIC, 0 in version 1 files
+   int version;       // file format version, 0 in version 1 files
+   int pageStride;    // # of bytes a page takes on disk, a multiple of
+                      // PF_FRAME_ALIGN; pageSize in version 1 files
 };
 
 //
@@ -85,7 +103,9 @@ public:
    PF_FileHandle& operator=(const PF_FileHandle &fileHandle);
 
 
-   RC OpenFile(const char *fileName);
+   // Open a file.  With bDirect, or after PF_SetDirectIO, the file is
+   // read and written around the OS page cache if it allows it.
+   RC OpenFile(const char *fileName, int bDirect = false);
    RC CloseFile();
    // Three methods that manipulate the buffer manager.  The calls are
    // forwarded to the PF_BufferMgr instance and are called by parse.y
@@ -114,21 +134,31 @@ public:
    RC DisposeBlock  (char *buffer);
 
 
+   // Five methods that get a page pinned in the buffer.  A page got
+   // bReadOnly must not be changed or marked dirty through that pin.
+
    // Get the first page
-   RC GetFirstPage(PF_PageHandle &pageHandle) const;
+   RC GetFirstPage(PF_PageHandle &pageHandle, int bReadOnly = false) const;
    // Get the next page after current
-   RC GetNextPage (PageNum current, PF_PageHandle &pageHandle) const;
+   RC GetNextPage (PageNum current, PF_PageHandle &pageHandle,
+                   int bReadOnly = false) const;
    // Get a specific page
-   RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle) const;
+   RC GetThisPage (PageNum pageNum, PF_PageHandle &pageHandle,
+                   int bReadOnly = false) const;
    // Get the last page
-   RC GetLastPage(PF_PageHandle &pageHandle) const;
+   RC GetLastPage(PF_PageHandle &pageHandle, int bReadOnly = false) const;
    // Get the prev page after current
-   RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle) const;
+   RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle,
+                   int bReadOnly = false) const;
 
    RC AllocatePage(PF_PageHandle &pageHandle);    // Allocate a new page
    RC DisposePage (PageNum pageNum);              // Dispose of a page
    RC MarkDirty   (PageNum pageNum) const;        // Mark page as dirty
    RC UnpinPage   (PageNum pageNum) const;        // Unpin the page
+   // Latch a pinned page shared, to read it, or exclusive, to change it
+   RC LatchPage   (PageNum pageNum, int bExclusive) const;
+   RC UnlatchPage (PageNum pageNum) const;        // Release the latch
+   RC PrefetchPage(PageNum pageNum) const;        // Hint a page is needed soon
 
    // Flush pages from buffer pool.  Will write dirty pages to disk.
    RC FlushPages  () const;
@@ -141,17 +171,51 @@ private:
    // IsValidPageNum will return true if page number is valid and false
    // otherwise
    int IsValidPageNum (PageNum pageNum) const;
+   // # of bytes a page takes on disk
+   int GetPageStride  () const;
+   // Write the file header back to the file
+   RC WriteHdr        () const;
 
    PF_BufferMgr *pBufferMgr;
    PF_FileHdr hdr;                                // file header
    int bFileOpen;                                 // file open flag
    int bHdrChanged;                               // dirty flag for file hdr
    int unixfd;                                    // OS file descriptor
+   int fileId;                                    // buffer file id
+   int bDirect;                                   // opened for direct I/O
 };
 
 
 RC PF_CreateFile    (const char *fileName, int _pageSize);       // Create a new file
 RC PF_DestroyFile   (const char *fileName);       // Delete a file
+// Convert a file to the current file format.  The file must not be open.
+RC PF_UpgradeFile   (const char *fileName);
+
+// All open files share one buffer pool.  Set the number of pages it
+// holds; the pool is resized if it already exists.
+RC PF_SetBufferSize (int numPages);
+
+//
+// PF_ReplacePolicy: how the buffer pool chooses the page to replace
+//
+enum PF_ReplacePolicy {
+   PF_REPLACE_LRU,      // least recently used page
+   PF_REPLACE_CLOCK,    // CLOCK sweep, one reference bit per page
+   PF_REPLACE_2Q        // 2Q, pages used once are replaced first
+};
+
+// Set the replacement policy of the buffer pool.  An existing pool is
+// emptied first, as by PF_SetBufferSize.
+RC PF_SetReplacePolicy (PF_ReplacePolicy policy);
+
+// Map the files opened from now on.  A page pinned read-only that is
+// not in the buffer pool then points into the mapping instead of being
+// read into the pool.
+void PF_SetMappedReads (int bMappedReads);
+
+// Open the files opened from now on for direct I/O, as if OpenFile was
+// given bDirect.
+void PF_SetDirectIO (int bDirectIO);
 
 
 
@@ -160,8 +224,30 @@ RC PF_DestroyFile   (const char *fileName);       // Delete a file
 //
 // Constants and defines
 //
-const int PF_BUFFER_SIZE = 40;     // Number of pages in the buffer
-const int PF_HASH_TBL_SIZE = 20;   // Size of hash table
+const int PF_BUFFER_SIZE = 1024;   // Default number of pages in the buffer
+const int PF_HASH_TBL_SIZE = 32;   // Min size of hash table
+const int PF_FILE_TBL_SIZE = 16;   // Initial size of the buffer file table
+const int PF_BLOCK_SIZE = 4096;    // Size of blocks from AllocateBlock
+const PF_ReplacePolicy PF_REPLACE_POLICY = PF_REPLACE_2Q;
+                                   // Default replacement policy
+const int PF_READAHEAD_MIN = 4;    // First read-ahead window, in pages
+const int PF_READAHEAD_MAX = 32;   // Largest read-ahead window, in pages
+const int PF_IO_DEPTH = 64;        // Max # of page reads/writes in flight
+const int PF_IO_THREADS = 4;       // Workers when io_uring is not used
+const int PF_IO_MAXVEC = PF_READAHEAD_MAX;
+                                   // Max # of pages in one read/write
+const int PF_DIRTY_START = 25;     // % of the buffer dirty before the pages
+                                   // to be replaced are written behind
+const int PF_DIRTY_MAX = 75;       // % of the buffer dirty before writers
+                                   // wait for the dirty pages to be written
+const int PF_FRAME_ALIGN = 4096;   // Alignment and size unit of frames
+const int PF_HUGE_PAGE = 2 << 20;  // Huge page size tried for the frames
+const int PF_CACHE_LINE = 64;      // Size of a page descriptor
+const int PF_FILE_MAGIC = 0x46505357;  // "WSPF", marks a version 2+ file
+const int PF_FILE_VERSION = 2;     // Version of the files created
+const int PF_LATCH_SPINS = 100;    // Spins on a page latch before yielding
+const int PF_LATCH_YIELDS = 100;   // Yields before sleeping between tries
+const int PF_LATCH_SLEEP = 50;     // Microseconds slept between tries
 
 #define CREATION_MASK      0600    // r/w privileges to owner only
 #define PF_PAGE_LIST_END  -1       // end of list of free pages
@@ -203,7 +289,14 @@ void PF_PrintError(RC rc);
 #define PF_PAGEUNPINNED    (START_PF_WARN + 6) // page already unpinned
 #define PF_EOF             (START_PF_WARN + 7) // end of file
 #define PF_TOOSMALL        (START_PF_WARN + 8) // Resize buffer too small
-#define PF_LASTWARN        PF_TOOSMALL
+#define PF_PAGEREADONLY    (START_PF_WARN + 9) // page pinned read-only
+#define PF_BADPAGESIZE     (START_PF_WARN + 10) // invalid page size
+#define PF_BADVERSION      (START_PF_WARN + 11) // unknown file format
+#define PF_PAGEUNLATCHED   (START_PF_WARN + 12) // page is not latched
+#define PF_LATCHNOTHELD    (START_PF_WARN + 13) // latch held by another thread
+#define PF_LATCHHELD       (START_PF_WARN + 14) // page latched by caller already
+#define PF_PAGEMAPPED      (START_PF_WARN + 15) // page pinned read-only mapped
+#define PF_LASTWARN        PF_PAGEMAPPED
 
 #define PF_NOMEM           (START_PF_ERR - 0)  // no memory
 #define PF_NOBUF           (START_PF_ERR - 1)  // no buffer space
@@ -0,0 +1,403 @@
+//
+// File:        pf_bench.cc
+// Description: workloads to measure the PF layer
+// Authors:     Haris Wang (dynmiw@gmail.com)
+//
+// Built by "make bench", with PF_STATS so that hits and reads can be
+// counted.  Each workload prints what it measured; times are wall clock
+// and depend on whether the file is in the OS page cache.
+//
+//   ./pf_bench <workload> [file]
+//
+//   hash       lookups in a PF_HashTable holding 100000 pages
+//   replace    hit rates of LRU, CLOCK and 2Q: 256-page pool, 4096-page
+//              file, 20 rounds of 5000 lookups then a full scan; each
+//              lookup reads one of 64 hot pages and one random page
+//   scan       5 scans of a 16384-page file, buffer cleared before each
+//   flush      5 flushes of 4000 dirty pages, then 5 scans with some
+//              work per page, 4096-page pool
+//   writeback  append 16384 dirty pages then 50000 random updates,
+//              256-page pool
+//   mapped     3 warm scans read, then 3 mapped, 1024-page pool
+//   arena      3 scans into an empty 32768-page pool
+//
+// The file is created, with the number of pages the workload reads, when
+// it does not have them.  It is kept so that later runs find it in the
+// OS page cache.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <unistd.h>
+#include "pf.h"
+#include "pf_hashtable.h"
+#include "statistics.h"
+
+using namespace std;
+using namespace std::chrono;
+
+extern StatisticsMgr *pStatisticsMgr;
+
+const int BENCH_PAGE_SIZE = PF_BLOCK_SIZE;
+const int BENCH_FILE_PAGES = 16384;
+
+static steady_clock::time_point start;
+
+static void StartTimer()
+{
+   start = steady_clock::now();
+}
+
+static double Elapsed()
+{
+   return duration<double, milli>(steady_clock::now() - start).count();
+}
+
+//
+// value of a PF statistic, 0 if it was never registered
+//
+static int Stat(const char *key)
+{
+   int *piValue = pStatisticsMgr->Get(key);
+   int value = piValue ? *piValue : 0;
+   delete piValue;
+   return value;
+}
+
+//
+// create fileName with numPages pages unless it is there already
+//
+static RC MakeFile(const char *fileName, int numPages)
+{
+   RC rc;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   PageNum p;
+   char *pData;
+
+   if (access(fileName, F_OK) == 0) {
+      if ((rc = fh.OpenFile(fileName)))
+         return (rc);
+      p = fh.GetNumPages();
+      if ((rc = fh.CloseFile()))
+         return (rc);
+      if (p == numPages)
+         return (0);
+      if ((rc = PF_DestroyFile(fileName)))
+         return (rc);
+   }
+
+   if ((rc = PF_CreateFile(fileName, BENCH_PAGE_SIZE))
+         || (rc = fh.OpenFile(fileName)))
+      return (rc);
+   for (int i = 0; i < numPages; i++) {
+      if ((rc = fh.AllocatePage(ph))
+            || (rc = ph.GetPageNum(p))
+            || (rc = ph.GetData(pData)))
+         return (rc);
+      memset(pData, i, BENCH_PAGE_SIZE);
+      if ((rc = fh.MarkDirty(p)) || (rc = fh.UnpinPage(p)))
+         return (rc);
+   }
+   return (fh.CloseFile());
+}
+
+//
+// pin page p, touch every 64th byte of it, unpin it
+//
+static RC ReadPage(PF_FileHandle &fh, PageNum p, long &sum,
+      int bReadOnly = false)
+{
+   RC rc;
+   PF_PageHandle ph;
+   char *pData;
+
+   if ((rc = fh.GetThisPage(p, ph, bReadOnly)) || (rc = ph.GetData(pData)))
+      return (rc);
+   for (int i = 0; i < BENCH_PAGE_SIZE; i += 64)
+      sum += pData[i];
+   return (fh.UnpinPage(p));
+}
+
+static RC BenchHash(const char *)
+{
+   const int numPages = 100000;
+   const int numLookups = 1000000;
+   PF_HashTable table(PF_HASH_TBL_SIZE);
+   int slot;
+   long sum = 0;
+   unsigned key = 1;
+
+   for (int i = 0; i < numPages; i++)
+      table.Insert(3, i, i);
+   StartTimer();
+   for (int i = 0; i < numLookups; i++) {
+      key = key * 1103515245u + 12345u;
+      table.Find(3, (key >> 8) % numPages, slot);
+      sum += slot;
+   }
+   printf("%d lookups in %d pages: %.1f ns each (%ld)\n", numLookups,
+         numPages, Elapsed() * 1e6 / numLookups, sum & 1);
+   return (0);
+}
+
+static RC BenchReplace(const char *fileName)
+{
+   const int numPages = 4096;
+   const int numHot = 64;
+   const char *names[] = { "LRU", "CLOCK", "2Q" };
+   const PF_ReplacePolicy policies[] = {
+      PF_REPLACE_LRU, PF_REPLACE_CLOCK, PF_REPLACE_2Q };
+   RC rc;
+   long sum = 0;
+
+   if ((rc = MakeFile(fileName, numPages)))
+      return (rc);
+   printf("          overall hit   hot-page hit\n");
+   for (int i = 0; i < 3; i++) {
+      PF_FileHandle fh;
+      int hotGets = 0, hotHits = 0;
+
+      if ((rc = PF_SetReplacePolicy(policies[i]))
+            || (rc = PF_SetBufferSize(256))
+            || (rc = fh.OpenFile(fileName)))
+         return (rc);
+      int gets = Stat(PF_GETPAGE), hits = Stat(PF_PAGEFOUND);
+      srand(1);
+      for (int round = 0; round < 20; round++) {
+         for (int j = 0; j < 5000; j++) {
+            int found = Stat(PF_PAGEFOUND);
+            if ((rc = ReadPage(fh, rand() % numHot, sum)))
+               return (rc);
+            hotGets++;
+            hotHits += Stat(PF_PAGEFOUND) - found;
+            if ((rc = ReadPage(fh, numHot + rand() % (numPages - numHot),
+                  sum)))
+               return (rc);
+         }
+         for (PageNum p = 0; p < numPages; p++)
+            if ((rc = ReadPage(fh, p, sum)))
+               return (rc);
+      }
+      gets = Stat(PF_GETPAGE) - gets;
+      hits = Stat(PF_PAGEFOUND) - hits;
+      printf("  %-5s     %5.1f%%         %5.1f%%\n", names[i],
+            100.0 * hits / gets, 100.0 * hotHits / hotGets);
+      if ((rc = fh.CloseFile()))
+         return (rc);
+   }
+   return (0);
+}
+
+static RC BenchScan(const char *fileName)
+{
+   RC rc;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   PageNum p;
+
+   if ((rc = MakeFile(fileName, BENCH_FILE_PAGES))
+         || (rc = fh.OpenFile(fileName)))
+      return (rc);
+   int misses = Stat(PF_PAGENOTFOUND), reads = Stat(PF_READPAGE);
+   StartTimer();
+   for (int i = 0; i < 5; i++) {
+      if ((rc = fh.ClearBuffer()))
+         return (rc);
+      for (p = -1; !(rc = fh.GetNextPage(p, ph)); ) {
+         if ((rc = ph.GetPageNum(p)) || (rc = fh.UnpinPage(p)))
+            return (rc);
+      }
+      if (rc != PF_EOF)
+         return (rc);
+   }
+   double ms = Elapsed();
+   printf("5 scans of %d pages: %.0f ms, %d pages read, "
+         "%d of them by GetPage\n", BENCH_FILE_PAGES, ms,
+         Stat(PF_READPAGE) - reads, Stat(PF_PAGENOTFOUND) - misses);
+   return (fh.CloseFile());
+}
+
+static RC BenchFlush(const char *fileName)
+{
+   RC rc;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   char *pData;
+   double ms = 0;
+   unsigned long sum = 0;
+
+   if ((rc = MakeFile(fileName, BENCH_FILE_PAGES))
+         || (rc = PF_SetBufferSize(4096))
+         || (rc = fh.OpenFile(fileName)))
+      return (rc);
+   for (int i = 0; i < 5; i++) {
+      for (PageNum p = 0; p < 4000; p++) {
+         if ((rc = fh.GetThisPage(p, ph)) || (rc = ph.GetData(pData)))
+            return (rc);
+         pData[8]++;
+         if ((rc = fh.MarkDirty(p)) || (rc = fh.UnpinPage(p)))
+            return (rc);
+      }
+      StartTimer();
+      if ((rc = fh.FlushPages()))
+         return (rc);
+      ms += Elapsed();
+   }
+   printf("5 flushes of 4000 dirty pages: %.0f ms\n", ms);
+
+   StartTimer();
+   for (int i = 0; i < 5; i++) {
+      if ((rc = fh.ClearBuffer()))
+         return (rc);
+      for (PageNum p = -1; !(rc = fh.GetNextPage(p, ph)); ) {
+         if ((rc = ph.GetPageNum(p)) || (rc = ph.GetData(pData)))
+            return (rc);
+         for (int j = 0; j + 4 <= BENCH_PAGE_SIZE; j += 4)
+            sum += *(unsigned *)(pData + j) * 2654435761u;
+         if ((rc = fh.UnpinPage(p)))
+            return (rc);
+      }
+      if (rc != PF_EOF)
+         return (rc);
+   }
+   printf("5 scans with work per page: %.0f ms (%lu)\n", Elapsed(),
+         sum & 1);
+   return (fh.CloseFile());
+}
+
+static RC BenchWriteback(const char *fileName)
+{
+   RC rc;
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   PageNum p;
+   char *pData;
+
+   unlink(fileName);
+   if ((rc = PF_SetBufferSize(256))
+         || (rc = PF_CreateFile(fileName, BENCH_PAGE_SIZE))
+         || (rc = fh.OpenFile(fileName)))
+      return (rc);
+   StartTimer();
+   for (int i = 0; i < BENCH_FILE_PAGES; i++) {
+      if ((rc = fh.AllocatePage(ph))
+            || (rc = ph.GetPageNum(p))
+            || (rc = ph.GetData(pData)))
+         return (rc);
+      memset(pData, i, BENCH_PAGE_SIZE);
+      if ((rc = fh.MarkDirty(p)) || (rc = fh.UnpinPage(p)))
+         return (rc);
+   }
+   printf("append and dirty %d pages: %.0f ms\n", BENCH_FILE_PAGES,
+         Elapsed());
+
+   srand(3);
+   StartTimer();
+   for (int i = 0; i < 50000; i++) {
+      p = rand() % BENCH_FILE_PAGES;
+      if ((rc = fh.GetThisPage(p, ph)) || (rc = ph.GetData(pData)))
+         return (rc);
+      pData[10]++;
+      if ((rc = fh.MarkDirty(p)) || (rc = fh.UnpinPage(p)))
+         return (rc);
+   }
+   printf("50000 random page updates: %.0f ms\n", Elapsed());
+
+   StartTimer();
+   rc = fh.CloseFile();
+   printf("close: %.0f ms\n", Elapsed());
+   unlink(fileName);
+   return (rc);
+}
+
+static RC BenchMapped(const char *fileName)
+{
+   RC rc;
+   long sum = 0;
+
+   if ((rc = MakeFile(fileName, BENCH_FILE_PAGES))
+         || (rc = PF_SetBufferSize(1024)))
+      return (rc);
+   for (int bMapped = 0; bMapped < 2; bMapped++) {
+      PF_FileHandle fh;
+
+      PF_SetMappedReads(bMapped);
+      if ((rc = fh.OpenFile(fileName)))
+         return (rc);
+      for (int i = 0; i < 3; i++) {
+         StartTimer();
+         for (PageNum p = 0; p < BENCH_FILE_PAGES; p++)
+            if ((rc = ReadPage(fh, p, sum, true)))
+               return (rc);
+         printf("%s scan %d: %.1f ms\n", bMapped ? "mapped" : "read  ",
+               i, Elapsed());
+      }
+      if ((rc = fh.CloseFile()))
+         return (rc);
+   }
+   PF_SetMappedReads(false);
+   return (0);
+}
+
+static RC BenchArena(const char *fileName)
+{
+   RC rc;
+   PF_FileHandle fh;
+   long sum = 0;
+
+   if ((rc = MakeFile(fileName, BENCH_FILE_PAGES)))
+      return (rc);
+   StartTimer();
+   if ((rc = PF_SetBufferSize(32768)) || (rc = fh.OpenFile(fileName)))
+      return (rc);
+   printf("pool of 32768 pages: %.1f ms\n", Elapsed());
+   for (int i = 0; i < 3; i++) {
+      StartTimer();
+      for (PageNum p = 0; p < BENCH_FILE_PAGES; p++)
+         if ((rc = ReadPage(fh, p, sum)))
+            return (rc);
+      printf("scan %d: %.1f ms\n", i, Elapsed());
+   }
+   return (fh.CloseFile());
+}
+
+int main(int argc, char *argv[])
+{
+   const struct {
+      const char *name;
+      RC (*run)(const char *fileName);
+   } workloads[] = {
+      { "hash", BenchHash },
+      { "replace", BenchReplace },
+      { "scan", BenchScan },
+      { "flush", BenchFlush },
+      { "writeback", BenchWriteback },
+      { "mapped", BenchMapped },
+      { "arena", BenchArena },
+   };
+   const int numWorkloads = sizeof(workloads) / sizeof(workloads[0]);
+
+   if (argc < 2 || argc > 3) {
+      printf("usage: %s <workload> [file]\nworkloads:", argv[0]);
+      for (int i = 0; i < numWorkloads; i++)
+         printf(" %s", workloads[i].name);
+      printf("\n");
+      return (1);
+   }
+   const char *fileName = argc > 2 ? argv[2] : "pf_bench.data";
+   for (int i = 0; i < numWorkloads; i++) {
+      if (strcmp(argv[1], workloads[i].name))
+         continue;
+      RC rc = workloads[i].run(fileName);
+      if (rc) {
+         PF_PrintError(rc);
+         return (1);
+      }
+      return (0);
+   }
+   printf("unknown workload %s\n", argv[1]);
+   return (1);
+}
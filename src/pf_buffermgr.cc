@@ -14,12 +14,46 @@
 //       pf_test2.cc for a demo.
 // 1998: The statistics manager is now instantiated in this file and is
 //       created and destroyed by the buffer manager.
+// 2021: One buffer manager is shared by the whole process, see
+//       PF_GetBufferMgr.  Frames are sized on demand since files of
+//       different page sizes share the same buffer.
+// 2021: The page to replace is chosen by a PF_ReplacePolicy, 2Q by
+//       default, so that a full scan no longer flushes the pages used
+//       over and over, such as the upper levels of an index.
+// 2021: GetPage reads ahead when a file is read in page order, see
+//       ReadAhead.
+// 2021: Pages read ahead and pages written by FlushPages, ForcePages,
+//       ClearBuffer and write behind go through a PF_IOEngine.  A page
+//       being read ahead is in the hash table with bIO set and is pinned
+//       until the read is done; GetPage waits for it.
+// 2021: With PF_SetMappedReads, files are mapped when opened and a page
+//       pinned read-only that is not in the buffer is used in place in
+//       the mapping, see GetPage.
+// 2021: Frames come from one anonymous arena, so that they are
+//       contiguous, aligned on PF_FRAME_ALIGN for direct I/O and backed
+//       by huge pages where the OS has them, see MapArena.
+// 2021: Files opened for direct I/O are neither mapped nor advised to
+//       the OS, which does not cache them; PrefetchPage reads their
+//       pages into the buffer instead.
+// 2021: The buffer manager is shared by threads.  Its latch is held
+//       shared by the hits that leave the replacement order as it is,
+//       exclusively otherwise, and is released while a missing page is
+//       read; the page is then PF_IO_THREAD, see GetPage.
 //
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
 #include "pf_buffermgr.h"
 
 using namespace std;
@@ -78,17 +112,167 @@ void WriteLog(const char *psMessage)
 #endif
 
 
+// The buffer manager shared by all files, created on first use.  The
+// mutex guards these variables, the buffer manager has its own latch.
+//
+// SameTime
+//
+// Desc: Whether two file times are the same to the nanosecond
+//
+static bool SameTime(const struct timespec &a, const struct timespec &b)
+{
+   return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+//
+// IsRacy
+//
+// Desc: Whether the file may still be written without its times
+//       changing.  The OS stamps files from a coarse clock, so a write
+//       in the same tick as the last one leaves st_mtim and st_ctim as
+//       they are.  Only once a tick has passed do the times tell
+//       whether the file changed.
+// In:   st - status of the file
+//
+static bool IsRacy(const struct stat &st)
+{
+   struct timespec now, res;
+#ifdef CLOCK_REALTIME_COARSE
+   clockid_t clk = CLOCK_REALTIME_COARSE;
+   if (clock_getres(clk, &res) < 0)
+      return (true);
+#else
+   // Assume the times are only kept to the second
+   clockid_t clk = CLOCK_REALTIME;
+   res.tv_sec = 1;
+   res.tv_nsec = 0;
+#endif
+   if (clock_gettime(clk, &now) < 0)
+      return (true);
+
+   const long long NS = 1000000000LL;
+   long long tNow = now.tv_sec * NS + now.tv_nsec;
+   long long tRes = res.tv_sec * NS + res.tv_nsec;
+   long long tMod = max(st.st_mtim.tv_sec * NS + st.st_mtim.tv_nsec,
+                        st.st_ctim.tv_sec * NS + st.st_ctim.tv_nsec);
+   return tMod + tRes >= tNow;
+}
+
+//
+// The page latches held by the calling thread, so that a thread only
+// releases the latches it holds.  A thread holds few at once.
+//
+struct PF_HeldLatch {
+   const PF_BufferMgr *pMgr;   // buffer manager of the page
+   int slot;                   // slot of the page
+   int bExclusive;             // held exclusively
+};
+static thread_local vector<PF_HeldLatch> heldLatches;
+
+//
+// FindHeldLatch
+//
+// Desc: Find the latch of a slot among those the calling thread holds
+// Ret:  index in heldLatches, -1 if not held
+//
+static int FindHeldLatch(const PF_BufferMgr *pMgr, int slot)
+{
+   for (size_t i = 0; i < heldLatches.size(); i++)
+      if (heldLatches[i].pMgr == pMgr && heldLatches[i].slot == slot)
+         return (i);
+   return (-1);
+}
+
+static mutex sharedMgrLock;
+static PF_BufferMgr *pSharedBufferMgr = NULL;
+static int iSharedBufferSize = PF_BUFFER_SIZE;
+static PF_ReplacePolicy iSharedPolicy = PF_REPLACE_POLICY;
+static int bSharedMappedReads = false;
+
+//
+// PF_GetBufferMgr
+//
+// Desc: Return the buffer manager shared by every PF_FileHandle of the
+//       process.  It is created with the size given to PF_SetBufferSize
+//       (PF_BUFFER_SIZE pages by default) and the policy given to
+//       PF_SetReplacePolicy the first time it is needed.
+// Ret:  pointer to the shared buffer manager
+//
+PF_BufferMgr *PF_GetBufferMgr()
+{
+   lock_guard<mutex> guard(sharedMgrLock);
+   if (pSharedBufferMgr == NULL) {
+      pSharedBufferMgr = new PF_BufferMgr(iSharedBufferSize, PF_BLOCK_SIZE,
+                                          iSharedPolicy);
+      pSharedBufferMgr->SetMappedReads(bSharedMappedReads);
+   }
+   return (pSharedBufferMgr);
+}
+
+//
+// PF_SetBufferSize
+//
+// Desc: Set the number of pages in the shared buffer.  If the buffer
+//       already exists it is resized.
+// In:   numPages - the number of pages in the buffer
+// Ret:  PF_TOOSMALL if numPages is not positive, other PF return code
+//
+RC PF_SetBufferSize(int numPages)
+{
+   if (numPages <= 0)
+      return (PF_TOOSMALL);
+
+   lock_guard<mutex> guard(sharedMgrLock);
+   iSharedBufferSize = numPages;
+   if (pSharedBufferMgr == NULL)
+      return (0);
+   return (pSharedBufferMgr->ResizeBuffer(numPages));
+}
+
+//
+// PF_SetReplacePolicy
+//
+// Desc: Set the replacement policy of the shared buffer.  If the buffer
+//       already exists it is emptied and switches to the policy.
+// In:   policy - the replacement policy
+// Ret:  PF return code
+//
+RC PF_SetReplacePolicy(PF_ReplacePolicy policy)
+{
+   lock_guard<mutex> guard(sharedMgrLock);
+   iSharedPolicy = policy;
+   if (pSharedBufferMgr == NULL)
+      return (0);
+   return (pSharedBufferMgr->SetReplacePolicy(policy));
+}
+
+//
+// PF_SetMappedReads
+//
+// Desc: Turn mapped reads on or off for the files opened from now on.
+//       Files already open keep the way they were opened.
+// In:   bMappedReads - map the files
+//
+void PF_SetMappedReads(int bMappedReads)
+{
+   lock_guard<mutex> guard(sharedMgrLock);
+   bSharedMappedReads = bMappedReads;
+   if (pSharedBufferMgr != NULL)
+      pSharedBufferMgr->SetMappedReads(bMappedReads);
+}
+
 //
 // PF_BufferMgr
 //
-// Desc: Constructor - called by PF_Manager::PF_Manager
+// Desc: Constructor - called by PF_GetBufferMgr
 //       The buffer manager manages the page buffer.  When asked for a page,
 //       it checks if it is in the buffer.  If so, it pins the page (pages
 //       can be pinned multiple times).  If not, it reads it from the file
 //       and pins it.  If the buffer is full and a new page needs to be
-//       inserted, an unpinned page is replaced according to an LRU
+//       inserted, an unpinned page is replaced according to _policy
 // In:   _numPages - the number of pages in the buffer
-//       _pageSize - exact size of page on disk
+//       _pageSize - size of the memory blocks handed out by AllocateBlock
+//       _policy - the replacement policy
 //
 // Note: The constructor will initialize the global pStatisticsMgr.  We
 //       make it global so that other components may use it and to allow
@@ -97,11 +281,24 @@ void WriteLog(const char *psMessage)
 // Aut2003
 // numPages changed to _numPages for to eliminate CC warnings
 
-PF_BufferMgr::PF_BufferMgr(int _numPages, int _pageSize) : hashTable(PF_HASH_TBL_SIZE)
+PF_BufferMgr::PF_BufferMgr(int _numPages, int _pageSize,
+                           PF_ReplacePolicy _policy) : hashTable(_numPages)
 {
    // Initialize local variables
    this->numPages = _numPages;
    this->pageSize = _pageSize;
+   this->policy = _policy;
+   this->ghostTable = NULL;
+   this->ghostRing = NULL;
+   for (int i = 0; i < PF_IO_DEPTH; i++)
+      freeBatches[i] = i;
+   this->numFreeBatches = PF_IO_DEPTH;
+   this->numDirty = 0;
+   this->numWriting = 0;
+   this->cleanMark = 0;
+   this->bMappedReads = false;
+   this->arena = NULL;
+   this->arenaSize = 0;
 
 #ifdef PF_STATS
    // Initialize the global variable for the statistics manager
@@ -118,22 +315,28 @@ PF_BufferMgr::PF_BufferMgr(int _numPages, int _pageSize) : hashTable(PF_HASH_TBL
    // Allocate memory for buffer page description table
    bufTable = new PF_BufPageDesc[numPages];
 
-   // Initialize the buffer table and allocate memory for buffer pages.
-   // Initially, the free list contains all pages
+   // Initialize the buffer table.  The frames are carved from an arena
+   // that grows with the largest page size of the files.  Initially,
+   // the free list contains all pages
    for (int i = 0; i < numPages; i++) {
-      if ((bufTable[i].pData = new char[pageSize]) == NULL) {
-         cerr << "Not enough memory for buffer\n";
-         exit(1);
-      }
-
-      memset ((void *)bufTable[i].pData, 0, pageSize);
-
+      bufTable[i].pData = NULL;
+      bufTable[i].frameSize = 0;
+      bufTable[i].pMapped = NULL;
+      bufTable[i].bDirty = false;
+      bufTable[i].bIO = PF_IO_NONE;
+      bufTable[i].latch = 0;
       bufTable[i].prev = i - 1;
       bufTable[i].next = i + 1;
    }
    bufTable[0].prev = bufTable[numPages - 1].next = INVALID_SLOT;
    free = 0;
    first = last = INVALID_SLOT;
+   InitPolicy();
+   MapArena((_pageSize + PF_FRAME_ALIGN - 1) / PF_FRAME_ALIGN * PF_FRAME_ALIGN);
+
+   // The file table is grown as files are opened
+   fileTable = NULL;
+   numFiles = 0;
 
 #ifdef PF_LOG
    WriteLog("Succesfully created the buffer manager.\n");
@@ -147,11 +350,19 @@ PF_BufferMgr::PF_BufferMgr(int _numPages, int _pageSize) : hashTable(PF_HASH_TBL
 //
 PF_BufferMgr::~PF_BufferMgr()
 {
-   // Free up buffer pages and tables
-   for (int i = 0; i < this->numPages; i++)
-      delete [] bufTable[i].pData;
+   // The pages being read ahead must not be freed under the reads
+   WaitIO(INVALID_SLOT);
+
+   // Free up buffer pages, mappings and tables
+   UnmapArena();
+   for (int i = 0; i < numFiles; i++)
+      if (fileTable[i].pMap != NULL)
+         munmap(fileTable[i].pMap, fileTable[i].mapSize);
 
    delete [] bufTable;
+   delete [] fileTable;
+   delete ghostTable;
+   delete [] ghostRing;
 
 #ifdef PF_STATS
    // Destroy the global statistics manager
@@ -163,6 +374,427 @@ PF_BufferMgr::~PF_BufferMgr()
 #endif
 }
 
+//
+// OpenFile
+//
+// Desc: Register an open file with the buffer.  If the same file (same
+//       device and inode) was closed earlier and has not been modified
+//       since, the file id it had is reused and its cached pages become
+//       visible again.  Otherwise a free file id is handed out.
+// In:   fd - OS file descriptor of the open file
+//       _pageSize - # of bytes a page takes on disk
+// Out:  fileId - id to pass to the other methods for this file
+// Ret:  PF return code
+//
+RC PF_BufferMgr::OpenFile(int fd, int _pageSize, int &fileId)
+{
+   RC rc;
+   struct stat st;
+   int i;
+   unique_lock<shared_mutex> guard(latch);
+
+   if (fstat(fd, &st) < 0)
+      return (PF_UNIX);
+
+   // The frames must hold the pages of the file
+   if (_pageSize > frameStride && (rc = GrowArena(_pageSize)))
+      return (rc);
+
+   // Look for a closed entry for this file
+   fileId = -1;
+   for (i = 0; i < numFiles; i++) {
+      if (fileTable[i].fd != -1 || fileTable[i].numBufPages == 0 ||
+            fileTable[i].dev != st.st_dev || fileTable[i].ino != st.st_ino)
+         continue;
+
+      // The cached pages can only be trusted if the file has not changed
+      // since it was closed.  st_ino is not meaningful on every platform.
+      if (st.st_ino != 0 && fileTable[i].bReusable &&
+            fileTable[i].pageSize == _pageSize &&
+            fileTable[i].size == st.st_size &&
+            SameTime(fileTable[i].mtime, st.st_mtim) &&
+            SameTime(fileTable[i].ctime, st.st_ctim))
+         fileId = i;
+      else
+         InternalDiscard(st.st_dev, st.st_ino);
+      break;
+   }
+
+   // Otherwise take an entry without pages, growing the table if needed
+   if (fileId == -1) {
+      for (i = 0; i < numFiles; i++)
+         if (fileTable[i].fd == -1 && fileTable[i].numBufPages == 0)
+            break;
+
+      if (i == numFiles) {
+         int iNewSize = (numFiles == 0) ? PF_FILE_TBL_SIZE : 2 * numFiles;
+         PF_BufFile *pNewFileTable = new PF_BufFile[iNewSize];
+         for (int j = 0; j < iNewSize; j++) {
+            if (j < numFiles)
+               pNewFileTable[j] = fileTable[j];
+            else {
+               pNewFileTable[j].fd = -1;
+               pNewFileTable[j].numBufPages = 0;
+               pNewFileTable[j].pMap = NULL;
+               pNewFileTable[j].bReusable = false;
+            }
+         }
+         delete [] fileTable;
+         fileTable = pNewFileTable;
+         numFiles = iNewSize;
+      }
+
+      fileId = i;
+      fileTable[fileId].pageSize = _pageSize;
+      fileTable[fileId].dev = st.st_dev;
+      fileTable[fileId].ino = st.st_ino;
+   }
+
+   fileTable[fileId].fd = fd;
+   fileTable[fileId].lastPage = -1;
+   fileTable[fileId].raPages = 0;
+   fileTable[fileId].pMap = NULL;
+   fileTable[fileId].mapSize = 0;
+   fileTable[fileId].numMapped = 0;
+   fileTable[fileId].bDirect = false;
+#ifdef O_DIRECT
+   int flags = fcntl(fd, F_GETFL);
+   fileTable[fileId].bDirect = (flags >= 0 && (flags & O_DIRECT));
+#endif
+
+   // Return ok, a file that can not be mapped is just read.  A mapping
+   // would bring the pages of a direct file back in the OS cache.
+   if (bMappedReads && !fileTable[fileId].bDirect)
+      MapFile(fileId);
+   return (0);
+}
+
+//
+// CloseFile
+//
+// Desc: Write out the dirty pages of a file and detach the file id from
+//       its OS file descriptor.  Clean pages remain in the buffer until
+//       they are replaced or the file is opened again.  The file must
+//       not have pinned pages.
+// In:   fileId - buffer file id of the file
+// Ret:  PF_PAGEPINNED or other PF return code
+//
+RC PF_BufferMgr::CloseFile(int fileId)
+{
+   RC rc;
+   struct stat st;
+   unique_lock<shared_mutex> guard(latch);
+
+   // Write out dirty pages and ensure none of the pages is pinned
+   if ((rc = WaitIO(INVALID_SLOT)) ||
+         (rc = WritePages(fileId, ALL_PAGES, true)))
+      return (rc);
+   for (int slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      if (bufTable[slot].fileId == fileId && bufTable[slot].pinCount)
+         return (PF_PAGEPINNED);
+
+   // Pages in the mapping can not outlive it
+   if ((rc = UnmapFile(fileId)))
+      return (rc);
+
+   if (fstat(fileTable[fileId].fd, &st) < 0)
+      return (PF_UNIX);
+   fileTable[fileId].fd = -1;
+   fileTable[fileId].size = st.st_size;
+   fileTable[fileId].mtime = st.st_mtim;
+   fileTable[fileId].ctime = st.st_ctim;
+   fileTable[fileId].bReusable = !IsRacy(st);
+
+   // If the file is still open through another entry, the pages of this
+   // entry may become stale.  Likewise older closed entries are stale now.
+   for (int i = 0; i < numFiles; i++) {
+      if (i == fileId || fileTable[i].dev != st.st_dev ||
+            fileTable[i].ino != st.st_ino)
+         continue;
+      if (fileTable[i].fd != -1) {
+         fileTable[fileId].bReusable = false;
+         break;
+      }
+      fileTable[i].bReusable = false;
+   }
+
+   // Return ok
+   return (0);
+}
+
+//
+// DiscardFile
+//
+// Desc: Remove the cached pages of a closed file from the buffer.  The
+//       pages are clean, so nothing is written.  Called when a file is
+//       destroyed or its cached pages are found to be stale.  Pages of
+//       entries that are still open are left alone.
+// In:   dev, ino - device and inode of the file
+// Ret:  PF return code
+//
+RC PF_BufferMgr::DiscardFile(dev_t dev, ino_t ino)
+{
+   unique_lock<shared_mutex> guard(latch);
+   return (InternalDiscard(dev, ino));
+}
+
+//
+// InternalDiscard
+//
+// Desc: Internal.  DiscardFile, with the latch held.
+// In:   dev, ino - device and inode of the file
+// Ret:  PF return code
+//
+RC PF_BufferMgr::InternalDiscard(dev_t dev, ino_t ino)
+{
+   RC rc;
+
+   int slot = first;
+   while (slot != INVALID_SLOT) {
+      int next = bufTable[slot].next;
+      int fileId = bufTable[slot].fileId;
+
+      if (fileId >= 0 && fileTable[fileId].fd == -1 &&
+            fileTable[fileId].dev == dev && fileTable[fileId].ino == ino) {
+         if ((rc = Unhash(slot)) ||
+               (rc = Unlink(slot)) ||
+               (rc = InsertFree(slot)))
+            return (rc);
+      }
+      slot = next;
+   }
+
+   // Return ok
+   return (0);
+}
+
+//
+// MapFrames
+//
+// Desc: Map anonymous memory for frames.  Huge pages reserved by the
+//       administrator are used if there are enough, transparent huge
+//       pages are asked for otherwise.  Build with -DPF_NO_HUGEPAGES to
+//       use neither.  The OS only gives the memory as it is touched.
+// In:   size - # of bytes to map
+// Out:  size - # of bytes mapped, rounded up for huge pages
+// Ret:  the memory, NULL if it can not be mapped
+//
+static char *MapFrames(size_t &size)
+{
+   void *p = MAP_FAILED;
+
+#if defined(MAP_HUGETLB) && !defined(PF_NO_HUGEPAGES)
+   if (size >= (size_t)PF_HUGE_PAGE) {
+      size_t hugeSize = (size + PF_HUGE_PAGE - 1) / PF_HUGE_PAGE * PF_HUGE_PAGE;
+      p = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED)
+         size = hugeSize;
+   }
+#endif
+   if (p == MAP_FAILED) {
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+         return (NULL);
+#if defined(MADV_HUGEPAGE) && !defined(PF_NO_HUGEPAGES)
+      if (size >= (size_t)PF_HUGE_PAGE)
+         madvise(p, size, MADV_HUGEPAGE);
+#endif
+   }
+   return ((char *)p);
+}
+
+//
+// MapArena
+//
+// Desc: Internal.  Map the arena and point each slot to its frame, the
+//       frame of slot i being at arena + i * stride.  If the arena can
+//       not be mapped, each slot gets a frame of its own when it is
+//       first used.
+// In:   stride - size of the frames, a multiple of PF_FRAME_ALIGN
+//
+void PF_BufferMgr::MapArena(int stride)
+{
+   frameStride = stride;
+   arenaSize = numPages * (size_t)stride;
+   if ((arena = MapFrames(arenaSize)) == NULL)
+      arenaSize = 0;
+
+   for (int i = 0; i < numPages; i++) {
+      bufTable[i].pData = (arena == NULL) ? NULL : arena + i * (size_t)stride;
+      bufTable[i].frameSize = (arena == NULL) ? 0 : stride;
+   }
+}
+
+//
+// UnmapArena
+//
+// Desc: Internal.  Free the frames of all slots and unmap the arena.
+//
+void PF_BufferMgr::UnmapArena()
+{
+   for (int i = 0; i < numPages; i++) {
+      if (!IsArenaFrame(i))
+         ::free(bufTable[i].pData);
+      bufTable[i].pData = NULL;
+      bufTable[i].frameSize = 0;
+   }
+   if (arena != NULL)
+      munmap(arena, arenaSize);
+   arena = NULL;
+   arenaSize = 0;
+}
+
+//
+// GrowArena
+//
+// Desc: Internal.  Called when a file has larger pages than the frames.
+//       Map an arena with frames large enough and move the pages in the
+//       buffer to it.  Pinned pages can not move, so nothing is done
+//       while there are any; GetFrame then gives the larger pages frames
+//       of their own.
+// In:   size - page size of the file
+// Ret:  PF return code
+//
+RC PF_BufferMgr::GrowArena(int size)
+{
+   RC  rc;
+   int slot;
+   int stride = (size + PF_FRAME_ALIGN - 1) / PF_FRAME_ALIGN * PF_FRAME_ALIGN;
+
+   // Pages must not move under a read or write
+   if ((rc = WaitIO(INVALID_SLOT)))
+      return (rc);
+
+   for (slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next) {
+      if (bufTable[slot].pinCount > 0 && bufTable[slot].pMapped == NULL)
+         return (0);
+      if (bufTable[slot].frameSize > stride)
+         stride = bufTable[slot].frameSize;
+   }
+
+   size_t newSize = numPages * (size_t)stride;
+   char *newArena = MapFrames(newSize);
+   if (newArena == NULL)
+      return (0);
+
+   for (slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      if (bufTable[slot].pMapped == NULL)
+         memcpy(newArena + slot * (size_t)stride, bufTable[slot].pData,
+                bufTable[slot].frameSize);
+
+   UnmapArena();
+   arena = newArena;
+   arenaSize = newSize;
+   frameStride = stride;
+   for (int i = 0; i < numPages; i++) {
+      bufTable[i].pData = arena + i * (size_t)stride;
+      bufTable[i].frameSize = stride;
+   }
+   return (0);
+}
+
+//
+// GetFrame
+//
+// Desc: Internal.  Make sure the frame of slot holds size bytes.  A page
+//       larger than the arena frames gets a frame of its own, aligned
+//       like them.
+// In:   slot - slot of the page
+//       size - size of the page
+// Ret:  PF_NOMEM or 0
+//
+RC PF_BufferMgr::GetFrame(int slot, int size)
+{
+   void *p;
+
+   if (bufTable[slot].frameSize >= size)
+      return (0);
+
+   size = (size + PF_FRAME_ALIGN - 1) / PF_FRAME_ALIGN * PF_FRAME_ALIGN;
+   if (posix_memalign(&p, PF_FRAME_ALIGN, size))
+      return (PF_NOMEM);
+   memset(p, 0, size);
+
+   if (!IsArenaFrame(slot))
+      ::free(bufTable[slot].pData);
+   bufTable[slot].pData = (char *)p;
+   bufTable[slot].frameSize = size;
+   return (0);
+}
+
+//
+// MapFile
+//
+// Desc: Internal.  Map a file being opened, read-only, so that GetPage
+//       can point to its pages in place.  Only the pages in the file
+//       now are mapped; pages added later are read as usual.
+// In:   fileId - buffer file id of the file
+// Ret:  PF_UNIX if the file can not be mapped
+//
+RC PF_BufferMgr::MapFile(int fileId)
+{
+   PF_BufFile &file = fileTable[fileId];
+   struct stat st;
+
+   if (fstat(file.fd, &st) < 0)
+      return (PF_UNIX);
+
+   // The first page on disk holds the file header
+   PageNum numMapped = st.st_size / file.pageSize - 1;
+   if (numMapped <= 0)
+      return (0);
+
+   size_t mapSize = (numMapped + 1) * (size_t)file.pageSize;
+   void *pMap = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, file.fd, 0);
+   if (pMap == MAP_FAILED)
+      return (PF_UNIX);
+
+   file.pMap = (char *)pMap;
+   file.mapSize = mapSize;
+   file.numMapped = numMapped;
+   return (0);
+}
+
+//
+// UnmapFile
+//
+// Desc: Internal.  Remove the pages of a file that point into its
+//       mapping from the buffer, then unmap the file.  None of these
+//       pages may be pinned.
+// In:   fileId - buffer file id of the file
+// Ret:  PF return code
+//
+RC PF_BufferMgr::UnmapFile(int fileId)
+{
+   RC rc;
+   PF_BufFile &file = fileTable[fileId];
+
+   if (file.pMap == NULL)
+      return (0);
+
+   int slot = first;
+   while (slot != INVALID_SLOT) {
+      int next = bufTable[slot].next;
+      if (bufTable[slot].fileId == fileId && bufTable[slot].pMapped != NULL) {
+         bufTable[slot].pMapped = NULL;
+         if ((rc = Unhash(slot)) ||
+               (rc = Unlink(slot)) ||
+               (rc = InsertFree(slot)))
+            return (rc);
+      }
+      slot = next;
+   }
+
+   if (munmap(file.pMap, file.mapSize) < 0)
+      return (PF_UNIX);
+   file.pMap = NULL;
+   file.mapSize = 0;
+   file.numMapped = 0;
+   return (0);
+}
+
 //
 // GetPage
 //
@@ -171,22 +803,39 @@ PF_BufferMgr::~PF_BufferMgr()
 //       to it.  If the page is not in the buffer, read it from the file,
 //       pin it, and return a pointer to it.  If the buffer is full,
 //       replace an unpinned page.
-// In:   fd - OS file descriptor of the file to read
+//       When the pages of the file are asked for in order, a page that
+//       is not in the buffer is read together with the next pages of
+//       the file.  The window starts at PF_READAHEAD_MIN pages and
+//       doubles on each read up to PF_READAHEAD_MAX pages, or a quarter
+//       of the buffer.
+//       A page of a mapped file that is pinned read-only and is not in
+//       the buffer is not read: the slot points into the mapping.  When
+//       such a page is pinned to be changed, it is copied into the frame
+//       of its slot first.  It can not be while it is still pinned
+//       read-only, as those pins would keep pointing at the old contents
+//       in the mapping.
+//       A hit that needs no change to the order of the replacement
+//       policy is served with the latch shared.  A page missing from the
+//       buffer is read with the latch released: its slot is in the hash
+//       table, pinned and PF_IO_THREAD, and other threads wait for it.
+// In:   fileId - buffer file id of the file to read
 //       pageNum - number of the page to read
 //       bMultiplePins - if false, it is an error to ask for a page that is
 //                       already pinned in the buffer.
+//       bReadOnly - the page will not be changed through this pin
 // Out:  ppBuffer - set *ppBuffer to point to the page in the buffer
-// Ret:  PF return code
+// Ret:  PF_PAGEMAPPED if the page is to be changed but is pinned
+//       read-only in the mapping, other PF return code
 //
-RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
-      int bMultiplePins)
+RC PF_BufferMgr::GetPage(int fileId, PageNum pageNum, char **ppBuffer,
+      int bMultiplePins, int bReadOnly)
 {
    RC  rc;     // return code
    int slot;   // buffer slot where page is located
 
 #ifdef PF_LOG
    char psMessage[100];
-   sprintf (psMessage, "Looking for (%d,%d).\n", fd, pageNum);
+   sprintf (psMessage, "Looking for (%d,%d).\n", fileId, pageNum);
    WriteLog(psMessage);
 #endif
 
@@ -195,29 +844,122 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
    pStatisticsMgr->Register(PF_GETPAGE, STAT_ADDONE);
 #endif
 
+   // A hit the replacement policy takes without reordering its lists
+   // only needs the latch shared
+   {
+      shared_lock<shared_mutex> guard(latch);
+      if (hashTable.Find(fileId, pageNum, slot) == 0 &&
+            bufTable[slot].bIO == PF_IO_NONE && bMultiplePins &&
+            (bReadOnly || bufTable[slot].pMapped == NULL) &&
+            IsSharedTouch(slot)) {
+
+#ifdef PF_STATS
+         pStatisticsMgr->Register(PF_PAGEFOUND, STAT_ADDONE);
+#endif
+         __atomic_fetch_add(&bufTable[slot].pinCount, 1, __ATOMIC_ACQ_REL);
+         Touch(slot);
+
+         // Other threads may track the order of the file at the same time,
+         // it only guides read-ahead
+         PF_BufFile &file = fileTable[fileId];
+         PageNum lastPage = __atomic_load_n(&file.lastPage, __ATOMIC_RELAXED);
+         if (pageNum != lastPage) {
+            if (pageNum != lastPage + 1)
+               __atomic_store_n(&file.raPages, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&file.lastPage, pageNum, __ATOMIC_RELAXED);
+         }
+
+         *ppBuffer = (bufTable[slot].pMapped != NULL) ?
+               bufTable[slot].pMapped : bufTable[slot].pData;
+         return (0);
+      }
+   }
+
+   unique_lock<shared_mutex> guard(latch);
+
+   // Wait for a page that is being read, it may have left the buffer
+   // when the read is done
+   int bFound = (hashTable.Find(fileId, pageNum, slot) == 0);
+   while (bFound && bufTable[slot].bIO != PF_IO_NONE) {
+      if ((rc = WaitIO(slot)))
+         return (rc);
+      bFound = (hashTable.Find(fileId, pageNum, slot) == 0);
+   }
+
+   // Track whether the file is read in page order.  Asking for the same
+   // page again, as for each record of a page, does not break the order.
+   PF_BufFile &file = fileTable[fileId];
+   int bInOrder = (pageNum == file.lastPage + 1);
+   if (pageNum != file.lastPage) {
+      if (!bInOrder)
+         file.raPages = 0;
+      file.lastPage = pageNum;
+   }
+
    // If page not in buffer...
-   if (hashTable.Find(fd, pageNum, slot) == PF_HASHNOTFOUND) 
+   if (!bFound)
    {
 
 #ifdef PF_STATS
    pStatisticsMgr->Register(PF_PAGENOTFOUND, STAT_ADDONE);
 #endif
+      // A page pinned read-only is used in place in the mapping, the OS
+      // reads it when it is first touched
+      int bMapped = bReadOnly && pageNum < file.numMapped;
+
       // Allocate an empty page, this will also promote the newly allocated
       // page to the MRU slot
-      if ((rc = InternalAlloc(slot)))
+      if ((rc = InternalAlloc(slot, bMapped ? 0 : file.pageSize)))
          return (rc);
 
-      // read the page, insert it into the hash table,
-      // and initialize the page description entry
-      if ((rc = ReadPage(fd, pageNum, bufTable[slot].pData)) ||
-            (rc = hashTable.Insert(fd, pageNum, slot)) ||
-            (rc = InitPageDesc(fd, pageNum, slot))) {
+      // Grow the read-ahead window while the file is read in order
+      int numAhead = 0;
+      if (bInOrder && !bMapped) {
+         int maxAhead = (numPages / 4 < PF_READAHEAD_MAX) ?
+               numPages / 4 : PF_READAHEAD_MAX;
+         file.raPages = (2 * file.raPages > PF_READAHEAD_MIN) ?
+               2 * file.raPages : PF_READAHEAD_MIN;
+         if (file.raPages > maxAhead)
+            file.raPages = maxAhead;
+         numAhead = file.raPages;
+      }
+
+      // Insert the page into the hash table, and initialize the page
+      // description entry, which pins the page
+      if ((rc = hashTable.Insert(fileId, pageNum, slot)) ||
+            (rc = InitPageDesc(fileId, pageNum, slot))) {
 
          // Put the slot back on the free list before returning the error
          Unlink(slot);
          InsertFree(slot);
          return (rc);
       }
+
+      if (bMapped)
+         bufTable[slot].pMapped = file.pMap + (pageNum + 1) * (off_t)file.pageSize;
+      else {
+         // Start on the pages that follow, then read the page with the
+         // latch released.  Other threads asking for the page wait.
+         bufTable[slot].bIO = PF_IO_THREAD;
+         ReadAhead(fileId, pageNum + 1, numAhead);
+
+         int   fd = file.fd;
+         int   size = file.pageSize;
+         char  *pData = bufTable[slot].pData;
+         guard.unlock();
+         rc = ReadPage(fd, size, pageNum, pData);
+         guard.lock();
+
+         bufTable[slot].bIO = PF_IO_NONE;
+         readDone.notify_all();
+         if (rc) {
+            bufTable[slot].pinCount = 0;
+            Unhash(slot);
+            Unlink(slot);
+            InsertFree(slot);
+            return (rc);
+         }
+      }
 #ifdef PF_LOG
    WriteLog("Page not found in buffer. Loaded.\n");
 #endif
@@ -227,9 +969,20 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
    pStatisticsMgr->Register(PF_PAGEFOUND, STAT_ADDONE);
 #endif
 
-      // Error if we don't want to get a pinned page
-      if (!bMultiplePins && bufTable[slot].pinCount > 0)
-         return (PF_PAGEPINNED);
+      // Error if we don't want to get a pinned page.  The pin may only be
+      // that of a write behind.
+      if (!bMultiplePins && bufTable[slot].pinCount > 0) {
+         if (numWriting > 0 && (rc = WaitIO(INVALID_SLOT)))
+            return (rc);
+         if (bufTable[slot].pinCount > 0)
+            return (PF_PAGEPINNED);
+      }
+
+      // Copying the page into a frame would leave the read-only pins
+      // pointing at the old contents in the mapping
+      if (!bReadOnly && bufTable[slot].pMapped != NULL &&
+            bufTable[slot].pinCount > 0)
+         return (PF_PAGEMAPPED);
 
       // Page is alredy in memory, just increment pin count
       bufTable[slot].pinCount++;
@@ -239,14 +992,23 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
       WriteLog(psMessage);
 #endif
 
-      // Make this page the most recently used page
-      if ((rc = Unlink(slot)) ||
-            (rc = LinkHead (slot)))
-         return (rc);
+      // Tell the replacement policy the page was used again
+      Touch(slot);
+
+      // A page to be changed must be in a frame
+      if (!bReadOnly && bufTable[slot].pMapped != NULL) {
+         if ((rc = GetFrame(slot, file.pageSize))) {
+            bufTable[slot].pinCount--;
+            return (rc);
+         }
+         memcpy(bufTable[slot].pData, bufTable[slot].pMapped, file.pageSize);
+         bufTable[slot].pMapped = NULL;
+      }
    }
 
    // Point ppBuffer to page
-   *ppBuffer = bufTable[slot].pData;
+   *ppBuffer = (bufTable[slot].pMapped != NULL) ? bufTable[slot].pMapped :
+         bufTable[slot].pData;
 
    // Return ok
    return (0);
@@ -256,36 +1018,45 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
 // AllocatePage
 //
 // Desc: Allocate a new page in the buffer and return a pointer to it.
-// In:   fd - OS file descriptor of the file associated with the new page
+// In:   fileId - buffer file id of the file associated with the new page
 //       pageNum - number of the new page
 // Out:  ppBuffer - set *ppBuffer to point to the page in the buffer
 // Ret:  PF return code
 //
-RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
+RC PF_BufferMgr::AllocatePage(int fileId, PageNum pageNum, char **ppBuffer)
 {
    RC  rc;     // return code
    int slot;   // buffer slot where page is located
 
 #ifdef PF_LOG
    char psMessage[100];
-   sprintf (psMessage, "Allocating a page for (%d,%d)....", fd, pageNum);
+   sprintf (psMessage, "Allocating a page for (%d,%d)....", fileId, pageNum);
    WriteLog(psMessage);
 #endif
 
+   unique_lock<shared_mutex> guard(latch);
+
+   // A page read ahead past the end of the file leaves the buffer once
+   // the read is done
+   while (hashTable.Find(fileId, pageNum, slot) == 0 &&
+         bufTable[slot].bIO != PF_IO_NONE)
+      if ((rc = WaitIO(slot)))
+         return (rc);
+
    // If page is already in buffer, return an error
-   if (!(rc = hashTable.Find(fd, pageNum, slot)))
+   if (!(rc = hashTable.Find(fileId, pageNum, slot)))
       return (PF_PAGEINBUF);
    else if (rc != PF_HASHNOTFOUND)
       return (rc);              // unexpected error
 
    // Allocate an empty page
-   if ((rc = InternalAlloc(slot)))
+   if ((rc = InternalAlloc(slot, fileTable[fileId].pageSize)))
       return (rc);
 
    // Insert the page into the hash table,
    // and initialize the page description entry
-   if ((rc = hashTable.Insert(fd, pageNum, slot)) ||
-         (rc = InitPageDesc(fd, pageNum, slot))) {
+   if ((rc = hashTable.Insert(fileId, pageNum, slot)) ||
+         (rc = InitPageDesc(fileId, pageNum, slot))) {
 
       // Put the slot back on the free list before returning the error
       Unlink(slot);
@@ -309,23 +1080,25 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
 //
 // Desc: Mark a page dirty so that when it is discarded from the buffer
 //       it will be written back to the file.
-// In:   fd - OS file descriptor of the file associated with the page
+// In:   fileId - buffer file id of the file associated with the page
 //       pageNum - number of the page to mark dirty
 // Ret:  PF return code
 //
-RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
+RC PF_BufferMgr::MarkDirty(int fileId, PageNum pageNum)
 {
    RC  rc;       // return code
    int slot;     // buffer slot where page is located
 
 #ifdef PF_LOG
    char psMessage[100];
-   sprintf (psMessage, "Marking dirty (%d,%d).\n", fd, pageNum);
+   sprintf (psMessage, "Marking dirty (%d,%d).\n", fileId, pageNum);
    WriteLog(psMessage);
 #endif
 
+   unique_lock<shared_mutex> guard(latch);
+
    // The page must be found and pinned in the buffer
-   if ((rc = hashTable.Find(fd, pageNum, slot))){
+   if ((rc = hashTable.Find(fileId, pageNum, slot))){
       if ((rc == PF_HASHNOTFOUND))
          return (PF_PAGENOTINBUF);
       else
@@ -335,13 +1108,29 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
    if (bufTable[slot].pinCount == 0)
       return (PF_PAGEUNPINNED);
 
+   // A page in the file mapping was only pinned read-only
+   if (bufTable[slot].pMapped != NULL)
+      return (PF_PAGEREADONLY);
+
    // Mark this page dirty
-   bufTable[slot].bDirty = true;
+   int bWasDirty = bufTable[slot].bDirty;
+   SetDirty(slot, true);
 
    // Make this page the most recently used page
-   if ((rc = Unlink(slot)) ||
-         (rc = LinkHead (slot)))
-      return (rc);
+   Touch(slot);
+
+   // Write behind once enough pages are dirty.  Past the high mark the
+   // writer waits until every dirty page that is not pinned is written.
+   if (!bWasDirty) {
+      if (numDirty * 100 > numPages * PF_DIRTY_MAX) {
+         CleanPages(numPages);
+         if ((rc = WaitIO(INVALID_SLOT)))
+            return (rc);
+      }
+      else if (numWriting == 0 && numDirty >= cleanMark &&
+            numDirty * 100 > numPages * PF_DIRTY_START)
+         CleanPages(numPages / 4);
+   }
 
    // Return ok
    return (0);
@@ -350,18 +1139,55 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
 //
 // UnpinPage
 //
-// Desc: Unpin a page so that it can be discarded from the buffer.
-// In:   fd - OS file descriptor of the file associated with the page
+// Desc: Unpin a page so that it can be discarded from the buffer.  If
+//       the replacement policy need not reorder its lists for the page,
+//       the latch is only held shared.
+// In:   fileId - buffer file id of the file associated with the page
+//       pageNum - number of the page to unpin
+// Ret:  PF return code
+//
+RC PF_BufferMgr::UnpinPage(int fileId, PageNum pageNum)
+{
+   int slot;     // buffer slot where page is located
+
+   {
+      shared_lock<shared_mutex> guard(latch);
+      if (hashTable.Find(fileId, pageNum, slot) == 0 && IsSharedTouch(slot)) {
+         short int pinCount = __atomic_load_n(&bufTable[slot].pinCount,
+                                              __ATOMIC_RELAXED);
+         do {
+            if (pinCount == 0)
+               return (PF_PAGEUNPINNED);
+         } while (!__atomic_compare_exchange_n(&bufTable[slot].pinCount,
+               &pinCount, pinCount - 1, false, __ATOMIC_ACQ_REL,
+               __ATOMIC_RELAXED));
+
+         // The last pin is gone, the page was used
+         if (pinCount == 1)
+            Touch(slot);
+         return (0);
+      }
+   }
+
+   unique_lock<shared_mutex> guard(latch);
+   return (InternalUnpin(fileId, pageNum));
+}
+
+//
+// InternalUnpin
+//
+// Desc: Internal.  UnpinPage, with the latch held exclusively.
+// In:   fileId - buffer file id of the file associated with the page
 //       pageNum - number of the page to unpin
 // Ret:  PF return code
 //
-RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
+RC PF_BufferMgr::InternalUnpin(int fileId, PageNum pageNum)
 {
    RC  rc;       // return code
    int slot;     // buffer slot where page is located
 
    // The page must be found and pinned in the buffer
-   if ((rc = hashTable.Find(fd, pageNum, slot))){
+   if ((rc = hashTable.Find(fileId, pageNum, slot))){
       if ((rc == PF_HASHNOTFOUND))
          return (PF_PAGENOTINBUF);
       else
@@ -374,21 +1200,116 @@ RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
 #ifdef PF_LOG
    char psMessage[100];
    sprintf (psMessage, "Unpinning (%d,%d). %d Pin count\n",
-         fd, pageNum, bufTable[slot].pinCount-1);
+         fileId, pageNum, bufTable[slot].pinCount-1);
    WriteLog(psMessage);
 #endif
 
    // If unpinning the last pin, make it the most recently used page
-   if (--(bufTable[slot].pinCount) == 0) {
-      if ((rc = Unlink(slot)) ||
-            (rc = LinkHead (slot)))
-         return (rc);
-   }
+   if (--(bufTable[slot].pinCount) == 0)
+      Touch(slot);
 
    // Return ok
    return (0);
 }
 
+//
+// LatchPage
+//
+// Desc: Latch the contents of a pinned page, so that threads sharing
+//       the page do not see it half changed.  Any number of threads may
+//       hold the latch shared, one thread exclusively.  The caller waits
+//       for the latches that conflict; the buffer latch is not held
+//       meanwhile, and the pin keeps the page in its slot.  A thread
+//       waiting to latch exclusively keeps new shared holders out, so
+//       that a stream of readers does not starve it.
+// In:   fileId - buffer file id of the file associated with the page
+//       pageNum - number of the page to latch
+//       bExclusive - latch the page to change it
+// Ret:  PF_LATCHHELD if the calling thread holds the latch already,
+//       other PF return code
+//
+RC PF_BufferMgr::LatchPage(int fileId, PageNum pageNum, int bExclusive)
+{
+   int slot;
+   int *pLatch;  // frame latch of the page
+
+   {
+      shared_lock<shared_mutex> guard(latch);
+      if (hashTable.Find(fileId, pageNum, slot))
+         return (PF_PAGENOTINBUF);
+      if (__atomic_load_n(&bufTable[slot].pinCount, __ATOMIC_RELAXED) == 0)
+         return (PF_PAGEUNPINNED);
+      pLatch = &bufTable[slot].latch;
+   }
+
+   // Waiting for itself would never end
+   if (FindHeldLatch(this, slot) >= 0)
+      return (PF_LATCHHELD);
+
+   for (int numTries = 0; ; numTries++) {
+      int value = __atomic_load_n(pLatch, __ATOMIC_RELAXED);
+      if (bExclusive) {
+         if (value == 0 || value == PF_LATCH_WAITING) {
+            if (__atomic_compare_exchange_n(pLatch, &value, PF_LATCH_WRITER,
+                  false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+               break;
+            continue;
+         }
+         // Keep new shared holders out until the current ones are done
+         if (value > 0 && !(value & PF_LATCH_WAITING))
+            __atomic_compare_exchange_n(pLatch, &value,
+                  value | PF_LATCH_WAITING, false, __ATOMIC_RELAXED,
+                  __ATOMIC_RELAXED);
+      } else if (value >= 0 && !(value & PF_LATCH_WAITING)) {
+         if (__atomic_compare_exchange_n(pLatch, &value, value + 1, false,
+               __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+         continue;
+      }
+
+      // The holder is busy on the page, let it run.  A holder that keeps
+      // it long should not cost a core, so end up sleeping.
+      if (numTries >= PF_LATCH_SPINS + PF_LATCH_YIELDS)
+         this_thread::sleep_for(chrono::microseconds(PF_LATCH_SLEEP));
+      else if (numTries >= PF_LATCH_SPINS)
+         this_thread::yield();
+   }
+
+   heldLatches.push_back({this, slot, bExclusive});
+   return (0);
+}
+
+//
+// UnlatchPage
+//
+// Desc: Release the latch the calling thread holds on a page.
+// In:   fileId - buffer file id of the file associated with the page
+//       pageNum - number of the page to unlatch
+// Ret:  PF_PAGEUNLATCHED if the page is not latched, PF_LATCHNOTHELD if
+//       only other threads hold its latch, other PF return code
+//
+RC PF_BufferMgr::UnlatchPage(int fileId, PageNum pageNum)
+{
+   shared_lock<shared_mutex> guard(latch);
+   int slot;
+   if (hashTable.Find(fileId, pageNum, slot))
+      return (PF_PAGENOTINBUF);
+
+   int *pLatch = &bufTable[slot].latch;
+   int held = FindHeldLatch(this, slot);
+   if (held < 0)
+      return (__atomic_load_n(pLatch, __ATOMIC_RELAXED) == 0 ?
+            PF_PAGEUNLATCHED : PF_LATCHNOTHELD);
+
+   // A writer waiting keeps its bit while the shared holders leave
+   if (heldLatches[held].bExclusive)
+      __atomic_store_n(pLatch, 0, __ATOMIC_RELEASE);
+   else
+      __atomic_fetch_sub(pLatch, 1, __ATOMIC_RELEASE);
+   heldLatches.erase(heldLatches.begin() + held);
+   return (0);
+}
+
 //
 // FlushPages
 //
@@ -396,16 +1317,16 @@ RC PF_BufferMgr::UnpinPage(int fd, PageNum pageNum)
 //       Returns a warning if any of the file's pages are pinned.
 //       A linear search of the buffer is performed.
 //       A better method is not needed because # of buffers are small.
-// In:   fd - file descriptor
+// In:   fileId - buffer file id
 // Ret:  PF_PAGEPINNED or other PF return code
 //
-RC PF_BufferMgr::FlushPages(int fd)
+RC PF_BufferMgr::FlushPages(int fileId)
 {
    RC rc, rcWarn = 0;  // return codes
 
 #ifdef PF_LOG
    char psMessage[100];
-   sprintf (psMessage, "Flushing all pages for (%d).\n", fd);
+   sprintf (psMessage, "Flushing all pages for (%d).\n", fileId);
    WriteLog(psMessage);
 #endif
 
@@ -413,14 +1334,21 @@ RC PF_BufferMgr::FlushPages(int fd)
    pStatisticsMgr->Register(PF_FLUSHPAGES, STAT_ADDONE);
 #endif
 
+   unique_lock<shared_mutex> guard(latch);
+
+   // Write the dirty pages that are not pinned all at once
+   if ((rc = WaitIO(INVALID_SLOT)) ||
+         (rc = WritePages(fileId, ALL_PAGES, false)))
+      return (rc);
+
    // Do a linear scan of the buffer to find pages belonging to the file
    int slot = first;
    while (slot != INVALID_SLOT) {
 
       int next = bufTable[slot].next;
 
-      // If the page belongs to the passed-in file descriptor
-      if (bufTable[slot].fd == fd) {
+      // If the page belongs to the passed-in file
+      if (bufTable[slot].fileId == fileId) {
 
 #ifdef PF_LOG
  sprintf (psMessage, "Page (%d) is in buffer manager.\n", bufTable[slot].pageNum);
@@ -432,19 +1360,8 @@ RC PF_BufferMgr::FlushPages(int fd)
             rcWarn = PF_PAGEPINNED;
          }
          else {
-            // Write the page if dirty
-            if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-               if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
-                  return (rc);
-               bufTable[slot].bDirty = false;
-            }
-
             // Remove page from the hash table and add the slot to the free list
-            if ((rc = hashTable.Delete(fd, bufTable[slot].pageNum)) ||
+            if ((rc = Unhash(slot)) ||
                   (rc = Unlink(slot)) ||
                   (rc = InsertFree(slot)))
                return (rc);
@@ -471,46 +1388,19 @@ RC PF_BufferMgr::FlushPages(int fd)
 // Ret:  Standard PF errors
 //
 //
-RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum)
+RC PF_BufferMgr::ForcePages(int fileId, PageNum pageNum)
 {
-   RC rc;  // return codes
-
 #ifdef PF_LOG
    char psMessage[100];
-   sprintf (psMessage, "Forcing page %d for (%d).\n", pageNum, fd);
+   sprintf (psMessage, "Forcing page %d for (%d).\n", pageNum, fileId);
    WriteLog(psMessage);
 #endif
 
-   // Do a linear scan of the buffer to find the page for the file
-   int slot = first;
-   while (slot != INVALID_SLOT) {
-
-      int next = bufTable[slot].next;
-
-      // If the page belongs to the passed-in file descriptor
-      if (bufTable[slot].fd == fd &&
-            (pageNum==ALL_PAGES || bufTable[slot].pageNum == pageNum)) {
-
-#ifdef PF_LOG
- sprintf (psMessage, "Page (%d) is in buffer pool.\n", bufTable[slot].pageNum);
- WriteLog(psMessage);
-#endif
-         // I don't care if the page is pinned or not, just write it if
-         // it is dirty.
-         if (bufTable[slot].bDirty) {
-#ifdef PF_LOG
-sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
-WriteLog(psMessage);
-#endif
-            if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
-               return (rc);
-            bufTable[slot].bDirty = false;
-         }
-      }
-      slot = next;
-   }
+   unique_lock<shared_mutex> guard(latch);
 
-   return 0;
+   // I don't care if the page is pinned or not, just write it if it is
+   // dirty.
+   return (WritePages(fileId, pageNum, true));
 }
 
 
@@ -525,8 +1415,9 @@ WriteLog(psMessage);
 //
 RC PF_BufferMgr::PrintBuffer()
 {
-   cout << "Buffer contains " << numPages << " pages of size "
-      << pageSize <<".\n";
+   unique_lock<shared_mutex> guard(latch);
+
+   cout << "Buffer contains " << numPages << " pages.\n";
    cout << "Contents in order from most recently used to "
       << "least recently used.\n";
 
@@ -535,7 +1426,7 @@ RC PF_BufferMgr::PrintBuffer()
    while (slot != INVALID_SLOT) {
       next = bufTable[slot].next;
       cout << slot << " :: \n";
-      cout << "  fd = " << bufTable[slot].fd << "\n";
+      cout << "  fileId = " << bufTable[slot].fileId << "\n";
       cout << "  pageNum = " << bufTable[slot].pageNum << "\n";
       cout << "  bDirty = " << bufTable[slot].bDirty << "\n";
       cout << "  pinCount = " << bufTable[slot].pinCount << "\n";
@@ -558,24 +1449,42 @@ RC PF_BufferMgr::PrintBuffer()
 //       This routine will be called via the system command and is only
 //       really useful if the user wants to run some performance
 //       comparison starting with an clean buffer.
+//       Dirty pages are written out first since the buffer is shared
+//       with files that are still open.  Pinned pages are kept.
 // In:   Nothing
 // Out:  Nothing
 // Ret:  Will return an error if a page is pinned and the Clear routine
 //       is called.
 RC PF_BufferMgr::ClearBuffer()
+{
+   unique_lock<shared_mutex> guard(latch);
+   return (InternalClear());
+}
+
+//
+// InternalClear
+//
+// Desc: Internal.  ClearBuffer, with the latch held exclusively.
+// Ret:  PF return code
+//
+RC PF_BufferMgr::InternalClear()
 {
    RC rc;
 
+   if ((rc = WaitIO(INVALID_SLOT)) ||
+         (rc = WritePages(ALL_FILES, ALL_PAGES, false)))
+      return (rc);
+
    int slot, next;
    slot = first;
    while (slot != INVALID_SLOT) {
       next = bufTable[slot].next;
-      if (bufTable[slot].pinCount == 0)
-         if ((rc = hashTable.Delete(bufTable[slot].fd,
-               bufTable[slot].pageNum)) ||
+      if (bufTable[slot].pinCount == 0) {
+         if ((rc = Unhash(slot)) ||
             (rc = Unlink(slot)) ||
             (rc = InsertFree(slot)))
          return (rc);
+      }
       slot = next;
    }
 
@@ -590,95 +1499,101 @@ RC PF_BufferMgr::ClearBuffer()
 // In:   The new buffer size
 // Out:  Nothing
 // Ret:  0 for success or,
-//       Some other PF error (probably PF_NOBUF)
+//       PF_PAGEPINNED if pages are still pinned after clearing the
+//       buffer, or some other PF error
 //
-// Notes: This method attempts to copy all the old pages which I am
-// unable to kick out of the old buffer manager into the new buffer
-// manager.  This obviously cannot always be successfull!
+// Notes: The buffer is cleared first.  Since the buffer is shared by all
+// open files, pinned pages cannot be moved to the new buffer table (the
+// callers hold pointers into the old frames), so resizing is refused
+// while any page is pinned.
 //
 RC PF_BufferMgr::ResizeBuffer(int iNewSize)
+{
+   unique_lock<shared_mutex> guard(latch);
+   return (InternalResize(iNewSize));
+}
+
+//
+// InternalResize
+//
+// Desc: Internal.  ResizeBuffer, with the latch held exclusively.
+// In:   iNewSize - the new buffer size
+// Ret:  PF return code
+//
+RC PF_BufferMgr::InternalResize(int iNewSize)
 {
    int i;
    RC rc;
 
+   if (iNewSize <= 0)
+      return (PF_TOOSMALL);
+
    // First try and clear out the old buffer!
-   ClearBuffer();
+   if ((rc = InternalClear()))
+      return (rc);
+   if (first != INVALID_SLOT)
+      return (PF_PAGEPINNED);
 
-   // Allocate memory for a new buffer table
-   PF_BufPageDesc *pNewBufTable = new PF_BufPageDesc[iNewSize];
+   // Free the old buffer pages
+   UnmapArena();
+   delete [] bufTable;
 
-   // Initialize the new buffer table and allocate memory for buffer
-   // pages.  Initially, the free list contains all pages
+   // Allocate memory for a new buffer table.  Initially, the free list
+   // contains all pages
+   bufTable = new PF_BufPageDesc[iNewSize];
    for (i = 0; i < iNewSize; i++) {
-      if ((pNewBufTable[i].pData = new char[pageSize]) == NULL) {
-         cerr << "Not enough memory for buffer\n";
-         exit(1);
-      }
-
-      memset ((void *)pNewBufTable[i].pData, 0, pageSize);
-
-      pNewBufTable[i].prev = i - 1;
-      pNewBufTable[i].next = i + 1;
-   }
-   pNewBufTable[0].prev = pNewBufTable[iNewSize - 1].next = INVALID_SLOT;
-
-   // Now we must remember the old first and last slots and (of course)
-   // the buffer table itself.  Then we use insert methods to insert
-   // each of the entries into the new buffertable
-   int oldFirst = first;
-   PF_BufPageDesc *pOldBufTable = bufTable;
-
-   // Setup the new number of pages,  first, last and free
-   numPages = iNewSize;
-   first = last = INVALID_SLOT;
-   free = 0;
-
-   // Setup the new buffer table
-   bufTable = pNewBufTable;
-
-   // We must first remove from the hashtable any possible entries
-   int slot, next, newSlot;
-   slot = oldFirst;
-   while (slot != INVALID_SLOT) {
-      next = pOldBufTable[slot].next;
-
-      // Must remove the entry from the hashtable from the
-      if ((rc=hashTable.Delete(pOldBufTable[slot].fd, pOldBufTable[slot].pageNum)))
-         return (rc);
-      slot = next;
-   }
-
-   // Now we traverse through the old buffer table and copy any old
-   // entries into the new one
-   slot = oldFirst;
-   while (slot != INVALID_SLOT) {
-
-      next = pOldBufTable[slot].next;
-      // Allocate a new slot for the old page
-      if ((rc = InternalAlloc(newSlot)))
-         return (rc);
-
-      // Insert the page into the hash table,
-      // and initialize the page description entry
-      if ((rc = hashTable.Insert(pOldBufTable[slot].fd,
-            pOldBufTable[slot].pageNum, newSlot)) ||
-            (rc = InitPageDesc(pOldBufTable[slot].fd,
-            pOldBufTable[slot].pageNum, newSlot)))
-         return (rc);
-
-      // Put the slot back on the free list before returning the error
-      Unlink(newSlot);
-      InsertFree(newSlot);
-
-      slot = next;
+      bufTable[i].pData = NULL;
+      bufTable[i].frameSize = 0;
+      bufTable[i].pMapped = NULL;
+      bufTable[i].bDirty = false;
+      bufTable[i].bIO = PF_IO_NONE;
+      bufTable[i].latch = 0;
+      bufTable[i].prev = i - 1;
+      bufTable[i].next = i + 1;
    }
+   bufTable[0].prev = bufTable[iNewSize - 1].next = INVALID_SLOT;
+   numDirty = 0;
+   cleanMark = 0;
 
-   // Finally, delete the old buffer table
-   delete [] pOldBufTable;
+   // Setup the new number of pages,  first, last and free
+   numPages = iNewSize;
+   first = last = INVALID_SLOT;
+   free = 0;
+   InitPolicy();
+   MapArena(frameStride);
 
    return 0;
 }
 
+//
+// SetReplacePolicy
+//
+// Desc: Switch to another replacement policy.  The buffer is emptied
+//       first, as by ResizeBuffer.
+// In:   _policy - the replacement policy
+// Ret:  PF_PAGEPINNED if pages are still pinned, other PF return code
+//
+RC PF_BufferMgr::SetReplacePolicy(PF_ReplacePolicy _policy)
+{
+   unique_lock<shared_mutex> guard(latch);
+   policy = _policy;
+   return (InternalResize(numPages));
+}
+
+//
+// SetMappedReads
+//
+// Desc: Map the files opened from now on, so that pages pinned
+//       read-only are used in place.  Files already open are left as
+//       they are.
+// In:   _bMappedReads - map the files
+//
+void PF_BufferMgr::SetMappedReads(int _bMappedReads)
+{
+   unique_lock<shared_mutex> guard(latch);
+   bMappedReads = _bMappedReads;
+}
+
 
 //
 // InsertFree
@@ -767,10 +1682,12 @@ RC PF_BufferMgr::Unlink(int slot)
 //       If there is something on the free list, then use it.
 //       Otherwise, choose a victim to replace.  If a victim cannot be
 //       chosen (because all the pages are pinned), then return an error.
+//       The page memory of the slot is grown to size bytes if needed.
+// In:   size - size of the page that will be stored in the slot
 // Out:  slot - set to newly-allocated slot
 // Ret:  PF_NOBUF if all pages are pinned, other PF return code otherwise
 //
-RC PF_BufferMgr::InternalAlloc(int &slot)
+RC PF_BufferMgr::InternalAlloc(int &slot, int size)
 {
    RC  rc;       // return code
 
@@ -781,31 +1698,43 @@ RC PF_BufferMgr::InternalAlloc(int &slot)
    }
    else {
 
-      // Choose the least-recently used page that is unpinned
-      for (slot = last; slot != INVALID_SLOT; slot = bufTable[slot].prev) {
-         if (bufTable[slot].pinCount == 0)
-            break;
+      // Let the replacement policy choose an unpinned page, return
+      // error if all buffers were pinned.  Pages pinned only while they
+      // are written behind or read ahead are waited for.
+      if ((rc = ChooseVictim(slot))) {
+         if (rc != PF_NOBUF || io.GetNumPending() == 0 ||
+               (rc = WaitIO(INVALID_SLOT)) ||
+               (rc = ChooseVictim(slot)))
+            return (rc);
       }
 
-      // Return error if all buffers were pinned
-      if (slot == INVALID_SLOT)
-         return (PF_NOBUF);
-
-      // Write out the page if it is dirty
+      // Write out the page if it is dirty; write behind did not get to
+      // it, so also start on the pages to be replaced after it
       if (bufTable[slot].bDirty) {
-         if ((rc = WritePage(bufTable[slot].fd, bufTable[slot].pageNum,
+         if ((rc = WritePage(bufTable[slot].fileId, bufTable[slot].pageNum,
                bufTable[slot].pData)))
             return (rc);
 
-         bufTable[slot].bDirty = false;
+         SetDirty(slot, false);
+         CleanPages(numPages / 4);
       }
 
+      // 2Q remembers the pages replaced before they were used again
+      if (policy == PF_REPLACE_2Q && bufTable[slot].queue == PF_2Q_A1IN)
+         Remember(slot);
+
       // Remove page from the hash table and slot from the used buffer list
-      if ((rc = hashTable.Delete(bufTable[slot].fd, bufTable[slot].pageNum)) ||
+      if ((rc = Unhash(slot)) ||
             (rc = Unlink(slot)))
          return (rc);
    }
 
+   // Make sure the slot is large enough for the page
+   if ((rc = GetFrame(slot, size))) {
+      InsertFree(slot);
+      return (rc);
+   }
+
    // Link slot at the head of the used list
    if ((rc = LinkHead(slot)))
       return (rc);
@@ -815,19 +1744,473 @@ RC PF_BufferMgr::InternalAlloc(int &slot)
 }
 
 //
-// ReadPage
+// Unhash
+//
+// Desc: Internal.  Remove the page held by slot from the hash table and
+//       the replacement policy, and update the page count of its file.
+// In:   slot - slot number of the page
+// Ret:  PF return code
+//
+RC PF_BufferMgr::Unhash(int slot)
+{
+   RC rc;
+
+   if ((rc = hashTable.Delete(bufTable[slot].fileId, bufTable[slot].pageNum)))
+      return (rc);
+   if (bufTable[slot].fileId >= 0)
+      fileTable[bufTable[slot].fileId].numBufPages--;
+   Forget(slot);
+
+   // Return ok
+   return (0);
+}
+
+//
+// PrefetchPage
+//
+// Desc: Tell the OS that a page will be read soon, so that it is read
+//       from disk while the caller works on other pages.  Nothing is
+//       done if the page is in the buffer.  The page of a direct file
+//       is read into the buffer through the I/O engine, as a page read
+//       ahead, if a slot is free for it.
+// In:   fileId - buffer file id
+//       pageNum - number of the page
+// Ret:  PF return code
+//
+RC PF_BufferMgr::PrefetchPage(int fileId, PageNum pageNum)
+{
+   int slot;
+   int pageSize = fileTable[fileId].pageSize;
+
+   unique_lock<shared_mutex> guard(latch);
+
+   if (fileTable[fileId].fd < 0)
+      return (PF_CLOSEDFILE);
+   if (hashTable.Find(fileId, pageNum, slot) == 0)
+      return (0);
+
+   if (fileTable[fileId].bDirect) {
+      ReadAhead(fileId, pageNum, 1);
+      return (0);
+   }
+
+#ifdef POSIX_FADV_WILLNEED
+   posix_fadvise(fileTable[fileId].fd, pageNum * (off_t)pageSize + pageSize,
+                 pageSize, POSIX_FADV_WILLNEED);
+#endif
+   return (0);
+}
+
+//
+// ReadAhead
+//
+// Desc: Internal.  Start reading up to numPages pages of a file, from
+//       firstPage on.  The pages read are only those before the next
+//       page of the file already in the buffer.  They get slots as any
+//       page read and are put in the hash table as PF_IO_ENGINE, pinned
+//       until FinishIO sees them read, and are read by one request to
+//       the I/O engine.  A page past the end of the file leaves the
+//       buffer then.  The OS is also told that the window after them
+//       will be needed.
+// In:   fileId - buffer file id
+//       firstPage - number of the first page to read
+//       numPages - number of pages to read
+//
+void PF_BufferMgr::ReadAhead(int fileId, PageNum firstPage, int numPages)
+{
+   int   fd = fileTable[fileId].fd;
+   int   pageSize = fileTable[fileId].pageSize;
+   int   aheadSlot[PF_READAHEAD_MAX];
+   int   n, s;
+
+   // Free the slots of the reads already done
+   ReapIO();
+   if (numPages == 0 || io.IsFull())
+      return;
+
+   for (n = 0; n < numPages; n++) {
+      PageNum p = firstPage + n;
+      if (hashTable.Find(fileId, p, s) == 0 ||
+            InternalAlloc(s, pageSize))
+         break;
+      if (hashTable.Insert(fileId, p, s)) {
+         Unlink(s);
+         InsertFree(s);
+         break;
+      }
+      InitPageDesc(fileId, p, s);
+      bufTable[s].bIO = PF_IO_ENGINE;
+      aheadSlot[n] = s;
+   }
+   if (n > 0 && SubmitIO(fileId, firstPage, false, aheadSlot, n)) {
+      for (int i = 0; i < n; i++) {
+         s = aheadSlot[i];
+         bufTable[s].bIO = PF_IO_NONE;
+         bufTable[s].pinCount = 0;
+         Unhash(s);
+         Unlink(s);
+         InsertFree(s);
+      }
+      n = 0;
+   }
+   io.Start();
+
+#ifdef PF_LOG
+   char psMessage[100];
+   sprintf (psMessage, "Reading ahead %d pages from (%d,%d).\n", n, fd, firstPage);
+   WriteLog(psMessage);
+#endif
+
+#ifdef POSIX_FADV_WILLNEED
+   // Let the OS fetch the next window while these pages are used
+   if (!fileTable[fileId].bDirect)
+      posix_fadvise(fd, (firstPage + n) * (off_t)pageSize + pageSize,
+                    numPages * (off_t)pageSize, POSIX_FADV_WILLNEED);
+#endif
+}
+
+//
+// WritePages
+//
+// Desc: Internal.  Write the dirty pages of a file, in page order and
+//       all through the I/O engine at once, then wait for them.  A page
+//       whose write fails is left dirty.
+// In:   fileId - buffer file id, or ALL_FILES
+//       pageNum - page to write, or ALL_PAGES
+//       bPinned - also write pinned pages
+// Ret:  PF return code of the first write that failed
+//
+RC PF_BufferMgr::WritePages(int fileId, PageNum pageNum, int bPinned)
+{
+   RC  rc, rcFirst;
+   vector<int> slots;
+
+   for (int slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next) {
+      if (bufTable[slot].bDirty &&
+            (fileId == ALL_FILES || bufTable[slot].fileId == fileId) &&
+            (pageNum == ALL_PAGES || bufTable[slot].pageNum == pageNum) &&
+            (bPinned || bufTable[slot].pinCount == 0))
+         slots.push_back(slot);
+   }
+
+   rcFirst = WriteRuns(slots, false);
+   if ((rc = WaitIO(INVALID_SLOT)) && !rcFirst)
+      rcFirst = rc;
+   return (rcFirst);
+}
+
+//
+// WriteRuns
+//
+// Desc: Internal.  Sort dirty pages by file and page number and start
+//       writing them, one request to the I/O engine per run of
+//       consecutive pages.  Does not wait for the writes.
+//       A buffered write of one page costs less done at once than
+//       handed to the engine, so bSyncSingle has such pages written
+//       right away.
+// In:   slots - slots of the dirty pages, sorted on return
+//       bSyncSingle - write a page with no dirty neighbour at once
+// Ret:  PF return code of the first page that could not be submitted
+//
+RC PF_BufferMgr::WriteRuns(vector<int> &slots, int bSyncSingle)
+{
+   RC  rc, rcFirst = 0;
+   int run[PF_IO_MAXVEC];
+   int numRun = 0;
+
+   sort(slots.begin(), slots.end(), [this](int a, int b) {
+      if (bufTable[a].fileId != bufTable[b].fileId)
+         return (bufTable[a].fileId < bufTable[b].fileId);
+      return (bufTable[a].pageNum < bufTable[b].pageNum);
+   });
+
+   // Write each run of consecutive pages with one request
+   for (size_t i = 0; i <= slots.size(); i++) {
+      int slot = (i < slots.size()) ? slots[i] : INVALID_SLOT;
+
+      if (numRun > 0 && (slot == INVALID_SLOT || numRun == PF_IO_MAXVEC ||
+            bufTable[slot].fileId != bufTable[run[0]].fileId ||
+            bufTable[slot].pageNum != bufTable[run[numRun - 1]].pageNum + 1)) {
+
+         // Make room by applying a finished request
+         if (io.IsFull()) {
+            long tag;
+            int result;
+            if (!io.Complete(tag, result, true))
+               return (PF_UNIX);
+            if ((rc = FinishIO(tag, result)) && !rcFirst)
+               rcFirst = rc;
+         }
+         if (numRun == 1 && bSyncSingle) {
+            if ((rc = WritePage(bufTable[run[0]].fileId,
+                  bufTable[run[0]].pageNum, bufTable[run[0]].pData)))
+               return (rc);
+            SetDirty(run[0], false);
+         }
+         else if ((rc = SubmitIO(bufTable[run[0]].fileId,
+               bufTable[run[0]].pageNum, true, run, numRun)))
+            return (rc);
+         numRun = 0;
+      }
+      if (slot == INVALID_SLOT)
+         break;
+
+      // Pages of closed files and memory blocks are never written
+      int id = bufTable[slot].fileId;
+      if (id < 0 || fileTable[id].fd < 0) {
+         if (!rcFirst)
+            rcFirst = PF_CLOSEDFILE;
+         continue;
+      }
+      run[numRun++] = slot;
+   }
+
+   return (rcFirst);
+}
+
+//
+// CleanPages
+//
+// Desc: Internal.  Write behind: start writing the dirty pages among the
+//       next maxScan pages the replacement policy would replace, so that
+//       they are clean by the time they are replaced.  Pinned pages are
+//       skipped.  The writes go on while the caller does; each page is
+//       pinned until its write is done.
+// In:   maxScan - number of pages to look at, in replacement order
+//
+void PF_BufferMgr::CleanPages(int maxScan)
+{
+   vector<int> slots;
+   int slot, n = 0;
+
+   // Pages whose write-behind is done can be looked at again
+   ReapIO();
+
+   switch (policy) {
+   case PF_REPLACE_CLOCK:
+      for (slot = clockHand; n < maxScan && n < numPages; n++) {
+         if (bufTable[slot].bDirty && bufTable[slot].pinCount == 0)
+            slots.push_back(slot);
+         slot = (slot + 1) % numPages;
+      }
+      break;
+
+   case PF_REPLACE_2Q:
+      for (int q = PF_2Q_A1IN; q <= PF_2Q_AM; q++)
+         for (slot = qTail[q]; slot != INVALID_SLOT && n < maxScan;
+               slot = bufTable[slot].qPrev, n++)
+            if (bufTable[slot].bDirty && bufTable[slot].pinCount == 0)
+               slots.push_back(slot);
+      break;
+
+   default:
+      for (slot = last; slot != INVALID_SLOT && n < maxScan;
+            slot = bufTable[slot].prev, n++)
+         if (bufTable[slot].bDirty && bufTable[slot].pinCount == 0)
+            slots.push_back(slot);
+      break;
+   }
+
+   // Pages of closed files and memory blocks are never written
+   size_t j = 0;
+   for (size_t i = 0; i < slots.size(); i++) {
+      int id = bufTable[slots[i]].fileId;
+      if (id >= 0 && fileTable[id].fd >= 0)
+         slots[j++] = slots[i];
+   }
+   slots.resize(j);
+
+   WriteRuns(slots, true);
+   io.Start();
+
+   // Do not look again before a few more pages are dirty
+   cleanMark = numDirty + numPages / 8;
+}
+
+//
+// SetDirty
+//
+// Desc: Internal.  Mark the page in slot dirty or clean, and keep count
+//       of the dirty pages.
+// In:   slot - slot of the page
+//       bDirty - new state
+//
+void PF_BufferMgr::SetDirty(int slot, int bDirty)
+{
+   if (bufTable[slot].bDirty == (bDirty != 0))
+      return;
+   bufTable[slot].bDirty = (bDirty != 0);
+   numDirty += bDirty ? 1 : -1;
+}
+
+//
+// SubmitIO
+//
+// Desc: Internal.  Hand a read or write of consecutive pages of a file to
+//       the I/O engine.  The pages written are marked clean and pinned
+//       until the write is done.
+// In:   fileId - buffer file id
+//       pageNum - number of the first page
+//       bWrite - write rather than read
+//       slots, numSlots - slots of the pages, at most PF_IO_MAXVEC
+// Ret:  PF_NOBUF if the engine is full, other PF return code
+//
+RC PF_BufferMgr::SubmitIO(int fileId, PageNum pageNum, int bWrite,
+      const int *slots, int numSlots)
+{
+   RC  rc;
+   int pageSize = fileTable[fileId].pageSize;
+   struct iovec iov[PF_IO_MAXVEC];
+
+   if (numFreeBatches == 0)
+      return (PF_NOBUF);
+   int b = freeBatches[--numFreeBatches];
+   batches[b].bWrite = bWrite;
+   batches[b].numSlots = numSlots;
+   for (int i = 0; i < numSlots; i++) {
+      batches[b].slots[i] = slots[i];
+      iov[i].iov_base = bufTable[slots[i]].pData;
+      iov[i].iov_len = pageSize;
+   }
+
+#ifdef PF_LOG
+   char psMessage[100];
+   sprintf (psMessage, "%s (%d,%d) and %d more.\n", bWrite ? "Writing" :
+         "Reading", fileTable[fileId].fd, pageNum, numSlots - 1);
+   WriteLog(psMessage);
+#endif
+
+   if ((rc = io.Submit(fileTable[fileId].fd, bWrite, iov, numSlots,
+         pageNum * (off_t)pageSize + pageSize, b))) {
+      freeBatches[numFreeBatches++] = b;
+      return (rc);
+   }
+   if (bWrite) {
+      for (int i = 0; i < numSlots; i++) {
+         SetDirty(slots[i], false);
+         bufTable[slots[i]].pinCount++;
+      }
+      numWriting += numSlots;
+   }
+   return (0);
+}
+
+//
+// FinishIO
+//
+// Desc: Internal.  Apply a request the I/O engine finished.  A page read
+//       ahead is unpinned, or dropped if it could not be read in full.
+//       A page written is unpinned, or marked dirty again if it could
+//       not be written.
+// In:   tag - index of the batch
+//       result - bytes transferred, or -errno
+// Ret:  PF return code of a failed write
+//
+RC PF_BufferMgr::FinishIO(long tag, int result)
+{
+   PF_IOBatch &batch = batches[tag];
+   int pageSize = fileTable[bufTable[batch.slots[0]].fileId].pageSize;
+   int numDone = (result < 0) ? 0 : result / pageSize;
+   RC  rc = 0;
+
+   freeBatches[numFreeBatches++] = (int)tag;
+
+   for (int i = 0; i < batch.numSlots; i++) {
+      int slot = batch.slots[i];
+
+      if (batch.bWrite) {
+         bufTable[slot].pinCount--;
+         numWriting--;
+         if (i < numDone) {
+#ifdef PF_STATS
+            pStatisticsMgr->Register(PF_WRITEPAGE, STAT_ADDONE);
+#endif
+            continue;
+         }
+         SetDirty(slot, true);
+         rc = (result < 0) ? PF_UNIX : PF_INCOMPLETEWRITE;
+         continue;
+      }
+
+      bufTable[slot].bIO = PF_IO_NONE;
+      bufTable[slot].pinCount--;
+      if (i < numDone) {
+#ifdef PF_STATS
+         pStatisticsMgr->Register(PF_READPAGE, STAT_ADDONE);
+#endif
+         continue;
+      }
+
+      // Past the end of the file, or the read failed: the caller of
+      // GetPage will read the page itself
+      Unhash(slot);
+      Unlink(slot);
+      InsertFree(slot);
+   }
+   return (rc);
+}
+
+//
+// WaitIO
+//
+// Desc: Internal.  Wait until the page in slot is read, or until no
+//       request at all is in flight if slot is INVALID_SLOT.  The latch
+//       must be held exclusively; it is released while another thread
+//       reads the page.
+// In:   slot - slot with bIO set, or INVALID_SLOT
+// Ret:  PF return code of the first write that failed
+//
+RC PF_BufferMgr::WaitIO(int slot)
+{
+   RC   rc, rcFirst = 0;
+   long tag;
+   int  result;
+
+   while (1) {
+      if (slot != INVALID_SLOT && bufTable[slot].bIO == PF_IO_THREAD) {
+         readDone.wait(latch);
+         continue;
+      }
+      if (io.GetNumPending() == 0 ||
+            (slot != INVALID_SLOT && bufTable[slot].bIO == PF_IO_NONE))
+         break;
+      if (!io.Complete(tag, result, true))
+         return (PF_UNIX);
+      if ((rc = FinishIO(tag, result)) && !rcFirst)
+         rcFirst = rc;
+   }
+   return (rcFirst);
+}
+
+//
+// ReapIO
+//
+// Desc: Internal.  Apply the requests that are already finished.
+//
+void PF_BufferMgr::ReapIO()
+{
+   long tag;
+   int  result;
+
+   while (io.Complete(tag, result, false))
+      FinishIO(tag, result);
+}
+
 //
-// Desc: Read a page from disk
+// ReadPage
 //
-// In:   fd - OS file descriptor
+// Desc: Read a page from disk.  It touches nothing of the buffer
+//       manager but the statistics, so that it may run with the latch
+//       released.
+// In:   fd - OS file descriptor of the file
+//       pageSize - size of the pages of the file
 //       pageNum - number of page to read
 //       dest - pointer to buffer in which to read page
 // Out:  dest - buffer contains page contents
 // Ret:  PF return code
 //
-RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
+RC PF_BufferMgr::ReadPage(int fd, int pageSize, PageNum pageNum, char *dest)
 {
-
 #ifdef PF_LOG
    char psMessage[100];
    sprintf (psMessage, "Reading (%d,%d).\n", fd, pageNum);
@@ -838,13 +2221,9 @@ RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
    pStatisticsMgr->Register(PF_READPAGE, STAT_ADDONE);
 #endif
 
-   // seek to the appropriate place (cast to long for PC's)
-   long offset = pageNum * (long)pageSize + pageSize;
-   if (lseek(fd, offset, L_SET) < 0)
-      return (PF_UNIX);
-
-   // Read the data
-   int numBytes = read(fd, dest, pageSize);
+   // Read the data at its offset, the file position is shared by threads
+   off_t offset = pageNum * (off_t)pageSize + pageSize;
+   int numBytes = pread(fd, dest, pageSize, offset);
    if (numBytes < 0)
       return (PF_UNIX);
    else if (numBytes != pageSize)
@@ -858,13 +2237,19 @@ RC PF_BufferMgr::ReadPage(int fd, PageNum pageNum, char *dest)
 //
 // Desc: Write a page to disk
 //
-// In:   fd - OS file descriptor
+// In:   fileId - buffer file id
 //       pageNum - number of page to write
 //       dest - pointer to buffer containing page contents
 // Ret:  PF return code
 //
-RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
+RC PF_BufferMgr::WritePage(int fileId, PageNum pageNum, char *source)
 {
+   // Pages of closed files and memory blocks are never written
+   if (fileId < 0 || fileTable[fileId].fd < 0)
+      return (PF_CLOSEDFILE);
+
+   int fd = fileTable[fileId].fd;
+   int pageSize = fileTable[fileId].pageSize;
 
 #ifdef PF_LOG
    char psMessage[100];
@@ -876,13 +2261,9 @@ RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
    pStatisticsMgr->Register(PF_WRITEPAGE, STAT_ADDONE);
 #endif
 
-   // seek to the appropriate place (cast to long for PC's)
-   long offset = pageNum * (long)pageSize + pageSize;
-   if (lseek(fd, offset, L_SET) < 0)
-      return (PF_UNIX);
-
-   // Read the data
-   int numBytes = write(fd, source, pageSize);
+   // Write the data at its offset
+   off_t offset = pageNum * (off_t)pageSize + pageSize;
+   int numBytes = pwrite(fd, source, pageSize, offset);
    if (numBytes < 0)
       return (PF_UNIX);
    else if (numBytes != pageSize)
@@ -896,22 +2277,279 @@ RC PF_BufferMgr::WritePage(int fd, PageNum pageNum, char *source)
 //
 // Desc: Internal.  Initialize PF_BufPageDesc to a newly-pinned page
 //       for a newly pinned page
-// In:   fd - file descriptor
+// In:   fileId - buffer file id
 //       pageNum - page number
 // Ret:  PF return code
 //
-RC PF_BufferMgr::InitPageDesc(int fd, PageNum pageNum, int slot)
+RC PF_BufferMgr::InitPageDesc(int fileId, PageNum pageNum, int slot)
 {
    // set the slot to refer to a newly-pinned page
-   bufTable[slot].fd       = fd;
+   bufTable[slot].fileId   = fileId;
    bufTable[slot].pageNum  = pageNum;
-   bufTable[slot].bDirty   = false;
+   SetDirty(slot, false);
    bufTable[slot].pinCount = 1;
+   bufTable[slot].bIO      = PF_IO_NONE;
+   bufTable[slot].latch    = 0;
+   bufTable[slot].pMapped  = NULL;
+
+   if (fileId >= 0)
+      fileTable[fileId].numBufPages++;
+   Admit(slot);
 
    // Return ok
    return (0);
 }
 
+//------------------------------------------------------------------------------
+// Replacement policy
+//------------------------------------------------------------------------------
+
+//
+// InitPolicy
+//
+// Desc: Internal.  Reset the state of the replacement policy for an
+//       empty buffer of numPages pages.
+//
+void PF_BufferMgr::InitPolicy()
+{
+   for (int i = 0; i < numPages; i++) {
+      bufTable[i].bRef = 0;
+      bufTable[i].queue = PF_2Q_NONE;
+      bufTable[i].qNext = bufTable[i].qPrev = INVALID_SLOT;
+   }
+   clockHand = 0;
+   for (int q = 0; q < 2; q++) {
+      qHead[q] = qTail[q] = INVALID_SLOT;
+      qSize[q] = 0;
+   }
+
+   // 2Q remembers as many replaced pages as half the buffer holds
+   delete ghostTable;
+   delete [] ghostRing;
+   ghostTable = NULL;
+   ghostRing = NULL;
+   if (policy == PF_REPLACE_2Q) {
+      numGhosts = (numPages / 2 > 0) ? numPages / 2 : 1;
+      ghostTable = new PF_HashTable(numGhosts);
+      ghostRing = new PF_HashEntry[numGhosts];
+      for (int i = 0; i < numGhosts; i++)
+         ghostRing[i].slot = -1;
+      ghostPos = 0;
+   }
+}
+
+//
+// Admit
+//
+// Desc: Internal.  A page was read or allocated into slot.  2Q puts it
+//       in Am if it was replaced recently, in A1in otherwise.
+// In:   slot - slot of the page, its fileId and pageNum are set
+//
+void PF_BufferMgr::Admit(int slot)
+{
+   int g;
+
+   switch (policy) {
+   case PF_REPLACE_CLOCK:
+      bufTable[slot].bRef = 1;
+      break;
+   case PF_REPLACE_2Q:
+      if (bufTable[slot].fileId >= 0 &&
+            ghostTable->Find(bufTable[slot].fileId, bufTable[slot].pageNum, g) == 0) {
+         ghostTable->Delete(bufTable[slot].fileId, bufTable[slot].pageNum);
+         ghostRing[g].slot = -1;
+         QueuePush(slot, PF_2Q_AM);
+      }
+      else
+         QueuePush(slot, PF_2Q_A1IN);
+      break;
+   default:
+      // LRU: InternalAlloc linked the slot at the head of the used list
+      break;
+   }
+}
+
+//
+// Touch
+//
+// Desc: Internal.  The page in slot was used again.
+// In:   slot - slot of the page
+//
+void PF_BufferMgr::Touch(int slot)
+{
+   switch (policy) {
+   case PF_REPLACE_CLOCK:
+      // Hits may set it at once with the latch shared
+      __atomic_store_n(&bufTable[slot].bRef, 1, __ATOMIC_RELAXED);
+      break;
+   case PF_REPLACE_2Q:
+      // A1in is FIFO, a page only moves up within Am
+      if (bufTable[slot].queue == PF_2Q_AM) {
+         QueueRemove(slot);
+         QueuePush(slot, PF_2Q_AM);
+      }
+      break;
+   default:
+      Unlink(slot);
+      LinkHead(slot);
+      break;
+   }
+}
+
+//
+// IsSharedTouch
+//
+// Desc: Internal.  Whether Touch leaves the lists of the replacement
+//       policy as they are for the page in slot, so that it may run
+//       with the latch shared.
+// In:   slot - slot of the page
+// Ret:  true if Touch changes nothing but the reference bit
+//
+int PF_BufferMgr::IsSharedTouch(int slot) const
+{
+   return (policy == PF_REPLACE_CLOCK ||
+         (policy == PF_REPLACE_2Q && bufTable[slot].queue != PF_2Q_AM));
+}
+
+//
+// Forget
+//
+// Desc: Internal.  The page in slot left the buffer.
+// In:   slot - slot of the page
+//
+void PF_BufferMgr::Forget(int slot)
+{
+   bufTable[slot].bRef = 0;
+   QueueRemove(slot);
+}
+
+//
+// ChooseVictim
+//
+// Desc: Internal.  Choose an unpinned page to replace.  Called when the
+//       free list is empty, so every slot holds a page.
+//       LRU takes the least recently used page.
+//       CLOCK sweeps the slots, clearing reference bits on its way, and
+//       takes the first page whose bit is already clear.
+//       2Q takes the oldest page of A1in while A1in holds more than a
+//       quarter of the buffer, the least recently used page of Am
+//       otherwise.
+// Out:  slot - slot of the page to replace
+// Ret:  PF_NOBUF if all pages are pinned
+//
+RC PF_BufferMgr::ChooseVictim(int &slot)
+{
+   switch (policy) {
+   case PF_REPLACE_CLOCK:
+      // Two turns clear every bit, so a page is found unless all are pinned
+      for (int i = 0; i < 2 * numPages; i++) {
+         slot = clockHand;
+         clockHand = (clockHand + 1) % numPages;
+         if (bufTable[slot].pinCount > 0)
+            continue;
+         if (!bufTable[slot].bRef)
+            return (0);
+         bufTable[slot].bRef = 0;
+      }
+      break;
+
+   case PF_REPLACE_2Q: {
+      int kin = (numPages / 4 > 0) ? numPages / 4 : 1;
+      int q = (qSize[PF_2Q_A1IN] > kin || qTail[PF_2Q_AM] == INVALID_SLOT) ?
+            PF_2Q_A1IN : PF_2Q_AM;
+
+      // Fall back to the other queue if all pages of q are pinned
+      for (int i = 0; i < 2; i++, q = 1 - q) {
+         for (slot = qTail[q]; slot != INVALID_SLOT; slot = bufTable[slot].qPrev)
+            if (bufTable[slot].pinCount == 0)
+               return (0);
+      }
+      break;
+   }
+
+   default:
+      for (slot = last; slot != INVALID_SLOT; slot = bufTable[slot].prev)
+         if (bufTable[slot].pinCount == 0)
+            return (0);
+      break;
+   }
+
+   return (PF_NOBUF);
+}
+
+//
+// QueuePush
+//
+// Desc: Internal.  Insert a slot at the head of a 2Q queue
+// In:   slot - slot number to insert
+//       q - PF_2Q_A1IN or PF_2Q_AM
+//
+void PF_BufferMgr::QueuePush(int slot, int q)
+{
+   bufTable[slot].qNext = qHead[q];
+   bufTable[slot].qPrev = INVALID_SLOT;
+   if (qHead[q] != INVALID_SLOT)
+      bufTable[qHead[q]].qPrev = slot;
+   qHead[q] = slot;
+   if (qTail[q] == INVALID_SLOT)
+      qTail[q] = slot;
+   bufTable[slot].queue = q;
+   qSize[q]++;
+}
+
+//
+// QueueRemove
+//
+// Desc: Internal.  Unlink a slot from its 2Q queue, if any
+// In:   slot - slot number to unlink
+//
+void PF_BufferMgr::QueueRemove(int slot)
+{
+   int q = bufTable[slot].queue;
+   if (q == PF_2Q_NONE)
+      return;
+
+   if (qHead[q] == slot)
+      qHead[q] = bufTable[slot].qNext;
+   if (qTail[q] == slot)
+      qTail[q] = bufTable[slot].qPrev;
+   if (bufTable[slot].qNext != INVALID_SLOT)
+      bufTable[bufTable[slot].qNext].qPrev = bufTable[slot].qPrev;
+   if (bufTable[slot].qPrev != INVALID_SLOT)
+      bufTable[bufTable[slot].qPrev].qNext = bufTable[slot].qNext;
+
+   bufTable[slot].qNext = bufTable[slot].qPrev = INVALID_SLOT;
+   bufTable[slot].queue = PF_2Q_NONE;
+   qSize[q]--;
+}
+
+//
+// Remember
+//
+// Desc: Internal.  Add the page in slot to the 2Q ghost list, dropping
+//       the oldest entry once the list is full.
+// In:   slot - slot of the page being replaced
+//
+void PF_BufferMgr::Remember(int slot)
+{
+   int fileId = bufTable[slot].fileId;
+   PageNum pageNum = bufTable[slot].pageNum;
+   if (fileId < 0)
+      return;
+
+   PF_HashEntry &entry = ghostRing[ghostPos];
+   if (entry.slot != -1)
+      ghostTable->Delete(entry.fd, entry.pageNum);
+   if (ghostTable->Insert(fileId, pageNum, ghostPos) == 0) {
+      entry.fd = fileId;
+      entry.pageNum = pageNum;
+      entry.slot = ghostPos;
+   }
+   else
+      entry.slot = -1;
+   ghostPos = (ghostPos + 1) % numGhosts;
+}
+
 //------------------------------------------------------------------------------
 // Methods for manipulating raw memory buffers
 //------------------------------------------------------------------------------
@@ -943,9 +2581,11 @@ RC PF_BufferMgr::AllocateBlock(char *&buffer)
 {
    RC rc = OK_RC;
 
+   unique_lock<shared_mutex> guard(latch);
+
    // Get an empty slot from the buffer pool
    int slot;
-   if ((rc = InternalAlloc(slot)) != OK_RC)
+   if ((rc = InternalAlloc(slot, pageSize)) != OK_RC)
       return rc;
 
    // Create artificial page number (just needs to be unique for hash table)
@@ -974,5 +2614,6 @@ RC PF_BufferMgr::AllocateBlock(char *&buffer)
 //
 RC PF_BufferMgr::DisposeBlock(char* buffer)
 {
-   return UnpinPage(MEMORY_FD, buffer - (char *)0);
+   unique_lock<shared_mutex> guard(latch);
+   return InternalUnpin(MEMORY_FD, buffer - (char *)0);
 }
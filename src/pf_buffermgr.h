@@ -11,12 +11,34 @@
 // 1998: Allow chunks from the buffer manager to not be associated with
 // a particular file.  Allows students to use main memory chunks that
 // are associated with (and limited by) the buffer.
+// 2021: A single buffer manager is now shared by every open file of the
+// process.  Pages are cached per file id rather than per OS file
+// descriptor so that clean pages survive closing and re-opening a file.
+// 2021: The page to replace is chosen by a PF_ReplacePolicy.  The used
+// list still holds every page in the buffer, but is only kept in LRU
+// order by PF_REPLACE_LRU.
+// 2021: Sequential reads of a file are detected and read ahead, several
+// pages per system call.
+// 2021: Pages read ahead and pages flushed go through a PF_IOEngine, so
+// that they are read and written while the caller goes on.
+// 2021: Dirty pages about to be replaced are written behind, before
+// they are replaced, see CleanPages.
+// 2021: Files may be mapped, so that pages pinned read-only point into
+// the mapping rather than being copied into a frame.
+// 2021: Frames are carved from one page-aligned arena, see MapArena, and
+// the page descriptors are one cache line each.
+// 2021: The buffer manager may be used by several threads at once, see
+// the latches below.
 //
 
 #ifndef PF_BUFFERMGR_H
 #define PF_BUFFERMGR_H
 
+#include <sys/types.h>
+#include <shared_mutex>
+#include <condition_variable>
 #include "pf_hashtable.h"
+#include "pf_io.h"
 
 //
 // Defines
@@ -28,43 +50,141 @@
 // next.
 #define INVALID_SLOT  (-1)
 
+// ALL_FILES stands for every file in WritePages
+#define ALL_FILES     (-2)
+
+// Queues of PF_REPLACE_2Q.  Pages enter A1in, which is FIFO.  A page
+// replaced from A1in is remembered in a ghost list; if it is read again
+// while remembered it enters Am, which is LRU.  A full scan thus only
+// cycles through A1in and leaves the pages in Am alone.
+#define PF_2Q_NONE    (-1)
+#define PF_2Q_A1IN    0
+#define PF_2Q_AM      1
+
+// Values of PF_BufPageDesc::bIO.  A page being read is already in the
+// hash table, pinned until the read is done.
+#define PF_IO_NONE    0             // not being read
+#define PF_IO_ENGINE  1             // read ahead through the I/O engine
+#define PF_IO_THREAD  2             // read by a thread, buffer unlatched
+
+// PF_BufPageDesc::latch is the # of threads holding it shared, or
+// PF_LATCH_WRITER while one thread holds it exclusively.  A thread
+// waiting to hold it exclusively sets PF_LATCH_WAITING, which keeps new
+// shared holders out until it has the latch.
+#define PF_LATCH_WRITER   (-1)
+#define PF_LATCH_WAITING  0x40000000
+
 //
 // PF_BufPageDesc - struct containing data about a page in the buffer
 //
-struct PF_BufPageDesc {
-    char       *pData;      // page contents
+// The members are ordered so that a descriptor fills one cache line.
+//
+struct alignas(PF_CACHE_LINE) PF_BufPageDesc {
+    char       *pData;      // page contents, the frame of the slot
+    char       *pMapped;    // page in the file mapping, NULL if the page
+                            // is in pData
+    int        frameSize;   // # of bytes of the frame
     int        next;        // next in the linked list of buffer pages
     int        prev;        // prev in the linked list of buffer pages
-    int        bDirty;      // true if page is dirty
-    short int  pinCount;    // pin count
+    int        qNext;       // next in the 2Q queue
+    int        qPrev;       // prev in the 2Q queue
     PageNum    pageNum;     // page number for this page
-    int        fd;          // OS file descriptor of this page
+    int        fileId;      // buffer file id of this page
+    int        bDirty;      // true if page is dirty
+    int        latch;       // frame latch, see PF_LATCH_WRITER
+    short int  pinCount;    // pin count, atomic under a shared latch
+    short int  bIO;         // PF_IO_*, being read
+    short int  bRef;        // CLOCK reference bit
+    short int  queue;       // 2Q queue of this page
+};
+
+//
+// PF_BufFile - struct containing data about a file known to the buffer
+//
+// An entry is created when a file is opened and is kept after the file
+// is closed, as long as pages of the file remain in the buffer.  The
+// device, inode, size and modification and change times, to the
+// nanosecond, identify the file when it is opened again, so that its
+// cached pages can be reused.
+//
+struct PF_BufFile {
+    int        fd;          // OS file descriptor, -1 if file is closed
+    int        pageSize;    // # of bytes a page takes on disk, its stride
+    dev_t      dev;         // device of the file
+    ino_t      ino;         // inode of the file
+    off_t      size;        // size of the file when it was closed
+    struct timespec mtime;  // modification time when it was closed
+    struct timespec ctime;  // change time when it was closed
+    int        bReusable;   // pages can be reused if the times match
+    int        numBufPages; // # of pages of the file in the buffer
+    PageNum    lastPage;    // page last asked for
+    int        raPages;     // read-ahead window, 0 if not reading in order
+    char       *pMap;       // read-only mapping of the file, or NULL
+    size_t     mapSize;     // # of bytes mapped
+    PageNum    numMapped;   // # of pages in the mapping
+    int        bDirect;     // opened for direct I/O, not cached by the OS
+};
+
+//
+// PF_IOBatch - the slots of the pages of a request to the PF_IOEngine
+//
+struct PF_IOBatch {
+    int        bWrite;      // write rather than read
+    int        numSlots;    // # of pages, consecutive in one file
+    int        slots[PF_IO_MAXVEC];
 };
 
 //
 // PF_BufferMgr - manage the page buffer
 //
+// Threads share the buffer manager.  Its bookkeeping is guarded by one
+// reader/writer latch.  Most methods hold it exclusively, and release
+// it while a page missing from the buffer is read.  A hit in GetPage,
+// and UnpinPage, only hold it shared when the replacement policy need
+// not reorder its lists for them: always under CLOCK, and for pages in
+// A1in under 2Q.  The pin counts are then changed atomically.  The
+// contents of a page are guarded by its frame latch, LatchPage, which
+// callers that share pages between threads take while the page is
+// pinned.  PF_STATS and PF_LOG are not thread safe.
+//
 class PF_BufferMgr {
 public:
-    int            pageSize;                      // Size of pages in the buffer
+    int            pageSize;                      // Size of memory blocks
 
-    PF_BufferMgr     (int _numPages, int _pageSize);            
+    PF_BufferMgr     (int _numPages, int _pageSize,
+                      PF_ReplacePolicy _policy = PF_REPLACE_POLICY);
                                                   // Constructor - allocate
                                                   // numPages buffer pages
     ~PF_BufferMgr    ();                         // Destructor
 
-    // Read pageNum into buffer, point *ppBuffer to location
-    RC  GetPage      (int fd, PageNum pageNum, char **ppBuffer,
-                      int bMultiplePins = true);
+    // Register an open file with the buffer, set fileId to the id under
+    // which its pages are cached
+    RC  OpenFile     (int fd, int _pageSize, int &fileId);
+    // Write out the dirty pages of a file and detach it from its OS file
+    // descriptor.  Clean pages stay in the buffer.
+    RC  CloseFile    (int fileId);
+    // Remove every page of a file from the buffer without writing it
+    RC  DiscardFile  (dev_t dev, ino_t ino);
+
+    // Read pageNum into buffer, point *ppBuffer to location.  A page
+    // pinned bReadOnly may be pointed to in the mapping of the file.
+    RC  GetPage      (int fileId, PageNum pageNum, char **ppBuffer,
+                      int bMultiplePins = true, int bReadOnly = false);
     // Allocate a new page in the buffer, point *ppBuffer to its location
-    RC  AllocatePage (int fd, PageNum pageNum, char **ppBuffer);
+    RC  AllocatePage (int fileId, PageNum pageNum, char **ppBuffer);
+    // Tell the OS a page that is not in the buffer will be read soon
+    RC  PrefetchPage (int fileId, PageNum pageNum);
 
-    RC  MarkDirty    (int fd, PageNum pageNum);  // Mark page dirty
-    RC  UnpinPage    (int fd, PageNum pageNum);  // Unpin page from the buffer
-    RC  FlushPages   (int fd);                   // Flush pages for file
+    RC  MarkDirty    (int fileId, PageNum pageNum);  // Mark page dirty
+    RC  UnpinPage    (int fileId, PageNum pageNum);  // Unpin page
+    // Latch the contents of a pinned page, shared or exclusive; wait
+    // for the latches of other threads that conflict
+    RC  LatchPage    (int fileId, PageNum pageNum, int bExclusive);
+    RC  UnlatchPage  (int fileId, PageNum pageNum);  // Release the latch
+    RC  FlushPages   (int fileId);                   // Flush pages for file
 
     // Force a page to the disk, but do not remove from the buffer pool
-    RC ForcePages    (int fd, PageNum pageNum);
+    RC ForcePages    (int fileId, PageNum pageNum);
 
 
     // Remove all entries from the Buffer Manager.
@@ -74,6 +194,10 @@ public:
 
     // Attempts to resize the buffer to the new size
     RC ResizeBuffer  (int iNewSize);
+    // Empty the buffer and switch to another replacement policy
+    RC SetReplacePolicy (PF_ReplacePolicy _policy);
+    // Map the files opened from now on for read-only pins
+    void SetMappedReads (int _bMappedReads);
 
     // Three Methods for manipulating raw memory buffers.  These memory
     // locations are handled by the buffer manager, but are not
@@ -92,16 +216,65 @@ private:
     RC  InsertFree   (int slot);                 // Insert slot at head of free
     RC  LinkHead     (int slot);                 // Insert slot at head of used
     RC  Unlink       (int slot);                 // Unlink slot
-    RC  InternalAlloc(int &slot);                // Get a slot to use
+    RC  InternalAlloc(int &slot, int size);      // Get a slot to use
+    RC  Unhash       (int slot);                 // Remove slot from hash table
+    RC  InternalDiscard(dev_t dev, ino_t ino);   // DiscardFile, latched
+    RC  InternalUnpin(int fileId, PageNum pageNum);  // UnpinPage, latched
+    RC  InternalClear();                         // ClearBuffer, latched
+    RC  InternalResize(int iNewSize);            // ResizeBuffer, latched
 
-    // Read a page
-    RC  ReadPage     (int fd, PageNum pageNum, char *dest);
+    // Replacement policy
+    void InitPolicy  ();                         // Reset policy state
+    void Admit       (int slot);                 // Page entered the buffer
+    void Touch       (int slot);                 // Page was used again
+    void Forget      (int slot);                 // Page left the buffer
+    RC   ChooseVictim(int &slot);                // Unpinned page to replace
+    void QueuePush   (int slot, int q);          // Insert at head of 2Q queue
+    void QueueRemove (int slot);                 // Unlink from its 2Q queue
+    void Remember    (int slot);                 // Add page to 2Q ghost list
+    int  IsSharedTouch(int slot) const;          // Touch may run with the
+                                                 // latch shared
+
+    // Read a page, touches no member so that it may run unlatched
+    RC  ReadPage     (int fd, int pageSize, PageNum pageNum, char *dest);
+    // Start reading up to numPages pages, from firstPage on, into free
+    // slots
+    void ReadAhead   (int fileId, PageNum firstPage, int numPages);
+    // Write the dirty pages of a file (of all files if fileId is
+    // ALL_FILES) through the I/O engine and wait for them
+    RC  WritePages   (int fileId, PageNum pageNum, int bPinned);
+    // Start writing dirty pages, coalescing consecutive ones
+    RC  WriteRuns    (std::vector<int> &slots, int bSyncSingle);
+    // Start writing the dirty pages that will be replaced next
+    void CleanPages  (int maxScan);
+    void SetDirty    (int slot, int bDirty);     // Set bDirty, count it
+
+    RC  SubmitIO     (int fileId, PageNum pageNum, int bWrite,
+                      const int *slots, int numSlots);
+                                                 // Read or write pages of
+                                                 // slots, from pageNum on
+    RC  FinishIO     (long tag, int result);     // Apply a finished request
+    RC  WaitIO       (int slot);                 // Wait for the read of slot,
+                                                 // or all I/O if INVALID_SLOT
+    void ReapIO      ();                         // Apply finished requests
 
     // Write a page
-    RC  WritePage    (int fd, PageNum pageNum, char *source);
+    RC  WritePage    (int fileId, PageNum pageNum, char *source);
 
     // Init the page desc entry
-    RC  InitPageDesc (int fd, PageNum pageNum, int slot);
+    RC  InitPageDesc (int fileId, PageNum pageNum, int slot);
+
+    RC  MapFile      (int fileId);               // Map a file being opened
+    RC  UnmapFile    (int fileId);               // Drop its mapped pages
+
+    // Frames
+    void MapArena    (int stride);               // Give each slot a frame
+    void UnmapArena  ();                         // Free all frames
+    RC   GrowArena   (int size);                 // Make the frames hold size
+    RC   GetFrame    (int slot, int size);       // Frame of size for slot
+    int  IsArenaFrame(int slot) const            // Is pData in the arena
+        { return arena != NULL &&
+                 bufTable[slot].pData == arena + slot * (size_t)frameStride; }
 
     PF_BufPageDesc *bufTable;                     // info on buffer pages
     PF_HashTable   hashTable;                     // Hash table object
@@ -109,6 +282,42 @@ private:
     int            first;                         // MRU page slot
     int            last;                          // LRU page slot
     int            free;                          // head of free list
+
+    PF_BufFile     *fileTable;                    // info on buffered files
+    int            numFiles;                      // # of file table entries
+
+    PF_ReplacePolicy policy;                      // replacement policy
+    int            clockHand;                     // next slot CLOCK checks
+    int            qHead[2];                      // MRU slot of 2Q queues
+    int            qTail[2];                      // LRU slot of 2Q queues
+    int            qSize[2];                      // # of pages in 2Q queues
+    PF_HashTable   *ghostTable;                   // 2Q ghost list lookup
+    PF_HashEntry   *ghostRing;                    // 2Q ghost list, FIFO
+    int            numGhosts;                     // size of ghostRing
+    int            ghostPos;                      // oldest ghost entry
+
+    PF_IOEngine    io;                            // async reads and writes
+    PF_IOBatch     batches[PF_IO_DEPTH];          // requests of io, the tag
+                                                  // is the index
+    int            freeBatches[PF_IO_DEPTH];      // unused batches
+    int            numFreeBatches;
+    int            numDirty;                      // # of dirty pages
+    int            numWriting;                    // # of pages being written
+    int            cleanMark;                     // numDirty at which to
+                                                  // write behind again
+    int            bMappedReads;                  // map files when opened
+
+    char           *arena;                        // frames, frameStride
+                                                  // bytes per slot
+    size_t         arenaSize;                     // # of bytes mapped
+    int            frameStride;                   // size of arena frames
+
+    std::shared_mutex latch;                      // guards all of the above
+    std::condition_variable_any readDone;         // a PF_IO_THREAD read is
+                                                  // done
 };
 
+// Return the buffer manager shared by all files of the process
+PF_BufferMgr *PF_GetBufferMgr();
+
 #endif
@@ -26,6 +26,13 @@ static char *PF_WarnMsg[] = {
   (char*)"page already unpinned",
   (char*)"end of file",
   (char*)"attempting to resize the buffer too small",
+  (char*)"page is pinned read-only",
+  (char*)"invalid page size",
+  (char*)"file format version is not supported",
+  (char*)"page is not latched",
+  (char*)"page is latched by another thread",
+  (char*)"page is already latched by this thread",
+  (char*)"page is pinned read-only in the file mapping",
   (char*)"invalid filename"
 };
 
@@ -9,26 +9,48 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <string>
+#include <vector>
 #include "pf.h"
 #include "pf_buffermgr.h"
 
+// Open every file for direct I/O, see PF_SetDirectIO
+static int bSharedDirectIO = false;
+
+//
+// PageStride
+//
+// Desc: Internal.  Return the # of bytes a page of pageSize bytes takes
+//       on disk in the current file format.
+//
+static int PageStride(int pageSize)
+{
+   return ((pageSize + PF_FRAME_ALIGN - 1) / PF_FRAME_ALIGN * PF_FRAME_ALIGN);
+}
 
 //
 // CreateFile
 //
 // Desc: Create a new PF file named fileName. Initialize PF_FileHeader.
 // The size of page space visiable to high level user is defined 
-// by '_pageSize'. The real page size on disk should be 
-// '_pageSize'+sizeof(PF_PageHdr) .
+// by '_pageSize'. The real page size should be 
+// '_pageSize'+sizeof(PF_PageHdr) .  On disk the pages, and the file
+// header before them, are padded to a multiple of PF_FRAME_ALIGN, so
+// that each starts on a device block and the file can be opened for
+// direct I/O.
 //
 RC PF_CreateFile    (const char *fileName, int _pageSize)
 {
    int fd;		// unix file descriptor
    int numBytes;		// return code form write syscall
 
+   if (_pageSize <= 0)
+      return (PF_BADPAGESIZE);
+
    // Create file for exclusive use
    if ((fd = open(fileName,
 #ifdef PC
@@ -39,20 +61,24 @@ RC PF_CreateFile    (const char *fileName, int _pageSize)
       return (PF_UNIX);
 
    int PAGESIZE = _pageSize + sizeof(PF_PageHdr);
-   // Initialize the file header: must reserve FileHdrSize bytes in memory
+   int STRIDE = PageStride(PAGESIZE);
+   // Initialize the file header: must reserve one page stride in memory
    // though the actual size of FileHdr is smaller
-   char hdrBuf[PAGESIZE];
+   char hdrBuf[STRIDE];
 
    // So that Purify doesn't complain
-   memset(hdrBuf, 0, PAGESIZE);
+   memset(hdrBuf, 0, STRIDE);
 
    PF_FileHdr *hdr = (PF_FileHdr*)hdrBuf;
    hdr->firstFree = PF_PAGE_LIST_END;
    hdr->numPages = 0;
    hdr->pageSize = PAGESIZE;
+   hdr->magic = PF_FILE_MAGIC;
+   hdr->version = PF_FILE_VERSION;
+   hdr->pageStride = STRIDE;
 
    // Write header to file
-   if((numBytes = write(fd, hdrBuf, PAGESIZE)) != PAGESIZE) 
+   if((numBytes = write(fd, hdrBuf, STRIDE)) != STRIDE) 
    {
       // Error while writing: close and remove file
       close(fd);
@@ -83,6 +109,13 @@ RC PF_CreateFile    (const char *fileName, int _pageSize)
 //
 RC PF_DestroyFile   (const char *fileName)
 {
+   struct stat st;
+
+   // Drop the pages the shared buffer still caches for the file, a new
+   // file may get the same inode
+   if (stat(fileName, &st) == 0)
+      PF_GetBufferMgr()->DiscardFile(st.st_dev, st.st_ino);
+
    // Remove the file
    if (unlink(fileName) < 0)
       return (PF_UNIX);
@@ -92,6 +125,145 @@ RC PF_DestroyFile   (const char *fileName)
 }
 
 
+//
+// UpgradeFile
+//
+// Desc: Convert a PF file named fileName to the current file format
+//       (fileName must exist and not be open).  A version 1 file whose
+//       pages are aligned already only gets a new header.  Otherwise
+//       its pages are copied, padded to their stride, into a new file
+//       that then takes the place of the old one, so that the old file
+//       is left whole if the upgrade fails.
+// In:   fileName - name of file to upgrade
+// Ret:  PF_BADVERSION if the file is not a PF file of a known version,
+//       other PF return code
+//
+RC PF_UpgradeFile   (const char *fileName)
+{
+   PF_FileHdr hdr;
+   struct stat st;
+   int fd, tmpfd = -1;
+   int bTmpFile = false;           // tmpName was created here
+   int numBytes;
+   RC rc = 0;
+   std::string tmpName = std::string(fileName) + ".upgrade";
+
+   if ((fd = open(fileName,
+#ifdef PC
+         O_BINARY |
+#endif
+         O_RDWR)) < 0)
+      return (PF_UNIX);
+   if (fstat(fd, &st) < 0) {
+      rc = PF_UNIX;
+      goto done;
+   }
+
+   // Read the file header
+   numBytes = read(fd, (char *)&hdr, sizeof(PF_FileHdr));
+   if (numBytes != sizeof(PF_FileHdr)) {
+      rc = (numBytes < 0) ? PF_UNIX : PF_HDRREAD;
+      goto done;
+   }
+
+   // Nothing to do for a file of the current version
+   if (hdr.magic == PF_FILE_MAGIC) {
+      rc = (hdr.version == PF_FILE_VERSION) ? 0 : PF_BADVERSION;
+      goto done;
+   }
+
+   // A version 1 file is its header and pages, pageSize bytes each
+   if (hdr.magic != 0 || hdr.pageSize <= (int)sizeof(PF_PageHdr) ||
+         hdr.numPages < 0 ||
+         st.st_size != (hdr.numPages + 1) * (off_t)hdr.pageSize) {
+      rc = PF_BADVERSION;
+      goto done;
+   }
+
+   // Pages cached in the old format must not be used again
+   PF_GetBufferMgr()->DiscardFile(st.st_dev, st.st_ino);
+
+   hdr.magic = PF_FILE_MAGIC;
+   hdr.version = PF_FILE_VERSION;
+   hdr.pageStride = PageStride(hdr.pageSize);
+
+   if (hdr.pageStride == hdr.pageSize) {
+      // The layout is the same, the header has room for the new fields
+      numBytes = pwrite(fd, (char *)&hdr, sizeof(PF_FileHdr), 0);
+      if (numBytes != sizeof(PF_FileHdr))
+         rc = (numBytes < 0) ? PF_UNIX : PF_HDRWRITE;
+      else if (fsync(fd) < 0)
+         rc = PF_UNIX;
+      goto done;
+   }
+
+   if ((tmpfd = open(tmpName.c_str(),
+#ifdef PC
+         O_BINARY |
+#endif
+         O_CREAT | O_EXCL | O_WRONLY,
+         CREATION_MASK)) < 0) {
+      rc = PF_UNIX;
+      goto done;
+   }
+   bTmpFile = true;
+
+   {
+      // Write the header, then each page at its new place
+      std::vector<char> buf(hdr.pageStride, 0);
+      memcpy(&buf[0], &hdr, sizeof(PF_FileHdr));
+      for (PageNum pageNum = -1; pageNum < hdr.numPages; pageNum++) {
+         if (pageNum >= 0) {
+            memset(&buf[0], 0, hdr.pageStride);
+            numBytes = pread(fd, &buf[0], hdr.pageSize,
+                             (pageNum + 1) * (off_t)hdr.pageSize);
+            if (numBytes != hdr.pageSize) {
+               rc = (numBytes < 0) ? PF_UNIX : PF_INCOMPLETEREAD;
+               goto done;
+            }
+         }
+         numBytes = write(tmpfd, &buf[0], hdr.pageStride);
+         if (numBytes != hdr.pageStride) {
+            rc = (numBytes < 0) ? PF_UNIX : PF_INCOMPLETEWRITE;
+            goto done;
+         }
+      }
+   }
+
+   if (fsync(tmpfd) < 0 || close(tmpfd) < 0) {
+      tmpfd = -1;
+      rc = PF_UNIX;
+      goto done;
+   }
+   tmpfd = -1;
+   if (rename(tmpName.c_str(), fileName) < 0) {
+      rc = PF_UNIX;
+      goto done;
+   }
+
+done:
+   if (tmpfd >= 0)
+      close(tmpfd);
+   if (rc && bTmpFile)
+      unlink(tmpName.c_str());
+   close(fd);
+   return (rc);
+}
+
+
+//
+// PF_SetDirectIO
+//
+// Desc: Turn direct I/O on or off for the files opened from now on.
+//       Files already open keep the way they were opened.
+// In:   bDirectIO - open the files for direct I/O
+//
+void PF_SetDirectIO(int bDirectIO)
+{
+   bSharedDirectIO = bDirectIO;
+}
+
+
 //
 // PF_FileHandle
 //
@@ -101,15 +273,16 @@ RC PF_DestroyFile   (const char *fileName)
 //       It is constructed here but must be passed to PF_Manager::OpenFile() in
 //       order to be used to access the pages of a file.
 //       It should be passed to PF_Manager::CloseFile() to close the file.
-//       A file handle object contains a pointer to the file data stored
-//       in the file table managed by PF_Manager.  It passes the file's unix
-//       file descriptor to the buffer manager to access pages of the file.
+//       A file handle object contains a pointer to the buffer manager
+//       shared by all open files.  It passes the buffer file id of the
+//       file to the buffer manager to access pages of the file.
 //
 PF_FileHandle::PF_FileHandle()
 {
    // Initialize local variables
    bFileOpen = false;
    pBufferMgr = NULL;
+   bDirect = false;
 }
 
 //
@@ -138,6 +311,8 @@ PF_FileHandle::PF_FileHandle(const PF_FileHandle &fileHandle)
    this->bFileOpen   = fileHandle.bFileOpen;
    this->bHdrChanged = fileHandle.bHdrChanged;
    this->unixfd      = fileHandle.unixfd;
+   this->fileId      = fileHandle.fileId;
+   this->bDirect     = fileHandle.bDirect;
 }
 
 //
@@ -160,6 +335,8 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
       this->bFileOpen   = fileHandle.bFileOpen;
       this->bHdrChanged = fileHandle.bHdrChanged;
       this->unixfd      = fileHandle.unixfd;
+      this->fileId      = fileHandle.fileId;
+      this->bDirect     = fileHandle.bDirect;
    }
 
    // Return a reference to this
@@ -170,17 +347,25 @@ PF_FileHandle& PF_FileHandle::operator= (const PF_FileHandle &fileHandle)
 //
 // OpenFile
 //
-// Desc: Open the paged file whose name is "fileName".  It is possible to open
-//       a file more than once, however, it will be treated as 2 separate files
-//       (different file descriptors; different buffers).  Thus, opening a file
+// Desc: Open the paged file whose name is "fileName".  Pages of the file
+//       that are still in the shared buffer from an earlier open are
+//       reused.  It is possible to open a file more than once at the same
+//       time, however, it will be treated as 2 separate files (different
+//       file descriptors; different buffer file ids).  Thus, opening a file
 //       more than once for writing may corrupt the file, and can, in certain
 //       circumstances, crash the PF layer. Note that even if only one instance
 //       of a file is for writing, problems may occur because some writes may
 //       not be seen by a reader of another instance of the file.
+//       Files of version 1 of the file format are read and written in
+//       that format.  With direct I/O the pages bypass the OS page cache, so that the
+//       buffer pool is their only copy in memory.  The file is opened
+//       as usual if its pages are not aligned for that or the OS does
+//       not allow it.
 // In:   fileName - name of file to open
+//       bDirect - open the file for direct I/O
 // Ret:  PF_FILEOPEN or other PF return code
 //
-RC PF_FileHandle::OpenFile(const char *fileName)
+RC PF_FileHandle::OpenFile(const char *fileName, int bDirect)
 {
    RC rc = 0;
 
@@ -205,10 +390,33 @@ RC PF_FileHandle::OpenFile(const char *fileName)
       }
    }
 
+   // Version 1 files have zeros after the header
+   if ((hdr.magic == PF_FILE_MAGIC) ? hdr.version > PF_FILE_VERSION
+                                    : hdr.magic != 0) {
+      rc = PF_BADVERSION;
+      goto err;
+   }
+
    // Set file header to be not changed
    bHdrChanged = false;
 
-   pBufferMgr = new PF_BufferMgr(PF_BUFFER_SIZE, hdr.pageSize);
+   // The header is read as usual, it tells whether the pages are aligned
+   this->bDirect = false;
+#ifdef O_DIRECT
+   if ((bDirect || bSharedDirectIO) &&
+         GetPageStride() % PF_FRAME_ALIGN == 0) {
+      int flags = fcntl(unixfd, F_GETFL);
+      if (flags >= 0 && fcntl(unixfd, F_SETFL, flags | O_DIRECT) == 0)
+         this->bDirect = true;
+   }
+#endif
+
+   // Register the file with the shared buffer
+   pBufferMgr = PF_GetBufferMgr();
+   if ((rc = pBufferMgr->OpenFile(unixfd, GetPageStride(), fileId))) {
+      pBufferMgr = NULL;
+      goto err;
+   }
    bFileOpen = true;
 
    // Return ok
@@ -228,7 +436,8 @@ err:
 //
 // Desc: Close file associated with fileHandle
 //       The file should have been opened with OpenFile().
-//       Also, flush all pages for the file from the page buffer
+//       Also, write all dirty pages for the file to disk.  Clean pages
+//       stay in the shared buffer for the next OpenFile of the file.
 //       It is an error to close a file with pages still fixed in the buffer.
 // Ret:  PF return code
 //
@@ -240,8 +449,10 @@ RC PF_FileHandle::CloseFile()
    if (!bFileOpen)
       return (PF_CLOSEDFILE);
 
-   // Flush all buffers for this file and write out the header
-   if ((rc = this->FlushPages()))
+   // Write out the header and the dirty pages, then detach the file
+   // from the buffer
+   if ((rc = this->ForcePages()) ||
+         (rc = pBufferMgr->CloseFile(fileId)))
       return (rc);
 
    // Close the file
@@ -250,7 +461,6 @@ RC PF_FileHandle::CloseFile()
    bFileOpen = false;
 
    // Reset the buffer manager pointer in the file handle
-   delete pBufferMgr;
    pBufferMgr = NULL;
 
    // Return ok
@@ -336,13 +546,14 @@ RC PF_FileHandle::DisposeBlock(char *buffer)
 //
 // Desc: Get the first page in a file
 //       The file handle must refer to an open file
+// In:   bReadOnly - the page will not be changed
 // Out:  pageHandle - becomes a handle to the first page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle, int bReadOnly) const
 {
-   return (GetNextPage((PageNum)-1, pageHandle));
+   return (GetNextPage((PageNum)-1, pageHandle, bReadOnly));
 }
 
 //
@@ -350,13 +561,14 @@ RC PF_FileHandle::GetFirstPage(PF_PageHandle &pageHandle) const
 //
 // Desc: Get the last page in a file
 //       The file handle must refer to an open file
+// In:   bReadOnly - the page will not be changed
 // Out:  pageHandle - becomes a handle to the last page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle, int bReadOnly) const
 {
-   return (GetPrevPage((PageNum)hdr.numPages, pageHandle));
+   return (GetPrevPage((PageNum)hdr.numPages, pageHandle, bReadOnly));
 }
 
 //
@@ -366,11 +578,13 @@ RC PF_FileHandle::GetLastPage(PF_PageHandle &pageHandle) const
 //       The file handle must refer to an open file
 // In:   current - get the next valid page after this page number
 //       current can refer to a page that has been disposed
+//       bReadOnly - the page will not be changed
 // Out:  pageHandle - becomes a handle to the next page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF_EOF, or another PF return code
 //
-RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle,
+      int bReadOnly) const
 {
    int rc;               // return code
 
@@ -386,7 +600,7 @@ RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
    for (current++; current < hdr.numPages; current++) {
 
       // If this is a valid (used) page, we're done
-      if (!(rc = GetThisPage(current, pageHandle)))
+      if (!(rc = GetThisPage(current, pageHandle, bReadOnly)))
          return (0);
 
       // If unexpected error, return it
@@ -405,11 +619,13 @@ RC PF_FileHandle::GetNextPage(PageNum current, PF_PageHandle &pageHandle) const
 //       The file handle must refer to an open file
 // In:   current - get the prev valid page before this page number
 //       current can refer to a page that has been disposed
+//       bReadOnly - the page will not be changed
 // Out:  pageHandle - becomes a handle to the prev page of the file
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF_EOF, or another PF return code
 //
-RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle,
+      int bReadOnly) const
 {
    int rc;               // return code
 
@@ -425,7 +641,7 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
    for (current--; current >= 0; current--) {
 
       // If this is a valid (used) page, we're done
-      if (!(rc = GetThisPage(current, pageHandle)))
+      if (!(rc = GetThisPage(current, pageHandle, bReadOnly)))
          return (0);
 
       // If unexpected error, return it
@@ -443,12 +659,15 @@ RC PF_FileHandle::GetPrevPage(PageNum current, PF_PageHandle &pageHandle) const
 // Desc: Get a specific page in a file
 //       The file handle must refer to an open file
 // In:   pageNum - the number of the page to get
+//       bReadOnly - the page will not be changed, so it may be used in
+//                   place in the mapping of the file
 // Out:  pageHandle - becomes a handle to the this page of the file
 //                    this function modifies local var's in pageHandle
 //       The referenced page is pinned in the buffer pool.
 // Ret:  PF return code
 //
-RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
+RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle,
+      int bReadOnly) const
 {
    int  rc;               // return code
    char *pPageBuf;        // address of page in buffer pool
@@ -462,7 +681,8 @@ RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
       return (PF_INVALIDPAGE);
 
    // Get this page from the buffer manager
-   if ((rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf)))
+   if ((rc = pBufferMgr->GetPage(fileId, pageNum, &pPageBuf, true,
+         bReadOnly)))
       return (rc);
 
    // If the page is valid, then set pageHandle to this page and return ok
@@ -507,7 +727,7 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
       pageNum = hdr.firstFree;
 
       // Get the first free page into the buffer
-      if ((rc = pBufferMgr->GetPage(unixfd,
+      if ((rc = pBufferMgr->GetPage(fileId,
             pageNum,
             &pPageBuf)))
          return (rc);
@@ -521,7 +741,7 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
       pageNum = hdr.numPages;
 
       // Allocate a new page in the file
-      if ((rc = pBufferMgr->AllocatePage(unixfd,
+      if ((rc = pBufferMgr->AllocatePage(fileId,
             pageNum,
             &pPageBuf)))
          return (rc);
@@ -536,8 +756,8 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
    // Mark this page as used
    ((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_USED;
 
-   // Zero out the page data
-   memset(pPageBuf + sizeof(PF_PageHdr), 0, hdr.pageSize - sizeof(PF_PageHdr));
+   // Zero out the page data, and the padding after it
+   memset(pPageBuf + sizeof(PF_PageHdr), 0, GetPageStride() - sizeof(PF_PageHdr));
 
    // Mark the page dirty because we changed the next pointer
    if ((rc = MarkDirty(pageNum)))
@@ -575,7 +795,7 @@ RC PF_FileHandle::DisposePage(PageNum pageNum)
       return (PF_INVALIDPAGE);
 
    // Get the page (but don't re-pin it if it's already pinned)
-   if ((rc = pBufferMgr->GetPage(unixfd,
+   if ((rc = pBufferMgr->GetPage(fileId,
          pageNum,
          &pPageBuf,
          false)))
@@ -630,7 +850,7 @@ RC PF_FileHandle::MarkDirty(PageNum pageNum) const
       return (PF_INVALIDPAGE);
 
    // Tell the buffer manager to mark the page dirty
-   return (pBufferMgr->MarkDirty(unixfd, pageNum));
+   return (pBufferMgr->MarkDirty(fileId, pageNum));
 }
 
 //
@@ -655,7 +875,80 @@ RC PF_FileHandle::UnpinPage(PageNum pageNum) const
       return (PF_INVALIDPAGE);
 
    // Tell the buffer manager to unpin the page
-   return (pBufferMgr->UnpinPage(unixfd, pageNum));
+   return (pBufferMgr->UnpinPage(fileId, pageNum));
+}
+
+//
+// LatchPage
+//
+// Desc: Latch a page pinned by the caller, to read it (shared) or to
+//       change it (exclusive) while other threads have it pinned too.
+//       Waits for the latches of other threads that conflict.  A thread
+//       can not latch a page it already holds latched.
+//       The file handle must refer to an open file.
+// In:   pageNum - number of the page to latch
+//       bExclusive - latch the page to change it
+// Ret:  PF_LATCHHELD if the calling thread holds the latch already,
+//       other PF return code
+//
+RC PF_FileHandle::LatchPage(PageNum pageNum, int bExclusive) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   // Tell the buffer manager to latch the page
+   return (pBufferMgr->LatchPage(fileId, pageNum, bExclusive));
+}
+
+//
+// UnlatchPage
+//
+// Desc: Release the latch the calling thread took by LatchPage.  The
+//       page stays pinned.  The file handle must refer to an open file.
+// In:   pageNum - number of the page to unlatch
+// Ret:  PF_LATCHNOTHELD if only other threads hold the latch, other PF
+//       return code
+//
+RC PF_FileHandle::UnlatchPage(PageNum pageNum) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   // Tell the buffer manager to unlatch the page
+   return (pBufferMgr->UnlatchPage(fileId, pageNum));
+}
+
+//
+// PrefetchPage
+//
+// Desc: Hint that a page will be read soon, so that the OS reads it
+//       in the background.  The page is not pinned or brought into the
+//       buffer pool.
+//       The file handle must refer to an open file.
+// In:   pageNum - number of the page
+// Ret:  PF return code
+//
+RC PF_FileHandle::PrefetchPage(PageNum pageNum) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   return (pBufferMgr->PrefetchPage(fileId, pageNum));
 }
 
 //
@@ -674,28 +967,13 @@ RC PF_FileHandle::FlushPages() const
 
    // If the file header has changed, write it back to the file
    if (bHdrChanged) {
-
-      // First seek to the appropriate place
-      if (lseek(unixfd, 0, L_SET) < 0)
-         return (PF_UNIX);
-
-      // Write header
-      int numBytes = write(unixfd,
-            (char *)&hdr,
-            sizeof(PF_FileHdr));
-      if (numBytes < 0)
-         return (PF_UNIX);
-      if (numBytes != sizeof(PF_FileHdr))
-         return (PF_HDRWRITE);
-
-      // This function is declared const, but we need to change the
-      // bHdrChanged variable.  Cast away the constness
-      PF_FileHandle *dummy = (PF_FileHandle *)this;
-      dummy->bHdrChanged = false;
+      RC rc = WriteHdr();
+      if (rc)
+         return (rc);
    }
 
    // Tell Buffer Manager to flush pages
-   return (pBufferMgr->FlushPages(unixfd));
+   return (pBufferMgr->FlushPages(fileId));
 }
 
 //
@@ -716,28 +994,13 @@ RC PF_FileHandle::ForcePages(PageNum pageNum) const
 
    // If the file header has changed, write it back to the file
    if (bHdrChanged) {
-
-      // First seek to the appropriate place
-      if (lseek(unixfd, 0, L_SET) < 0)
-         return (PF_UNIX);
-
-      // Write header
-      int numBytes = write(unixfd,
-            (char *)&hdr,
-            sizeof(PF_FileHdr));
-      if (numBytes < 0)
-         return (PF_UNIX);
-      if (numBytes != sizeof(PF_FileHdr))
-         return (PF_HDRWRITE);
-
-      // This function is declared const, but we need to change the
-      // bHdrChanged variable.  Cast away the constness
-      PF_FileHandle *dummy = (PF_FileHandle *)this;
-      dummy->bHdrChanged = false;
+      RC rc = WriteHdr();
+      if (rc)
+         return (rc);
    }
 
    // Tell Buffer Manager to Force the page
-   return (pBufferMgr->ForcePages(unixfd, pageNum));
+   return (pBufferMgr->ForcePages(fileId, pageNum));
 }
 
 
@@ -765,3 +1028,55 @@ int PF_FileHandle::IsValidPageNum(PageNum pageNum) const
          pageNum < hdr.numPages);
 }
 
+
+//
+// GetPageStride
+//
+// Desc: Internal.  Return the # of bytes a page takes on disk, which is
+//       the page size itself in version 1 files.
+//
+int PF_FileHandle::GetPageStride() const
+{
+   return (hdr.magic == PF_FILE_MAGIC ? hdr.pageStride : hdr.pageSize);
+}
+
+
+
+//
+// WriteHdr
+//
+// Desc: Internal.  Write the file header back to the file.  Direct I/O
+//       only moves whole aligned pages, so the header page is then
+//       written from an aligned copy, padded with zeros as
+//       PF_CreateFile wrote it.
+// Ret:  PF return code
+//
+RC PF_FileHandle::WriteHdr() const
+{
+   char *pHdr = (char *)&hdr;
+   int  hdrSize = sizeof(PF_FileHdr);
+   void *pPage = NULL;
+
+   if (bDirect) {
+      hdrSize = GetPageStride();
+      if (posix_memalign(&pPage, PF_FRAME_ALIGN, hdrSize))
+         return (PF_NOMEM);
+      memset(pPage, 0, hdrSize);
+      memcpy(pPage, &hdr, sizeof(PF_FileHdr));
+      pHdr = (char *)pPage;
+   }
+
+   // Write header at the start of the file
+   int numBytes = pwrite(unixfd, pHdr, hdrSize, 0);
+   free(pPage);
+   if (numBytes < 0)
+      return (PF_UNIX);
+   if (numBytes != hdrSize)
+      return (PF_HDRWRITE);
+
+   // This function is declared const, but we need to change the
+   // bHdrChanged variable.  Cast away the constness
+   PF_FileHandle *dummy = (PF_FileHandle *)this;
+   dummy->bHdrChanged = false;
+   return (0);
+}
@@ -15,19 +15,21 @@
 //
 // Desc: Constructor for PF_HashTable object, which allows search, insert,
 //       and delete of hash table entries.
-// In:   numBuckets - number of hash table buckets
+// In:   numEntries - number of entries expected, the table grows past it
 //
-PF_HashTable::PF_HashTable(int _numBuckets)
+PF_HashTable::PF_HashTable(int _numEntries)
 {
-  // Initialize numBuckets local variable from parameter
-  this->numBuckets = _numBuckets;
-
-  // Allocate memory for hash table
-  hashTable = new PF_HashEntry* [numBuckets];
-
-  // Initialize all buckets to empty
-  for (int i = 0; i < numBuckets; i++)
-    hashTable[i] = NULL;
+  // Size the table to a power of two at most half full with numEntries
+  int size = 1;
+  while (size < 2 * _numEntries || size < PF_HASH_TBL_SIZE)
+    size <<= 1;
+  this->mask = size - 1;
+  this->numEntries = 0;
+
+  // Allocate memory for hash table, all entries empty
+  hashTable = new PF_HashEntry[size];
+  for (int i = 0; i < size; i++)
+    hashTable[i].slot = -1;
 }
 
 //
@@ -37,20 +39,52 @@ PF_HashTable::PF_HashTable(int _numBuckets)
 //
 PF_HashTable::~PF_HashTable()
 {
-  // Clear out all buckets
-  for (int i = 0; i < numBuckets; i++) {
-
-    // Delete all entries in the bucket
-    PF_HashEntry *entry = hashTable[i];
-    while (entry != NULL) {
-      PF_HashEntry *next = entry->next;
-      delete entry;
-      entry = next;
-    }
+  delete[] hashTable;
+}
+
+//
+// Probe
+//
+// Desc: Walk the probe sequence of fd and pageNum
+// In:   fd - file descriptor
+//       pageNum - page number
+// Ret:  position of the entry for fd and pageNum if present, otherwise
+//       position of the empty entry where it would be inserted
+//
+int PF_HashTable::Probe(int fd, PageNum pageNum) const
+{
+  int i = Hash(fd, pageNum);
+  while (hashTable[i].slot != -1 &&
+         (hashTable[i].fd != fd || hashTable[i].pageNum != pageNum))
+    i = (i + 1) & mask;
+  return (i);
+}
+
+//
+// Grow
+//
+// Desc: Double the size of the table and re-insert every entry
+// Ret:  PF return code
+//
+RC PF_HashTable::Grow()
+{
+  PF_HashEntry *old = hashTable;
+  int oldSize = mask + 1;
+
+  if ((hashTable = new PF_HashEntry[2 * oldSize]) == NULL) {
+    hashTable = old;
+    return (PF_NOMEM);
   }
+  mask = 2 * oldSize - 1;
+  for (int i = 0; i <= mask; i++)
+    hashTable[i].slot = -1;
 
-  // Finally delete the hash table
-  delete[] hashTable;
+  for (int i = 0; i < oldSize; i++) {
+    if (old[i].slot != -1)
+      hashTable[Probe(old[i].fd, old[i].pageNum)] = old[i];
+  }
+  delete[] old;
+  return (0);
 }
 
 //
@@ -64,25 +98,12 @@ PF_HashTable::~PF_HashTable()
 //
 RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  if (bucket<0)
-     return (PF_HASHNOTFOUND);
-
-  // Go through the linked list of this bucket
-  for (PF_HashEntry *entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum) {
-      // Found it
-      slot = entry->slot;
-      return (0);
-    }
-  }
+  int i = Probe(fd, pageNum);
+  if (hashTable[i].slot == -1)
+    return (PF_HASHNOTFOUND);
 
-  // Didn't find it
-  return (PF_HASHNOTFOUND);
+  slot = hashTable[i].slot;
+  return (0);
 }
 
 //
@@ -96,31 +117,24 @@ RC PF_HashTable::Find(int fd, PageNum pageNum, int &slot)
 //
 RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  // Check entry doesn't already exist in the bucket
-  PF_HashEntry *entry;
-  for (entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum)
-      return (PF_HASHPAGEEXIST);
+  RC rc;
+
+  // Check entry doesn't already exist
+  int i = Probe(fd, pageNum);
+  if (hashTable[i].slot != -1)
+    return (PF_HASHPAGEEXIST);
+
+  // Keep the table at most 3/4 full so probe sequences stay short
+  if (4 * (numEntries + 1) > 3 * (mask + 1)) {
+    if ((rc = Grow()))
+      return (rc);
+    i = Probe(fd, pageNum);
   }
 
-  // Allocate memory for new hash entry
-  if ((entry = new PF_HashEntry) == NULL)
-    return (PF_NOMEM);
-
-  // Insert entry at head of list for this bucket
-  entry->fd = fd;
-  entry->pageNum = pageNum;
-  entry->slot = slot;
-  entry->next = hashTable[bucket];
-  entry->prev = NULL;
-  if (hashTable[bucket] != NULL)
-    hashTable[bucket]->prev = entry;
-  hashTable[bucket] = entry;
+  hashTable[i].fd = fd;
+  hashTable[i].pageNum = pageNum;
+  hashTable[i].slot = slot;
+  numEntries++;
 
   // Return ok
   return (0);
@@ -136,33 +150,28 @@ RC PF_HashTable::Insert(int fd, PageNum pageNum, int slot)
 //
 RC PF_HashTable::Delete(int fd, PageNum pageNum)
 {
-  // Get which bucket it should be in
-  int bucket = Hash(fd, pageNum);
-
-  // Find the entry is in this bucket
-  PF_HashEntry *entry;
-  for (entry = hashTable[bucket];
-       entry != NULL;
-       entry = entry->next) {
-    if (entry->fd == fd && entry->pageNum == pageNum)
-      break;
-  }
-
   // Did we find hash entry?
-  if (entry == NULL)
+  int i = Probe(fd, pageNum);
+  if (hashTable[i].slot == -1)
     return (PF_HASHNOTFOUND);
 
-  // Remove this entry
-  if (entry == hashTable[bucket])
-    hashTable[bucket] = entry->next;
-  if (entry->prev != NULL)
-    entry->prev->next = entry->next;
-  if (entry->next != NULL)
-    entry->next->prev = entry->prev;
-  delete entry;
+  // Shift back the entries of the probe run after i whose home position
+  // does not lie in (i, j], so that no lookup passes an empty entry
+  // before reaching its key.  No tombstones are needed.
+  int j = i;
+  while (1) {
+    j = (j + 1) & mask;
+    if (hashTable[j].slot == -1)
+      break;
+    int home = Hash(hashTable[j].fd, hashTable[j].pageNum);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      hashTable[i] = hashTable[j];
+      i = j;
+    }
+  }
+  hashTable[i].slot = -1;
+  numEntries--;
 
-  // Return ook
+  // Return ok
   return (0);
 }
-
-
@@ -4,22 +4,25 @@
 // Authors:     Hugo Rivero (rivero@cs.stanford.edu)
 //              Dallan Quass (quass@cs.stanford.edu)
 //
+// 2021: The chained buckets are replaced by open addressing with linear
+// probing.  Entries live inline in one array that doubles when it is
+// 3/4 full, so neither Insert nor Delete allocates memory.
+//
 
 #ifndef PF_HASHTABLE_H
 #define PF_HASHTABLE_H
 
+#include <stdint.h>
 #include "wsql.h"
 #include "pf.h"
 
 //
-// HashEntry - Hash table bucket entries
+// HashEntry - Hash table entries
 //
 struct PF_HashEntry {
-    PF_HashEntry *next;   // next hash table element or NULL
-    PF_HashEntry *prev;   // prev hash table element or NULL
     int          fd;      // file descriptor
     PageNum      pageNum; // page number
-    int          slot;    // slot of this page in the buffer
+    int          slot;    // slot of this page in the buffer, -1 if empty
 };
 
 //
@@ -27,7 +30,7 @@ struct PF_HashEntry {
 //
 class PF_HashTable {
 public:
-    PF_HashTable (int numBuckets);           // Constructor
+    PF_HashTable (int numEntries);           // Constructor
     ~PF_HashTable();                         // Destructor
     RC  Find     (int fd, PageNum pageNum, int &slot);
                                              // Set slot to the hash table
@@ -37,10 +40,25 @@ public:
     RC  Delete   (int fd, PageNum pageNum);  // Delete a hash table entry
 
 private:
-    int Hash     (int fd, PageNum pageNum) const
-      { return ((fd + pageNum) % numBuckets); }   // Hash function
-    int numBuckets;                               // Number of hash table buckets
-    PF_HashEntry **hashTable;                     // Hash table
+    int Hash     (int fd, PageNum pageNum) const    // Hash function
+      {
+        // mix the 64-bit key (fd, pageNum) with the murmur3 finalizer
+        uint64_t k = ((uint64_t)(uint32_t)fd << 32) | (uint32_t)pageNum;
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return (int)(k & mask);
+      }
+    int Probe    (int fd, PageNum pageNum) const;  // Position of the entry
+                                                   // or of the empty entry
+                                                   // ending its probe
+    RC  Grow     ();                               // Double the table
+
+    int numEntries;                               // Number of used entries
+    int mask;                                     // Table size - 1
+    PF_HashEntry *hashTable;                      // Hash table
 };
 
 #endif
@@ -0,0 +1,330 @@
+//
+// File:        pf_io.cc
+// Description: PF_IOEngine class implementation
+// Authors:     Haris Wang (dynmiw@gmail.com)
+//
+// The io_uring backend talks to the kernel through the raw system calls
+// and the mapped rings, so no library beyond the kernel headers is
+// needed.  Requests are IORING_OP_READV and IORING_OP_WRITEV, which
+// every kernel with io_uring has.
+//
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "pf_io.h"
+
+#ifdef PF_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+using namespace std;
+
+//
+// PF_IOEngine
+//
+// Desc: Constructor.  Sets up io_uring if it can, the worker threads are
+//       only started when the first request is submitted without it.
+// In:   _depth - max number of requests pending at once
+//
+PF_IOEngine::PF_IOEngine(int _depth)
+{
+   depth = _depth;
+   numPending = 0;
+   numQueued = 0;
+   ringFd = -1;
+   reqs = NULL;
+   sqRing = cqRing = NULL;
+   sqes = NULL;
+   bStop = false;
+
+#ifdef PF_IO_URING
+   if (SetupURing())
+      CloseURing();
+   else {
+      reqs = new PF_IORequest[depth];
+      for (int i = depth - 1; i >= 0; i--)
+         freeReqs.push_back(i);
+   }
+#endif
+}
+
+//
+// ~PF_IOEngine
+//
+// Desc: Destructor.  Waits for the pending requests, stops the workers.
+//
+PF_IOEngine::~PF_IOEngine()
+{
+   long tag;
+   int result;
+   while (Complete(tag, result, true))
+      ;
+
+   {
+      lock_guard<mutex> guard(lock);
+      bStop = true;
+   }
+   todoReady.notify_all();
+   for (size_t i = 0; i < workers.size(); i++)
+      workers[i].join();
+
+   CloseURing();
+   delete [] reqs;
+}
+
+//
+// Submit
+//
+// Desc: Queue a read or write of consecutive pages.  The caller must not
+//       touch the pages until Complete gives back tag.
+// In:   fd - OS file descriptor
+//       bWrite - write the pages rather than read into them
+//       iov, numIov - the pages, at most PF_IO_MAXVEC; iov is copied
+//       offset - offset of the first page in the file
+//       tag - identifies the request for Complete
+// Ret:  PF_NOBUF if depth requests are pending, PF return code otherwise
+//
+RC PF_IOEngine::Submit(int fd, int bWrite, const struct iovec *iov,
+      int numIov, off_t offset, long tag)
+{
+   if (numPending == depth)
+      return (PF_NOBUF);
+
+   PF_IORequest req;
+   req.fd = fd;
+   req.bWrite = bWrite;
+   memcpy(req.iov, iov, numIov * sizeof(struct iovec));
+   req.numIov = numIov;
+   req.offset = offset;
+   req.tag = tag;
+   req.result = 0;
+
+#ifdef PF_IO_URING
+   if (ringFd >= 0) {
+      int r = freeReqs.back();
+      freeReqs.pop_back();
+      reqs[r] = req;
+
+      unsigned tail = *sqTail;
+      unsigned index = tail & *sqMask;
+      io_uring_sqe *sqe = &sqes[index];
+
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = bWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = fd;
+      sqe->addr = (unsigned long)reqs[r].iov;
+      sqe->len = numIov;
+      sqe->off = offset;
+      sqe->user_data = r;
+      sqArray[index] = index;
+
+      // The kernel must see the entry before the new tail
+      __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+      numQueued++;
+      numPending++;
+      return (0);
+   }
+#endif
+
+   // Start the workers the first time they are needed
+   if (workers.empty())
+      for (int i = 0; i < PF_IO_THREADS; i++)
+         workers.push_back(thread(&PF_IOEngine::Work, this));
+
+   {
+      lock_guard<mutex> guard(lock);
+      todo.push_back(req);
+   }
+   todoReady.notify_one();
+   numPending++;
+   return (0);
+}
+
+//
+// Start
+//
+// Desc: Hand the queued requests to the OS.  The worker threads pick up
+//       requests as they are submitted, so only io_uring needs this.
+// Ret:  PF_UNIX if the kernel refused the requests
+//
+RC PF_IOEngine::Start()
+{
+#ifdef PF_IO_URING
+   while (ringFd >= 0 && numQueued > 0) {
+      int n = syscall(__NR_io_uring_enter, ringFd, numQueued, 0, 0, NULL, 0);
+      if (n < 0) {
+         if (errno == EINTR || errno == EAGAIN)
+            continue;
+         return (PF_UNIX);
+      }
+      numQueued -= n;
+   }
+#endif
+   return (0);
+}
+
+//
+// Complete
+//
+// Desc: Get a finished request, waiting for one if bWait is true.
+// In:   bWait - wait if no request is finished yet
+// Out:  tag - tag of the request
+//       result - bytes transferred, or -errno
+// Ret:  false if no request is finished, or none is pending
+//
+bool PF_IOEngine::Complete(long &tag, int &result, int bWait)
+{
+   if (numPending == 0)
+      return (false);
+
+#ifdef PF_IO_URING
+   if (ringFd >= 0) {
+      Start();
+      while (1) {
+         unsigned head = *cqHead;
+         if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe *cqe = &cqes[head & *cqMask];
+            int r = (int)cqe->user_data;
+            tag = reqs[r].tag;
+            result = cqe->res;
+            freeReqs.push_back(r);
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            numPending--;
+            return (true);
+         }
+         if (!bWait)
+            return (false);
+         if (syscall(__NR_io_uring_enter, ringFd, 0, 1,
+               IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+            // The ring is unusable; report the request as failed
+            tag = -1;
+            result = -errno;
+            return (false);
+         }
+      }
+   }
+#endif
+
+   unique_lock<mutex> guard(lock);
+   if (bWait)
+      doneReady.wait(guard, [this] { return !done.empty(); });
+   if (done.empty())
+      return (false);
+   tag = done.front().tag;
+   result = done.front().result;
+   done.pop_front();
+   numPending--;
+   return (true);
+}
+
+//
+// Work
+//
+// Desc: Loop of a worker thread: run requests until the engine stops.
+//
+void PF_IOEngine::Work()
+{
+   while (1) {
+      PF_IORequest req;
+      {
+         unique_lock<mutex> guard(lock);
+         todoReady.wait(guard, [this] { return bStop || !todo.empty(); });
+         if (todo.empty())
+            return;
+         req = todo.front();
+         todo.pop_front();
+      }
+
+      ssize_t n = req.bWrite ? pwritev(req.fd, req.iov, req.numIov, req.offset)
+                             : preadv(req.fd, req.iov, req.numIov, req.offset);
+      req.result = (n < 0) ? -errno : (int)n;
+
+      {
+         lock_guard<mutex> guard(lock);
+         done.push_back(req);
+      }
+      doneReady.notify_one();
+   }
+}
+
+//
+// SetupURing
+//
+// Desc: Create the io_uring and map its rings.
+// Ret:  PF_UNIX if io_uring can not be used
+//
+int PF_IOEngine::SetupURing()
+{
+#ifdef PF_IO_URING
+   io_uring_params p;
+   memset(&p, 0, sizeof(p));
+   ringFd = syscall(__NR_io_uring_setup, depth, &p);
+   if (ringFd < 0)
+      return (PF_UNIX);
+
+   sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+   cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+   sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+
+   sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+   if (sqRing == MAP_FAILED) {
+      sqRing = NULL;
+      return (PF_UNIX);
+   }
+   cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+   if (cqRing == MAP_FAILED) {
+      cqRing = NULL;
+      return (PF_UNIX);
+   }
+   void *pSqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+   if (pSqes == MAP_FAILED)
+      return (PF_UNIX);
+   sqes = (io_uring_sqe *)pSqes;
+
+   char *sq = (char *)sqRing;
+   char *cq = (char *)cqRing;
+   sqHead = (unsigned *)(sq + p.sq_off.head);
+   sqTail = (unsigned *)(sq + p.sq_off.tail);
+   sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+   sqArray = (unsigned *)(sq + p.sq_off.array);
+   cqHead = (unsigned *)(cq + p.cq_off.head);
+   cqTail = (unsigned *)(cq + p.cq_off.tail);
+   cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+   cqes = (io_uring_cqe *)(cq + p.cq_off.cqes);
+
+   // The ring may be larger than asked for, never let more be pending
+   if ((int)p.sq_entries < depth)
+      depth = p.sq_entries;
+   return (0);
+#else
+   return (PF_UNIX);
+#endif
+}
+
+//
+// CloseURing
+//
+// Desc: Unmap the rings and close the io_uring, if any.
+//
+void PF_IOEngine::CloseURing()
+{
+#ifdef PF_IO_URING
+   if (sqes != NULL)
+      munmap(sqes, sqesSize);
+   if (cqRing != NULL)
+      munmap(cqRing, cqRingSize);
+   if (sqRing != NULL)
+      munmap(sqRing, sqRingSize);
+   if (ringFd >= 0)
+      close(ringFd);
+#endif
+   sqes = NULL;
+   sqRing = cqRing = NULL;
+   ringFd = -1;
+}
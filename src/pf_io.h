@@ -0,0 +1,104 @@
+//
+// File:        pf_io.h
+// Description: PF_IOEngine class interface
+// Authors:     Haris Wang (dynmiw@gmail.com)
+//
+// The buffer manager hands page reads and writes to a PF_IOEngine so
+// that several of them are in flight at once.  On Linux the requests go
+// through io_uring; elsewhere, or if the kernel refuses io_uring, a few
+// worker threads run them with preadv and pwritev.
+//
+
+#ifndef PF_IO_H
+#define PF_IO_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include "wsql.h"
+#include "pf.h"
+
+// Build the io_uring backend unless PF_NO_URING is defined
+#if defined(__linux__) && !defined(PF_NO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PF_IO_URING
+#endif
+#endif
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//
+// PF_IORequest - a read or write of consecutive pages
+//
+struct PF_IORequest {
+    int          fd;        // OS file descriptor
+    int          bWrite;    // write rather than read
+    struct iovec iov[PF_IO_MAXVEC];  // the pages, in file order
+    int          numIov;    // # of pages
+    off_t        offset;    // offset of the first page in the file
+    long         tag;       // given back when the request is complete
+    int          result;    // bytes transferred, or -errno
+};
+
+//
+// PF_IOEngine - run page reads and writes asynchronously
+//
+// Submit queues a request for up to PF_IO_MAXVEC consecutive pages of a
+// file, which is handed to the OS at the latest by the next Start or
+// Complete.  Complete gives back one finished request at a time, in any
+// order.  The caller must keep the page data alive and untouched until
+// its request is complete.
+//
+class PF_IOEngine {
+public:
+    PF_IOEngine      (int _depth = PF_IO_DEPTH);  // Constructor
+    ~PF_IOEngine     ();                          // Destructor, waits for
+                                                  // all requests
+
+    // Queue a request, PF_NOBUF if _depth requests are already pending
+    RC   Submit      (int fd, int bWrite, const struct iovec *iov,
+                      int numIov, off_t offset, long tag);
+    // Hand the queued requests to the OS
+    RC   Start       ();
+    // Get a finished request.  Returns false if none is finished and
+    // bWait is false, or if no request is pending.
+    bool Complete    (long &tag, int &result, int bWait);
+
+    int  GetNumPending() const { return numPending; }  // # not complete
+    int  IsFull      () const { return numPending == depth; }
+    int  IsURing     () const { return ringFd >= 0; }  // io_uring in use
+
+private:
+    int            depth;                         // max # of requests
+    int            numPending;                    // # of requests pending
+
+    // io_uring backend.  The sqe of a request points into its entry of
+    // reqs, whose index is its user_data.
+    int            ringFd;                        // -1 if not used
+    PF_IORequest   *reqs;                         // depth requests
+    std::vector<int> freeReqs;                    // unused entries of reqs
+    unsigned       numQueued;                     // # not handed to the OS
+    unsigned       *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned       *cqHead, *cqTail, *cqMask;
+    io_uring_sqe   *sqes;
+    io_uring_cqe   *cqes;
+    void           *sqRing, *cqRing;              // mapped rings
+    size_t         sqRingSize, cqRingSize, sqesSize;
+    int            SetupURing  ();
+    void           CloseURing  ();
+
+    // worker thread backend
+    std::vector<std::thread>    workers;
+    std::mutex                  lock;
+    std::condition_variable     todoReady, doneReady;
+    std::deque<PF_IORequest>    todo, done;
+    bool                        bStop;
+    void           Work        ();                // Loop of a worker
+};
+
+#endif
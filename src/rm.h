@@ -28,11 +28,14 @@
 //
 // bitmap: provides bitmap structure for each page
 // for each bit, 0 stands for "free" bit, 1 stands for "used"
+// The bits are kept in 64-bit words, bit i in bit i%64 of word i/64,
+// and are searched and counted a word at a time.
 //
 class bitmap {
 private:
     unsigned int size;
-    char* buffer;
+    unsigned long long* words;
+    unsigned int NumWords;
 public:
     unsigned int NumChars;
 
@@ -44,6 +47,18 @@ public:
 
     RC to_char_buf(char * buf, int len) const;
     RC getSize() const;
+
+    // first bit at or after 'from' that is clear / set, -1 if none
+    int firstClear(unsigned int from = 0) const;
+    int firstSet(unsigned int from = 0) const;
+    // # of bits set
+    int count() const;
+
+    // The same on 'numBits' bits laid out as a slot map, bit i%8 of
+    // byte i/8, read in place
+    static int FindClear(const char *map, int numBits, int from);
+    static int FindSet(const char *map, int numBits, int from);
+    static int CountSet(const char *map, int numBits);
 };
 
 
@@ -57,6 +72,7 @@ struct RM_FileHdr
     int extRecordSize;  // record size as seen by users
     int pageSize;       // pageSize as seen by users
     AttrType attrType;
+    int fsmMagic;       // RM_FSM_MAGIC if the file has a free-space map
 
 void print()
 {
@@ -95,7 +111,7 @@ RM_PageHdr(int numSlots) : numTotSlots(numSlots), numFreeSlots(numSlots)
 int size() const
 {
     return sizeof(nextFree) + sizeof(numTotSlots) + sizeof(numFreeSlots)
-        + bitmap(numTotSlots).NumChars*sizeof(char);
+        + (numTotSlots + 7) / 8;
 }
 
 int mapsize() const
@@ -134,6 +150,109 @@ int from_buf(const char *buf)
 };
 
 
+//
+// RM_PageGeom: where the slots of the pages of an RM file are, fixed
+// by the record size when the file is opened
+//
+struct RM_PageGeom {
+    int numSlots;     // # of slots per page
+    int mapSize;      // # of bytes of the slot map
+    int hdrSize;      // # of bytes of the page header, offset of slot 0
+    int recordSize;   // # of bytes of a slot
+    int fsmSpan;      // # of data pages per FSM page, 0 if no FSM
+};
+
+
+//
+// Free-space map (FSM): files created with one keep a 2-bit class of
+// the free slots of each data page in FSM pages, so that inserts find a
+// page with room without reading data pages.  FSM page k is page
+// 1 + k * (RM_FSM_SPAN + 1) and covers the RM_FSM_SPAN pages after it.
+// The positions do not depend on the record size, so the column files
+// of a table keep the same page numbers.  The entry of the e-th page
+// covered is bits 2*(e%4) and 2*(e%4)+1 of byte e/4, 0 if the page is
+// full or not allocated.  Files without an FSM keep the free list
+// threaded through the page headers.
+//
+#define RM_FSM_MAGIC   0x4d534652  // "RFSM"
+#define RM_FSM_SPAN    8192        // # of data pages per FSM page
+#define RM_FSM_FULL    0           // no free slot
+#define RM_FSM_SOME    1           // less than half of the slots free
+#define RM_FSM_HALF    2           // at least half of the slots free
+#define RM_FSM_EMPTY   3           // all slots free
+
+
+//
+// RM_PageView: the header of a pinned RM page, read and written in
+// place.  The layout is the one of RM_PageHdr::to_buf: nextFree,
+// numTotSlots and numFreeSlots, then the slot map, whose bit s%8 of
+// byte s/8 is set if slot s is used.  The records follow.
+//
+struct RM_PageView {
+    char *pData;              // page contents, as given by PF_PageHandle::GetData
+    const RM_PageGeom &geom;  // geometry of the pages of the file
+
+RM_PageView(char *_pData, const RM_PageGeom &_geom) : pData(_pData), geom(_geom) {}
+
+// # of bytes of the header of a page with 'numSlots' slots
+static int Size(int numSlots)
+{
+    return 3 * sizeof(int) + MapSize(numSlots);
+}
+
+static int MapSize(int numSlots)
+{
+    return (numSlots + 7) / 8;
+}
+
+int &NextFree() const { return ((int *)pData)[0]; }
+int &NumTotSlots() const { return ((int *)pData)[1]; }
+int &NumFreeSlots() const { return ((int *)pData)[2]; }
+char *SlotMap() const { return pData + 3 * sizeof(int); }
+
+bool IsUsed(int s) const
+{
+    return SlotMap()[s / 8] & (1 << (s % 8));
+}
+
+void SetUsed(int s, bool bUsed) const
+{
+    if (bUsed)
+        SlotMap()[s / 8] |= (1 << (s % 8));
+    else
+        SlotMap()[s / 8] &= ~(1 << (s % 8));
+}
+
+// first free / used slot at or after 's', -1 if none
+int FirstFreeSlot(int s) const
+{
+    return bitmap::FindClear(SlotMap(), geom.numSlots, s);
+}
+
+int FirstUsedSlot(int s) const
+{
+    return bitmap::FindSet(SlotMap(), geom.numSlots, s);
+}
+
+//
+// set up an empty page: all slots free, not on the free list
+//
+void Init() const
+{
+    NextFree() = RM_PAGE_LIST_END;
+    NumTotSlots() = geom.numSlots;
+    NumFreeSlots() = geom.numSlots;
+    memset(SlotMap(), 0, geom.mapSize);
+}
+
+char *GetSlot(int s) const
+{
+    return pData + geom.hdrSize + s * geom.recordSize;
+}
+
+};
+
+
 //
 // RM_Record: RM Record interface
 //
@@ -159,6 +278,39 @@ public:
 };
 
 
+class RM_FileHandle;
+
+//
+// RM_RecordView: a record read in place in its page, which stays
+// pinned until the view is reset, moves to another page or is
+// destroyed.  A scan reading records in page order pins each page
+// once and copies nothing.  Read only; use RM_Record to keep a copy.
+// The file may not be changed while one of its views holds a page.
+//
+class RM_RecordView {
+private:
+    friend class RM_FileHandle;
+    const RM_FileHandle *rmfh; // file of the pinned page, NULL if none
+    PageNum page;          // pinned page
+    char *pPage;           // its contents
+    const char *data;      // the record, NULL if none
+    int recordSize;
+    RID rid;
+public:
+    RM_RecordView ();
+    ~RM_RecordView();
+    RM_RecordView(const RM_RecordView &) = delete;
+    RM_RecordView &operator=(const RM_RecordView &) = delete;
+
+    // Sets pData to the record contents, valid until the view changes
+    RC GetData(const char *&pData) const;
+    RC GetRid (RID &rid) const;
+    int GetRSize() const {return recordSize;}
+    bool IsNullValue() const;
+    void Reset();          // Unpin the page
+};
+
+
 RC CreateRMFile (const char *fileName, int recordSize, int pageSize, AttrType attrType);
 RC DestroyRMFile(const char *fileName);
 
@@ -167,12 +319,22 @@ RC DestroyRMFile(const char *fileName);
 //
 class RM_FileHandle {
 private:
+    friend class RM_RecordView;
     RM_FileHdr hdr;
     PF_FileHandle *pfh;
     bool bFileOpen;    // open flag for file
     bool bHdrChanged;  // dirty flag for FileHeader
+    RM_PageGeom geom;  // slot geometry, set when the file is opened
+    PageNum fsmHint;   // no data page before it has a free slot
+    mutable int numViews; // views holding a page of the file
 
     RC SetFileHeader(PF_PageHandle ph) const;
+    void SetGeom();
+
+    bool IsFsmPage(PageNum p) const;
+    RC FindFreePage(PageNum &pageNum);
+    RC NoteFreeSlots(PageNum p, int oldFree, int newFree);
+    RC AllocateDataPage(PF_PageHandle &ph, PageNum &pageNum);
 
     bool IsValidRID(const RID rid) const;
 
@@ -190,8 +352,13 @@ public:
     RC SetPageHeader(PF_PageHandle &ph, RM_PageHdr &pHdr);
     // Given a RID, return the record
     RC GetRec     (RID rid, RM_Record &rec) const;
+    // Point view at the record in its pinned page, without copying it
+    RC GetRec     (RID rid, RM_RecordView &view) const;
 
     RC InsertRec  (const void *pData, RID &rid);       // Insert a new record
+    // Insert numRecs records stored back to back in pData, a page at a
+    // time.  If rids is not NULL, the RID of each record is written to it.
+    RC InsertRecs (const char *pData, int numRecs, RID *rids = NULL);
     RC DeleteRec  (const RID &rid);                    // Delete a record
     RC UpdateRec  (const RM_Record &rec);              // Update a record
 
@@ -203,9 +370,12 @@ public:
 
     bool hdrChanged() const;
     PageNum GetNumPages() const;
-    SlotNum GetNumSlots() const;
+    SlotNum GetNumSlots() const
+    { return geom.numSlots > 0 ? geom.numSlots : (START_RM_ERR - 3); }
     long long GetNumRecs() const;
-    RC WriteAllRids(const char *OutFile) const;
+    // slot map / RIDs of the next page holding records after p
+    RC GetNextSlotMap(PageNum &p, char *slotMap) const;
+    RC GetNextRids(PageNum &p, RID *rids, int &numRids) const;
     RC WriteValue(FILE *&fp, RID rid) const;
     RC IsValid() const;
     void print(PageNum p, AttrType type);
@@ -45,6 +45,7 @@ RC CreateRMFile (const char *fileName, int recordSize, int pageSize, AttrType at
     hdr->numPages = 1; // only header page
     hdr->pageSize = pageSize;
     hdr->attrType = attrType;
+    hdr->fsmMagic = RM_FSM_MAGIC;
     memcpy(pData, hdr, sizeof(RM_FileHdr));
     delete hdr;
 
@@ -78,6 +79,9 @@ RM_FileHandle::RM_FileHandle()
     pfh = NULL;
     bFileOpen = 0;
     bHdrChanged = 0;
+    memset(&geom, 0, sizeof(geom));
+    fsmHint = 1;
+    numViews = 0;
 }
 
 
@@ -108,6 +112,8 @@ RC RM_FileHandle::OpenRMFile(const char *fileName)
     bFileOpen = true;
     // load file header to main memory
     memcpy(&hdr, pData, sizeof(RM_FileHdr));
+    SetGeom();
+    fsmHint = 1;
     return rc;
 }
 
@@ -121,6 +127,7 @@ RC RM_FileHandle::CloseRMFile()
 {
     if (!bFileOpen || pfh == NULL)
         return -1;
+    assert(numViews == 0);
     if (bHdrChanged)
     {
         PF_PageHandle ph;
@@ -161,20 +168,147 @@ PageNum RM_FileHandle::GetNumPages() const
 }
 
 
-SlotNum RM_FileHandle::GetNumSlots() const
+//
+// work out the slot geometry of the pages from the file header,
+// once, so that record operations only add offsets.  The slots fit
+// in hdr.pageSize less sizeof(RM_PageHdr), which existing files were
+// laid out with, together with the slot map.
+//
+void RM_FileHandle::SetGeom()
 {
-    if(hdr.extRecordSize==0)
-        return (START_RM_ERR - 3);
-    
-    int bytes_available = hdr.pageSize - sizeof(RM_PageHdr);
-    int slots = floor(1.0 * bytes_available/ (hdr.extRecordSize+1/8));
-    int r = sizeof(RM_PageHdr) + bitmap(slots).NumChars;
+    memset(&geom, 0, sizeof(geom));
+    int bytes_available = hdr.pageSize - (int)sizeof(RM_PageHdr);
+    if (hdr.extRecordSize <= 0 || bytes_available <= 0)
+        return;
 
-    while( slots*hdr.extRecordSize > bytes_available-bitmap(slots).NumChars )
+    int slots = bytes_available / hdr.extRecordSize;
+    while( slots*hdr.extRecordSize > bytes_available-RM_PageView::MapSize(slots) )
     {
         slots--;
     }
-    return slots;
+    geom.numSlots = slots;
+    geom.mapSize = RM_PageView::MapSize(slots);
+    geom.hdrSize = RM_PageView::Size(slots);
+    geom.recordSize = hdr.extRecordSize;
+    geom.fsmSpan = (hdr.fsmMagic == RM_FSM_MAGIC) ? RM_FSM_SPAN : 0;
+}
+
+
+//
+// FSM class of a page with 'numFree' of 'numSlots' slots free
+//
+static int FreeClass(int numFree, int numSlots)
+{
+    if (numFree == 0)
+        return RM_FSM_FULL;
+    if (numFree == numSlots)
+        return RM_FSM_EMPTY;
+    return (2 * numFree >= numSlots) ? RM_FSM_HALF : RM_FSM_SOME;
+}
+
+
+//
+// return whether page 'p' is an FSM page
+//
+bool RM_FileHandle::IsFsmPage(PageNum p) const
+{
+    return geom.fsmSpan > 0 && p > 0 && (p - 1) % (geom.fsmSpan + 1) == 0;
+}
+
+
+//
+// set 'pageNum' to the first data page with a free slot, from the FSM.
+// Data pages are not touched.
+// return 0 if success
+// return PF_EOF if no page has a free slot
+//
+RC RM_FileHandle::FindFreePage(PageNum &pageNum)
+{
+    RC rc;
+    PF_PageHandle ph;
+    char *pData;
+    int stride = geom.fsmSpan + 1;
+    for (PageNum fsmPage = 1 + (fsmHint - 1) / stride * stride;
+         fsmPage < hdr.numPages; fsmPage += stride)
+    {
+        int from = (fsmHint > fsmPage) ? fsmHint - fsmPage - 1 : 0;
+        int numEntries = min(geom.fsmSpan, hdr.numPages - fsmPage - 1);
+        if ((rc = pfh->GetThisPage(fsmPage, ph, true))
+            || (rc = ph.GetData(pData)))
+            return rc;
+        // a nonzero entry has a bit set
+        int bit = bitmap::FindSet(pData, 2 * numEntries, 2 * from);
+        if ((rc = pfh->UnpinPage(fsmPage)))
+            return rc;
+        if (bit >= 0)
+        {
+            pageNum = fsmHint = fsmPage + 1 + bit / 2;
+            return 0;
+        }
+    }
+    fsmHint = hdr.numPages;
+    return PF_EOF;
+}
+
+
+//
+// record in the FSM that data page 'p' went from 'oldFree' to 'newFree'
+// free slots.  The FSM page is only touched if the class changes.
+// return 0 if success
+//
+RC RM_FileHandle::NoteFreeSlots(PageNum p, int oldFree, int newFree)
+{
+    int cls = FreeClass(newFree, geom.numSlots);
+    if (geom.fsmSpan == 0 || cls == FreeClass(oldFree, geom.numSlots))
+        return 0;
+
+    RC rc;
+    PF_PageHandle ph;
+    char *pData;
+    PageNum fsmPage = 1 + (p - 1) / (geom.fsmSpan + 1) * (geom.fsmSpan + 1);
+    int e = p - fsmPage - 1;
+    if ((rc = pfh->GetThisPage(fsmPage, ph))
+        || (rc = ph.GetData(pData)))
+        return rc;
+    int shift = 2 * (e % 4);
+    pData[e / 4] = (pData[e / 4] & ~(3 << shift)) | (cls << shift);
+    if ((rc = pfh->MarkDirty(fsmPage))
+        || (rc = pfh->UnpinPage(fsmPage)))
+        return rc;
+
+    if (cls != RM_FSM_FULL && p < fsmHint)
+        fsmHint = p;
+    return 0;
+}
+
+
+//
+// append an empty data page to the file, after a new FSM page if it
+// falls where one goes.  The page is left pinned in 'ph'.
+// return 0 if success
+//
+RC RM_FileHandle::AllocateDataPage(PF_PageHandle &ph, PageNum &pageNum)
+{
+    RC rc;
+    char *pData;
+    while (1)
+    {
+        if ((rc = pfh->AllocatePage(ph))
+            || (rc = ph.GetData(pData))
+            || (rc = ph.GetPageNum(pageNum)))
+            return rc;
+        hdr.numPages++;
+        bHdrChanged = true;
+        if (!IsFsmPage(pageNum))
+            break;
+        // none of the pages it covers is allocated yet
+        memset(pData, 0, RM_FSM_SPAN / 4);
+        if ((rc = pfh->MarkDirty(pageNum))
+            || (rc = pfh->UnpinPage(pageNum)))
+            return rc;
+    }
+    RM_PageView(pData, geom).Init();
+    return pfh->MarkDirty(pageNum);
 }
 
 
@@ -182,23 +316,24 @@ long long RM_FileHandle::GetNumRecs() const
 {
     RC rc;
     long long cnt = 0;
-    auto numSlots = this->GetNumSlots();
     PF_PageHandle ph;
-    RM_PageHdr pHdr(numSlots);
     PageNum p = (PageNum)-1;
+    char *pData;
     while (1)
     {
-        rc = pfh->GetNextPage(p, ph);
+        rc = pfh->GetNextPage(p, ph, true);
         if (rc == PF_EOF)
             break;
         rc = ph.GetPageNum(p);
         assert(rc == 0);
-        if (p != 0)
+        if (p != 0 && !IsFsmPage(p))
         {
-            rc = this->GetPageHeader(ph, pHdr);
-            if (rc != 0) return rc;
-
-            cnt += numSlots - pHdr.numFreeSlots;
+            if ((rc = ph.GetData(pData)))
+            {
+                pfh->UnpinPage(p);
+                return rc;
+            }
+            cnt += geom.numSlots - RM_PageView(pData, geom).NumFreeSlots();
         }
         rc = pfh->UnpinPage(p);
         assert(rc == 0);
@@ -209,48 +344,74 @@ long long RM_FileHandle::GetNumRecs() const
 
 
 //
-// write RID of all records to 'OutFile'
+// copy the slot map of the first page after 'p' that holds records
+// to 'slotMap', and set 'p' to that page.  Bit s of the map, bit s%8 of
+// byte s/8, is set if slot s holds a record.  'slotMap' must have room
+// for RM_PageView::MapSize(GetNumSlots()) bytes.  Start with p = -1.
+// return 0 if success
+// return PF_EOF if there is no such page
 //
-RC RM_FileHandle::WriteAllRids(const char *OutFile) const
+RC RM_FileHandle::GetNextSlotMap(PageNum &p, char *slotMap) const
 {
     RC rc = 0;
-    auto numSlots = this->GetNumSlots();
     PF_PageHandle ph;
-    RM_PageHdr pHdr(numSlots);
-    PageNum p = (PageNum)-1;
-    FILE *fpx = fopen(OutFile, "w");
+    char *pData;
     while (1)
     {
-        rc = pfh->GetNextPage(p, ph);
-        if (rc == PF_EOF)
-            break;
-        rc = ph.GetPageNum(p);
-        if (rc != 0) return rc;
-        if (p > 0)
+        if ((rc = pfh->GetNextPage(p, ph, true)))
+            return rc;
+        if ((rc = ph.GetPageNum(p)))
+            return rc;
+        bool bFound = false;
+        if (p > 0 && !IsFsmPage(p))
         {
-            rc = this->GetPageHeader(ph, pHdr);
-            if (rc != 0) return rc;
-
-            bitmap b(this->GetNumSlots(), pHdr.freeSlotMap);
-            for (int s = 0; s < b.getSize(); s++)
+            if ((rc = ph.GetData(pData)))
+            {
+                pfh->UnpinPage(p);
+                return rc;
+            }
+            RM_PageView view(pData, geom);
+            if (view.NumFreeSlots() < geom.numSlots)
             {
-                if (b.test(s))
-                    fprintf(fpx, "%d %d\n", p, s);
+                memcpy(slotMap, view.SlotMap(), geom.mapSize);
+                bFound = true;
             }
         }
-        rc = pfh->UnpinPage(p);
-        if (rc != 0) return rc;
+        if ((rc = pfh->UnpinPage(p)))
+            return rc;
+        if (bFound)
+            return 0;
     }
-    fclose(fpx);
+}
+
 
+//
+// set 'rids' to the RIDs of all records on the first page after 'p'
+// that holds records, and 'p' to that page.  'rids' must have room
+// for GetNumSlots() RIDs.  Start with p = -1.
+// return 0 if success
+// return PF_EOF if there is no such page
+//
+RC RM_FileHandle::GetNextRids(PageNum &p, RID *rids, int &numRids) const
+{
+    RC rc = 0;
+    char *slotMap = new char[geom.mapSize];
+    numRids = 0;
+    if ((rc = GetNextSlotMap(p, slotMap)) == 0)
+    {
+        for (int s = bitmap::FindSet(slotMap, geom.numSlots, 0); s >= 0;
+             s = bitmap::FindSet(slotMap, geom.numSlots, s + 1))
+            rids[numRids++] = RID(p, s);
+    }
+    delete[] slotMap;
     return rc;
 }
 
 
 RC RM_FileHandle::WriteValue(FILE *&fp, RID rid) const
 {
-    char *ptr;
-    RM_Record rec;
+    const char *ptr;
+    RM_RecordView rec;
     RC rc = this->GetRec(rid, rec);
     if (rc != 0) 
         return rc;
@@ -261,10 +422,14 @@ RC RM_FileHandle::WriteValue(FILE *&fp, RID rid) const
             fprintf(fp, "%s ", ptr);
         }break;
         case FLOAT:{
-            fprintf(fp, "%f ", *(float *)ptr);
+            float val;
+            memcpy(&val, ptr, sizeof(val));
+            fprintf(fp, "%f ", val);
         }break;
         case INT:{
-            fprintf(fp, "%d ", *(int *)ptr);           
+            int val;
+            memcpy(&val, ptr, sizeof(val));
+            fprintf(fp, "%d ", val);
         }break;
     }
     return rc;
@@ -288,34 +453,52 @@ RC RM_FileHandle::GetSlotPointer(PF_PageHandle ph, SlotNum s, char*& pData ) con
     if( rc<0 )
         return rc;
     
-    pData += RM_PageHdr(this->GetNumSlots()).size();
-    pData += s * hdr.extRecordSize;
+    pData = RM_PageView(pData, geom).GetSlot(s);
     return rc;
 }
 
 
 //
 // get next free page in this RM file, set pageNum
-// to be the page id of this free page
+// to be the page id of this free page.  With an FSM this is the
+// first page with a free slot, so pages fill up in order.
 // return 0 if success
 //
 RC RM_FileHandle::GetNextFreePage(PageNum& pageNum) 
 {
     RC invalid = IsValid(); if(invalid) return invalid; 
     PF_PageHandle ph;
-    RM_PageHdr pHdr(this->GetNumSlots());
-    
+    RC rc;
+
+    if (geom.fsmSpan > 0)
+    {
+        if ((rc = FindFreePage(pageNum)) != PF_EOF)
+            return rc;
+        // no page has room, add one
+        if ((rc = AllocateDataPage(ph, pageNum))
+            || (rc = pfh->UnpinPage(pageNum))
+            || (rc = NoteFreeSlots(pageNum, 0, geom.numSlots)))
+        {
+            PF_PrintError(rc);
+            return rc;
+        }
+        return 0;
+    }
+
+    int numFreeSlots = geom.numSlots;
     if(hdr.firstFree != RM_PAGE_LIST_END) 
     {
         // this last page on the free list might actually be full
-        RC rc;
-        PageNum p;
-        if ((rc = pfh->GetThisPage(hdr.firstFree, ph))
-            || (rc = ph.GetPageNum(p))
-            || (rc = pfh->MarkDirty(p))
-            // Needs to be called everytime GetThisPage is called.
-            || (rc = pfh->UnpinPage(hdr.firstFree))
-            || (rc = this->GetPageHeader(ph, pHdr)))
+        char *pData;
+        if ((rc = pfh->GetThisPage(hdr.firstFree, ph, true))
+            || (rc = ph.GetData(pData)))
+        {
+            PF_PrintError(rc);
+            return rc;
+        }
+        numFreeSlots = RM_PageView(pData, geom).NumFreeSlots();
+        // Needs to be called everytime GetThisPage is called.
+        if ((rc = pfh->UnpinPage(hdr.firstFree)))
         {
             PF_PrintError(rc);
             return rc;
@@ -327,48 +510,23 @@ RC RM_FileHandle::GetNextFreePage(PageNum& pageNum)
         hdr.numPages == 0 || 
         hdr.firstFree == RM_PAGE_LIST_END ||
         // or due to a full page
-    //      (pHdr.numFreeSlots == 0 && pHdr.nextFree == RM_PAGE_FULLY_USED)
-        (pHdr.numFreeSlots == 0)
+        (numFreeSlots == 0)
         ) 
     {
-        if(pHdr.nextFree == RM_PAGE_FULLY_USED)
-        {
-        // std::cerr << "RM_FileHandle::GetNextFreePage - Page Full!" << endl;
-        }
-        {
-        char *pData;
-
-        RC rc;
-        if ((rc = pfh->AllocatePage(ph)) ||
-            (rc = ph.GetData(pData)) ||
-            (rc = ph.GetPageNum(pageNum)))
-            return(rc);
-        
-        // Add page header
-        RM_PageHdr phdr(this->GetNumSlots());
-        phdr.nextFree = RM_PAGE_LIST_END;
-        bitmap b(this->GetNumSlots());
-        b.set(); // Initially all slots are free
-        b.to_char_buf(phdr.freeSlotMap, b.NumChars);
-        // std::cerr << "RM_FileHandle::GetNextFreePage new!!" << b << endl;
-        phdr.to_buf(pData);
-
+        // Add page header, initially all slots are free.
         // the default behavior of the buffer pool is to pin pages
         // let us make sure that we unpin explicitly after setting
         // things up
-        if ((rc = pfh->MarkDirty(pageNum)) 
+        if ((rc = AllocateDataPage(ph, pageNum))
             || (rc = pfh->UnpinPage(pageNum)))
         {
             PF_PrintError(rc);
             return rc;
         }
-        }
 
         // add page to the free list
         hdr.firstFree = pageNum;
-        hdr.numPages++;
         assert(hdr.numPages > 1); 
-        bHdrChanged = true;
         return 0; // pageNum is set correctly
     }
     // return existing free page
@@ -379,7 +537,8 @@ RC RM_FileHandle::GetNextFreePage(PageNum& pageNum)
 
 //
 // get next free slot in the given page identified by pageNum,
-// ph will be set as the PageHandle associated with this page
+// ph will be set as the PageHandle associated with this page,
+// which is left pinned for the caller to fill the slot
 // return 0 if success
 // return -1 if this page if full
 //
@@ -390,27 +549,21 @@ RC RM_FileHandle::GetNextFreeSlot(PF_PageHandle& ph, PageNum& p, SlotNum& s)
     if (rc != 0)
         return rc;
 
-    RM_PageHdr *pHdr = new RM_PageHdr(this->GetNumSlots());
-
+    char *pData;
     if ((rc= this->GetNextFreePage(p))
         || (rc = pfh->GetThisPage(p, ph))
-        || (rc = this->GetPageHeader(ph, *pHdr))
-        || (rc = pfh->UnpinPage(p)))
+        || (rc = ph.GetData(pData)))
     {
-        delete pHdr;
         PF_PrintError(rc);
         return rc;
     }
-    bitmap b(this->GetNumSlots(), pHdr->freeSlotMap);
-    for (int i = 0; i < this->GetNumSlots(); i++)
+    int i = RM_PageView(pData, geom).FirstFreeSlot(0);
+    if (i >= 0)
     {
-        if (!b.test(i)) {
-            s = i;
-            delete pHdr;
-            return 0;
-        }
+        s = i;
+        return 0;
     }
-    delete pHdr;
+    pfh->UnpinPage(p);
     return -1; // This page is full
 }
 
@@ -419,7 +572,7 @@ RC RM_FileHandle::IsValid() const
 {
     if((pfh==NULL) || !bFileOpen)
         return (START_RM_ERR - 6);
-    if(GetNumSlots()<=0)
+    if(geom.numSlots<=0)
         return (START_RM_ERR - 3);
     
     return 0;
@@ -464,25 +617,75 @@ RC RM_FileHandle::GetRec(RID rid, RM_Record &rec) const
 
     RC rc;
     PF_PageHandle ph;
-    RM_PageHdr pHdr(this->GetNumSlots());
-    if((rc = pfh->GetThisPage(rid.page, ph)) 
-        || (rc = pfh->UnpinPage(rid.page)))
+    char *pData;
+    if((rc = pfh->GetThisPage(rid.page, ph, true))
+        || (rc = ph.GetData(pData)))
     {
         PF_PrintError(rc);
         return rc;
     }
 
-    GetPageHeader(ph, pHdr);
-    bitmap b(this->GetNumSlots(), pHdr.freeSlotMap);
-    if(!b.test(rid.slot))
-        return (START_RM_WARN + 1);
-    char *buf;
-    rc = this->GetSlotPointer(ph, rid.slot, buf);
-    if (rc != 0)
-        return rc;
-    rc = rec.Set(buf, hdr.extRecordSize, rid);
+    RM_PageView view(pData, geom);
+    if(!view.IsUsed(rid.slot))
+        rc = (START_RM_WARN + 1);
+    else
+        rc = rec.Set(view.GetSlot(rid.slot),
+                     hdr.extRecordSize, rid);
 
-    return rc;
+    RC rcUnpin = pfh->UnpinPage(rid.page);
+    return rc ? rc : rcUnpin;
+}
+
+//
+// point 'view' at the record at given RID position in its page.
+// The page stays pinned by the view, and is not pinned again while
+// the view reads records of the same page.  The file may not be
+// changed until the view is reset.
+//
+// Desc: Get record in place
+// Out:  view
+// Ret:  RM return code
+//
+RC RM_FileHandle::GetRec(RID rid, RM_RecordView &view) const
+{
+    if(IsValid())
+        return IsValid();
+    if(!this->IsValidRID(rid))
+        return (START_RM_ERR - 7);
+
+    RC rc;
+    if(view.rmfh != this || view.page != rid.page)
+    {
+        view.Reset();
+        PF_PageHandle ph;
+        char *pData;
+        if((rc = pfh->GetThisPage(rid.page, ph, true)))
+        {
+            PF_PrintError(rc);
+            return rc;
+        }
+        if((rc = ph.GetData(pData)))
+        {
+            pfh->UnpinPage(rid.page);
+            PF_PrintError(rc);
+            return rc;
+        }
+        view.rmfh = this;
+        numViews++;
+        view.page = rid.page;
+        view.pPage = pData;
+    }
+
+    RM_PageView page(view.pPage, geom);
+    if(!page.IsUsed(rid.slot))
+    {
+        view.data = NULL;
+        return (START_RM_WARN + 1);
+    }
+    view.data = page.GetSlot(rid.slot);
+    view.recordSize = hdr.extRecordSize;
+    view.rid = rid;
+    return 0;
 }
 
 //
@@ -496,36 +699,46 @@ RC RM_FileHandle::DeleteRec(const RID &rid)
     RC invalid = IsValid();
     if(invalid)
         return invalid;
+    assert(numViews == 0);
     if(!this->IsValidRID(rid))
         return (START_RM_ERR - 7);
 
     RC rc;
     PF_PageHandle ph;
-    RM_PageHdr pHdr(this->GetNumSlots());
+    char *pData;
     if((rc = pfh->GetThisPage(rid.page, ph)) 
-        || (rc = pfh->MarkDirty(rid.page))
-        || (rc = pfh->UnpinPage(rid.page))
-        || (rc = this->GetPageHeader(ph, pHdr)))
+        || (rc = ph.GetData(pData)))
     {
         PF_PrintError(rc);
         return rc;
     }
 
-    bitmap b(this->GetNumSlots(), pHdr.freeSlotMap);
-    if(!b.test(rid.slot))
+    RM_PageView view(pData, geom);
+    if(!view.IsUsed(rid.slot))
+    {
+        pfh->UnpinPage(rid.page);
         return (START_RM_WARN + 1);
-    b.set(rid.slot, 0);
-    if(pHdr.numFreeSlots == 0)
+    }
+    view.SetUsed(rid.slot, 0);
+    int numFree = view.NumFreeSlots();
+    if(geom.fsmSpan == 0 && numFree == 0)
     {
         // this page used to be full, but now it has free
         // space, so add it to the first list.
-        pHdr.nextFree = hdr.firstFree;
+        view.NextFree() = hdr.firstFree;
         hdr.firstFree = rid.page;
+        bHdrChanged = true;
     }
-    pHdr.numFreeSlots++;
-    b.to_char_buf(pHdr.freeSlotMap, b.NumChars);
-    rc = this->SetPageHeader(ph, pHdr);
-    return rc;
+    view.NumFreeSlots()++;
+
+    if ((rc = pfh->MarkDirty(rid.page))
+        || (rc = pfh->UnpinPage(rid.page))
+        || (rc = NoteFreeSlots(rid.page, numFree, numFree + 1)))
+    {
+        PF_PrintError(rc);
+        return rc;
+    }
+    return 0;
 }
 
 //
@@ -539,29 +752,23 @@ RC RM_FileHandle::InsertRec(const void *pData, RID &rid)
 {
     if(IsValid())
         return IsValid();
+    assert(numViews == 0);
 
-    PF_PageHandle *ph = new PF_PageHandle;
-    RM_PageHdr *pHdr = new RM_PageHdr(this->GetNumSlots());
+    PF_PageHandle ph;
     PageNum p; SlotNum s;
+    char *pPage;
     RC rc;
 
-    if ((rc = this->GetNextFreeSlot(*ph, p, s))
-        || (rc = GetPageHeader(*ph, *pHdr)))
-    {
-        delete ph;
-        delete pHdr;
-        PF_PrintError(rc);
+    if ((rc = this->GetNextFreeSlot(ph, p, s)))
         return rc;
-    }
-    bitmap b(this->GetNumSlots(), pHdr->freeSlotMap);
-    char *pSlot;
-    rc = this->GetSlotPointer(*ph, s, pSlot);
-    if(rc != 0)
+    if ((rc = ph.GetData(pPage)))
     {
-        delete ph;
-        delete pHdr;
+        pfh->UnpinPage(p);
+        PF_PrintError(rc);
         return rc;
     }
+    RM_PageView view(pPage, geom);
+    char *pSlot = view.GetSlot(s);
     rid = RID(p, s);
     if (pData == NULL)
     {
@@ -570,19 +777,89 @@ RC RM_FileHandle::InsertRec(const void *pData, RID &rid)
         memcpy(pSlot, pData, hdr.extRecordSize);
     }
 
-    b.set(s, 1);
-    pHdr->numFreeSlots--;
-    if(pHdr->numFreeSlots==0)
+    view.SetUsed(s, 1);
+    int numFree = --view.NumFreeSlots();
+    if(geom.fsmSpan == 0 && numFree == 0)
     {
-        hdr.firstFree = pHdr->nextFree;
-        pHdr->nextFree = RM_PAGE_FULLY_USED;
+        hdr.firstFree = view.NextFree();
+        view.NextFree() = RM_PAGE_FULLY_USED;
+        bHdrChanged = true;
     }
 
-    b.to_char_buf(pHdr->freeSlotMap, b.NumChars);
-    rc = this->SetPageHeader(*ph, *pHdr);
-    delete ph;
-    delete pHdr;
-    return rc;
+    if ((rc = pfh->MarkDirty(p))
+        || (rc = pfh->UnpinPage(p))
+        || (rc = NoteFreeSlots(p, numFree + 1, numFree)))
+    {
+        PF_PrintError(rc);
+        return rc;
+    }
+    return 0;
+}
+
+//
+// insert records, fill the free slots of one page before
+// moving to the next free page
+//
+// Desc: Insert records
+// Ret:  RM return code
+//
+RC RM_FileHandle::InsertRecs(const char *pData, int numRecs, RID *rids)
+{
+    if(IsValid())
+        return IsValid();
+    assert(numViews == 0);
+
+    PF_PageHandle ph;
+    PageNum p;
+    char *pPage;
+    RC rc;
+    int i = 0;
+    while (i < numRecs)
+    {
+        if ((rc = this->GetNextFreePage(p))
+            || (rc = pfh->GetThisPage(p, ph))
+            || (rc = ph.GetData(pPage)))
+        {
+            PF_PrintError(rc);
+            return rc;
+        }
+
+        RM_PageView view(pPage, geom);
+        int oldFree = view.NumFreeSlots();
+        int first = i;
+        for (int s = view.FirstFreeSlot(0); s >= 0 && i < numRecs;
+             s = view.FirstFreeSlot(s + 1))
+        {
+            memcpy(view.GetSlot(s),
+                   pData + i * hdr.extRecordSize, hdr.extRecordSize);
+            view.SetUsed(s, 1);
+            view.NumFreeSlots()--;
+            if (rids != NULL)
+                rids[i] = RID(p, s);
+            i++;
+        }
+        if (i == first)
+        {
+            pfh->UnpinPage(p);
+            return -1; // free page without free slot
+        }
+        int numFree = view.NumFreeSlots();
+        if (geom.fsmSpan == 0 && numFree == 0)
+        {
+            hdr.firstFree = view.NextFree();
+            view.NextFree() = RM_PAGE_FULLY_USED;
+            bHdrChanged = true;
+        }
+
+        if ((rc = pfh->MarkDirty(p))
+            || (rc = pfh->UnpinPage(p))
+            || (rc = NoteFreeSlots(p, oldFree, numFree)))
+        {
+            PF_PrintError(rc);
+            return rc;
+        }
+    }
+    return 0;
 }
 
 //
@@ -595,40 +872,38 @@ RC RM_FileHandle::UpdateRec(const RM_Record &rec)
 {
     if(IsValid())
         return IsValid();
+    assert(numViews == 0);
 
     RID rid;
     rec.GetRid(rid);
     if (!this->IsValidRID(rid))
         return (START_RM_ERR - 7);
 
-    RC rc;
+    char *pData;
+    RC rc = rec.GetData(pData);
+    if (rc != 0)
+        return rc;
+
     PF_PageHandle ph;
-    RM_PageHdr pHdr(this->GetNumSlots());
+    char *pPage;
     if ((rc = pfh->GetThisPage(rid.page, ph))
-        || (rc = pfh->MarkDirty(rid.page))
-        || (rc = pfh->UnpinPage(rid.page))
-        || (rc = this->GetPageHeader(ph, pHdr)))
+        || (rc = ph.GetData(pPage)))
     {
         PF_PrintError(rc);
         return rc;
     }
 
-    bitmap b(this->GetNumSlots(), pHdr.freeSlotMap);
-    if (!b.test(rid.slot))
+    RM_PageView view(pPage, geom);
+    if (!view.IsUsed(rid.slot))
+        view.SetUsed(rid.slot, 1);
+    memcpy(view.GetSlot(rid.slot), pData, hdr.extRecordSize);
+
+    if ((rc = pfh->MarkDirty(rid.page))
+        || (rc = pfh->UnpinPage(rid.page)))
     {
-        b.set(rid.slot, 1);
-        b.to_char_buf(pHdr.freeSlotMap, b.NumChars);
-        SetPageHeader(ph, pHdr);
-    }
-    char *pData;
-    rc = rec.GetData(pData);
-    if (rc != 0)
-        return rc;
-    char *pSlot;
-    rc = this->GetSlotPointer(ph, rid.slot, pSlot);
-    if (rc != 0)
+        PF_PrintError(rc);
         return rc;
-    memcpy(pSlot, pData, hdr.extRecordSize);
+    }
     return 0;
 }
 
@@ -655,7 +930,9 @@ bool RM_FileHandle::IsValidRID(const RID rid) const
 {
     if(!(rid.page>=0 && rid.page<hdr.numPages && bFileOpen))
         return 0;
-    if(!(rid.slot>=0 && rid.slot<this->GetNumSlots()))
+    if(!(rid.slot>=0 && rid.slot<geom.numSlots))
+        return 0;
+    if(IsFsmPage(rid.page))
         return 0;
     return 1;
 }
@@ -671,7 +948,7 @@ void RM_FileHandle::print(PageNum p, AttrType type)
     printf("\n==============%3d===============\n", p);
     printf("printRMPage\n");
     printf("SLOT  VALUE\n");
-    for (int s = 0; s < GetNumSlots(); s++)
+    for (int s = 0; s < geom.numSlots; s++)
     {
         rid.slot = s;
         if (GetRec(rid, rec) != 0)
@@ -708,26 +985,16 @@ RC RM_FileHandle::ExpandPage(PageNum numPages)
 {
     RC rc = 0;
 
-    auto numS = GetNumSlots();
     PF_PageHandle ph;
-    RM_PageHdr pHdr(numS);
     PageNum thisp;
-    char *pData;
     while (pfh->GetNumPages() < numPages)
     {
-        if ((rc = pfh->AllocatePage(ph))
-            || (rc = ph.GetPageNum(thisp))
+        if ((rc = AllocateDataPage(ph, thisp))
             || (rc = pfh->UnpinPage(thisp)))
         {
             PF_PrintError(rc);
             return rc;
         }
-        hdr.numPages++;
-        bitmap b(numS);
-        b.set();
-        b.to_char_buf(pHdr.freeSlotMap, b.NumChars);
-        rc = SetPageHeader(ph, pHdr);
-        if (rc != 0) return rc;
     }
     bHdrChanged = true;
     return rc;
@@ -749,18 +1016,18 @@ RC RM_FileHandle::CopyNullFromOthers(RM_FileHandle &rhs)
     // This function should only works when adding new column
     // in table, in which we need to set the value in this column
     // of existing entries to be NULL. Therefore, the storage layouts 
-    // of 'rhs' and this should be the same.
+    // of 'rhs' and this should be the same, with or without an FSM.
     //
-    auto numSlots = rhs.GetNumSlots();
+    hdr.fsmMagic = rhs.hdr.fsmMagic;
+    SetGeom();
     rc = ExpandPage(rhs.pfh->GetNumPages());
     if (rc != 0) return rc;
     assert(this->GetNumPages() == rhs.GetNumPages());
 
     PF_PageHandle this_ph;
     PF_PageHandle rhs_ph;
-    RM_PageHdr rhs_pHdr(numSlots);
     PageNum p = (PageNum)-1;
-    char *ptr;
+    char *ptr, *this_ptr;
     while (1)
     {
         rc = this->pfh->GetNextPage(p, this_ph);
@@ -772,21 +1039,37 @@ RC RM_FileHandle::CopyNullFromOthers(RM_FileHandle &rhs)
         rc = rhs.PinPage(rhs_ph, p);
         assert(rc == 0);
 
-        if (p != 0)
+        if (IsFsmPage(p))
         {
-            rc = rhs.GetPageHeader(rhs_ph, rhs_pHdr);
+            if ((rc = rhs_ph.GetData(ptr))
+                || (rc = this_ph.GetData(this_ptr)))
+                return rc;
+            memcpy(this_ptr, ptr, RM_FSM_SPAN / 4);
+            rc = this->pfh->MarkDirty(p);
+            assert(rc == 0);
+        }else if (p != 0) {
+            rc = rhs_ph.GetData(ptr);
             if (rc != 0) return rc;
-            bitmap b(numSlots, rhs_pHdr.freeSlotMap);
+            RM_PageView rhs_view(ptr, rhs.geom);
 
-            for (int s = 0; s < numSlots; s++)
+            for (int s = rhs_view.FirstUsedSlot(0); s >= 0;
+                 s = rhs_view.FirstUsedSlot(s + 1))
             {
-                if (!b.test(s))
-                    continue;
-                rhs.GetSlotPointer(rhs_ph, s, ptr);
-                rec.Set(ptr, hdr.extRecordSize, RID(p, s));
+                rec.Set(rhs_view.GetSlot(s),
+                        hdr.extRecordSize, RID(p, s));
                 rc = this->UpdateRec(rec);
                 assert(rc == 0);
             }
+
+            // keep the free slots of 'rhs' too, so that later inserts
+            // go to the same pages in both files
+            rc = this_ph.GetData(this_ptr);
+            if (rc != 0) return rc;
+            RM_PageView view(this_ptr, geom);
+            view.NextFree() = rhs_view.NextFree();
+            view.NumFreeSlots() = rhs_view.NumFreeSlots();
+            rc = this->pfh->MarkDirty(p);
+            assert(rc == 0);
         }
 
         rc = rhs.UnpinPage(p);
@@ -795,12 +1078,15 @@ RC RM_FileHandle::CopyNullFromOthers(RM_FileHandle &rhs)
         rc = this->pfh->UnpinPage(p);
         assert(rc == 0);
     }
+    hdr.firstFree = rhs.hdr.firstFree;
+    bHdrChanged = true;
     return 0;
 }
 
 
 RC RM_FileHandle::PinPage(PF_PageHandle &ph, PageNum p)
 {
+    assert(numViews == 0);
     return pfh->GetThisPage(p, ph);
 }
 
@@ -83,3 +83,73 @@ bool RM_Record::IsNullValue() const
         return 0;
     }
 }
+
+
+RM_RecordView::RM_RecordView():rmfh(NULL), page(-1), pPage(NULL), data(NULL),
+    recordSize(-1), rid(-1,-1){}
+
+
+RM_RecordView::~RM_RecordView()
+{
+    Reset();
+}
+
+
+// Return the data corresponding to the record.  Sets *pData to the
+// record contents in the pinned page.
+RC RM_RecordView::GetData(const char *&pData) const
+{
+    if (data == NULL)
+    {
+        return (START_RM_ERR-2);
+    }
+
+    pData = data;
+    return 0;
+}
+
+
+// Return the RID associated with the record
+RC RM_RecordView::GetRid (RID &rid) const
+{
+    if (data == NULL)
+    {
+        return (START_RM_ERR-2);
+    }
+
+    rid = this->rid;
+    return 0;
+}
+
+
+//
+// check whether the data is NULL
+//
+bool RM_RecordView::IsNullValue() const
+{
+    if (data == NULL)
+        return 0;
+    for (int p = 0; p < recordSize; p++)
+    {
+        if (data[p] != 0x00)
+            return 0;
+    }
+    return 1;
+}
+
+
+//
+// unpin the page of the view, if any
+//
+void RM_RecordView::Reset()
+{
+    if (rmfh != NULL)
+    {
+        rmfh->pfh->UnpinPage(page);
+        rmfh->numViews--;
+    }
+    rmfh = NULL;
+    page = -1;
+    pPage = NULL;
+    data = NULL;
+}
@@ -63,15 +63,213 @@ void print()
 };
 
 
+//
+// SM return codes
+//
+#define SM_TABLEEXISTS     (START_SM_WARN + 0)  // table already exists
+#define SM_UNIX            (START_SM_ERR - 0)   // Unix error
+
+
+//
+// SM_TableInfo: schema of a table
+//
+struct SM_TableInfo {
+    vector<attrInfo> attrList;              // columns in order of definition
+    unordered_map<string, int> attrIndex;   // column name -> index in attrList
+};
+
+
+//
+// SM_Catalog: schemas of the tables in a database
+//
+// Each .scm file is parsed once, on first use.  Changes of a schema are
+// written through to its .scm file.
+//
+class SM_Catalog {
+private:
+    string dbPath;
+    unordered_map<string, SM_TableInfo> tables;
+
+    void GetScmFile(string &retName, string &tableName) const;
+
+public:
+    SM_Catalog(string &database_path);
+    ~SM_Catalog();
+
+    RC GetTable(string &tableName, SM_TableInfo *&table);
+    RC GetAttr(string &tableName, string &colName, attrInfo &info);
+    bool isValidTable(string &tableName);
+    bool isValidColumn(string &tableName, string &colName);
+
+    RC CreateTable(string &tableName, vector<attrInfo> &attrList);
+    RC UpdateTable(string &tableName, vector<attrInfo> &attrList);
+    RC DropTable(string &tableName);
+    RC RenameTable(string &oldName, string &newName);
+};
+
+
+// Max number of RIDs an SM_RidList keeps in memory, 8 bytes each
+#define SM_RIDLIST_MEM (1 << 20)
+
+//
+// SM_RidList: RIDs passed between the stages of a query
+//
+// RIDs are packed into 64 bits and returned sorted by page, then slot,
+// so the records are fetched a page at a time.  Past maxMem RIDs the
+// list spills its memory as a sorted run to a binary temporary file;
+// the runs are merged when the list is read.
+//
+class SM_RidList {
+private:
+    vector<uint64_t> mem;       // RIDs not spilled yet
+    vector<FILE *> runs;        // sorted runs spilled to temporary files
+    size_t maxMem;
+    long long numRids;
+    bool bSorted;               // whether mem is sorted
+
+    // read state
+    size_t memPos;
+    vector<uint64_t> runHeads;
+    vector<bool> runLive;
+
+    RC Spill();
+
+public:
+    SM_RidList(size_t _maxMem = SM_RIDLIST_MEM);
+    ~SM_RidList();
+
+    RC Add(const RID &rid);
+    RC Rewind();                // start reading from the first RID
+    bool Next(RID &rid);        // false once all RIDs are read
+    void Clear();
+    void Swap(SM_RidList &rhs);
+    long long GetNumRids() const { return numRids; }
+};
+
+
+//
+// SM_RidSet: a set of RIDs for combining predicates
+//
+// The set keeps a slot bitmap for each page holding one of its RIDs,
+// laid out as RM_PageHdr::freeSlotMap: bit s%8 of byte s/8 stands for
+// slot s.  The bitmaps of all pages are padded to the same multiple of
+// 16 bytes, so And, Or and AndNot work on 128-bit words.
+//
+class SM_RidSet {
+private:
+    vector<PageNum> pages;      // pages with RIDs, sorted once bSorted
+    vector<uint8_t> bits;       // slot bitmap of pages[i] at i*mapBytes
+    unordered_map<PageNum, int> blockOf;
+    int mapBytes;
+    bool bSorted;
+
+    // read state
+    size_t iterBlock;
+    int iterSlot;
+
+    uint8_t *GetBlock(PageNum p);
+    void Widen(int numBytes);
+    void Sort();
+    template <int op> void Combine(SM_RidSet &rhs);
+
+public:
+    SM_RidSet();
+    ~SM_RidSet();
+
+    RC Add(const RID &rid);
+    void AddPage(PageNum p, const char *slotMap, int numSlots);
+    bool Contains(const RID &rid) const;
+
+    void And(SM_RidSet &rhs);       // keep the RIDs also in rhs
+    void Or(SM_RidSet &rhs);        // add the RIDs in rhs
+    void AndNot(SM_RidSet &rhs);    // remove the RIDs in rhs
+
+    RC Rewind();                // start reading from the first RID
+    bool Next(RID &rid);        // false once all RIDs are read
+    RC ToList(SM_RidList &rids);
+    void Clear();
+    void Swap(SM_RidSet &rhs);
+    long long GetNumRids() const;
+};
+
+
+//
+// SM_Cond: a 'column op value' predicate of a where clause
+//
+struct SM_Cond {
+    string column;
+    CompOp op;
+    string value;
+};
+
+// While a conjunction has at most this many candidate RIDs, SelectWhere
+// checks the next predicate on their records instead of scanning its index
+#define SM_FILTER_MAX_RIDS 1024
+
+
+//
+// SM_OpenFile: a .data or .index file kept open by SM_TableHandle
+//
+struct SM_OpenFile {
+    string tableName;
+    string fileName;
+    RM_FileHandle  *rmfh;   // set for .data files
+    IX_IndexHandle *ixfh;   // set for .index files
+    bool pinned;            // used by the running operation, see SM_FilePins
+};
+
+
+class SM_TableHandle;
+
+//
+// SM_FilePins: while one lives, the files an SM_TableHandle operation
+// opens are pinned in its cache, so that opening another one does not
+// close a handle the operation still holds
+//
+class SM_FilePins {
+private:
+    SM_TableHandle &th;
+public:
+    SM_FilePins(SM_TableHandle &_th);
+    ~SM_FilePins();
+};
+
+
+// Number of rows LoadData parses before appending them to the .data files
+#define SM_LOAD_CHUNK_ROWS 4096
+
+// Max number of .data and .index files SM_TableHandle keeps open.
+// Each open file holds one file descriptor.
+#define SM_MAX_OPEN_FILES 64
+
+
 class SM_TableHandle {
 private:
     string dbPath;
+    SM_Catalog catalog;
+
+    // open files, most recently used first
+    list<SM_OpenFile> openFiles;
+    unordered_map<string, list<SM_OpenFile>::iterator> openFileMap;
+    int maxOpenFiles;
+    int pinDepth;           // number of live SM_FilePins
+
+    friend class SM_FilePins;
+
+    RC GetRMHandle(string &tableName, string &columnName, RM_FileHandle *&rmfh);
+    RC GetIXHandle(string &tableName, string &columnName, IX_IndexHandle *&ixfh);
+    RC OpenCachedFile(string &tableName, string &fileName, bool bIndex,
+                      list<SM_OpenFile>::iterator &iter);
+    RC CloseCachedFile(list<SM_OpenFile>::iterator iter);
+    RC CloseTableFiles(string &tableName);
 
 public:
 
-    SM_TableHandle(string &database_path);
+    SM_TableHandle(string &database_path, int _maxOpenFiles = SM_MAX_OPEN_FILES);
     ~SM_TableHandle();
 
+    SM_Catalog &GetCatalog() { return catalog; }
+
     RC CreateTable(string &tableName, vector<attrInfo> *attrList = NULL);
     RC DropTable(string &tableName);
     RC ClearTable(string &tableName);
@@ -80,18 +278,26 @@ public:
     RC AddColumn(string &tableName, attrInfo &colinfo);
     RC DropColumn(string &tableName, string &colName);
     RC RenameColumn(string &tableName, string &oldName, string &newName);
+    RC RebuildIndex(string &tableName, string &colName);
+    RC LoadData(string &tableName, string &csvFile, long long &numRows);
 
     RC InsertEntry(string &tableName, map<string,string> &entry, RID &_rid);
     RC DeleteEntry(string &tableName, vector<RID> &rids);
-    RC DeleteEntry(string &tableName, string &RidFile);
+    RC DeleteEntry(string &tableName, SM_RidList &rids);
     RC UpdateEntry(string &tableName, RID rid, map<string,string> &entry);
-    RC SelectEntry(string &tableName, string &retFile, string &column, CompOp &op, void *&cmpKey);
-    RC SelectEntry(string &tableName, string &retFile, string &column, CompOp &op, string &value);
-    RC SelectEntry_from_file(string &tableName, string &retFile, string &column, CompOp &op, void *&cmpKey);
+    RC SelectEntry(string &tableName, SM_RidList &rids, string &column, CompOp &op, void *&cmpKey);
+    RC SelectEntry(string &tableName, SM_RidList &rids, string &column, CompOp &op, string &value);
+    RC SelectEntry_from_list(string &tableName, SM_RidList &rids, string &column, CompOp &op, void *&cmpKey);
+    RC SelectEntry_from_set(string &tableName, SM_RidSet &rids, string &column, CompOp &op, string &value);
+    RC SelectWhere(string &tableName, vector<vector<SM_Cond>> &where, SM_RidSet &rids);
+    RC SelectEntry(string &tableName, SM_RidSet &rids, string &column, CompOp &op, void *&cmpKey);
+    RC SelectEntry(string &tableName, SM_RidSet &rids, string &column, CompOp &op, string &value);
+    RC SelectAll(string &tableName, SM_RidList &rids);
+    RC SelectAll(string &tableName, SM_RidSet &rids);
 
     RC DetailTable(string &tableName);
-    RC WriteValue(string &tableName, vector<string> &colList, string &outFile, string &RidFile);
-    RC WriteValue(string &tableName, vector<string> &colList, string &outFile);
+    RC WriteValue(string &tableName, vector<string> &colList, FILE *fp, SM_RidList &rids);
+    RC WriteValue(string &tableName, vector<string> &colList, FILE *fp);
 
     void GetScmFile(string &retFile, string &tableName) const;
     void GetRMFile(string &retFile, string &tableName, string &columnName) const;
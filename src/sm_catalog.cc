@@ -0,0 +1,216 @@
+//
+// File:        sm_catalog.cc
+//
+// Description: SM_Catalog class implementation
+//
+// Author:     Haris Wang (dynmiw@gmail.com)
+//
+//
+#include "sm.h"
+#include <unistd.h>
+#include <bits/stdc++.h>
+
+
+static void read_scm(const char *scmPath, vector<attrInfo> &attrList)
+{
+    int attrNum;
+    FILE *fp = fopen(scmPath, "r");
+    fscanf(fp, "%d", &attrNum);
+    attrInfo tmp;
+    char *cname = new char[256];
+    int type;
+    for (int i = 0; i < attrNum; i++)
+    {
+        fscanf(fp, "%255s %d %d",
+                 cname,
+                 &type,
+                 &(tmp.length));
+        tmp.name = cname;
+        tmp.type = (AttrType)type;
+        attrList.push_back(tmp);
+    }
+    delete[] cname;
+    fclose(fp);
+}
+
+
+static void write_scm(const char *scmPath, vector<attrInfo> &attrList)
+{
+    FILE *fp = fopen(scmPath, "w");
+    fprintf(fp, "%zu\n", attrList.size());
+    for (size_t i = 0; i < attrList.size(); i++)
+    {
+        fprintf(fp, "%s %d %d\n",
+                    attrList[i].name.c_str(),
+                    (int)attrList[i].type,
+                    attrList[i].length);
+    }
+    fclose(fp);
+}
+
+
+// rebuild the column name lookup of 'table'
+static void index_attrs(SM_TableInfo &table)
+{
+    table.attrIndex.clear();
+    for (size_t i = 0; i < table.attrList.size(); i++)
+        table.attrIndex[table.attrList[i].name] = i;
+}
+
+
+SM_Catalog::SM_Catalog(string &database_path)
+{
+    this->dbPath = database_path;
+}
+
+
+SM_Catalog::~SM_Catalog()
+{
+
+}
+
+
+void SM_Catalog::GetScmFile(string &retName, string &tableName) const
+{
+    retName = dbPath + tableName + SCHEMA_SUFFIX;
+}
+
+
+//
+// set 'table' to the schema of given table.
+// The .scm file is parsed on first use only.
+// return 0 if success
+// return 1 if no such table
+//
+RC SM_Catalog::GetTable(string &tableName, SM_TableInfo *&table)
+{
+    auto iter = tables.find(tableName);
+    if (iter != tables.end())
+    {
+        table = &(iter->second);
+        return 0;
+    }
+
+    string filename;
+    GetScmFile(filename, tableName);
+    if (access(filename.c_str(), 0) != 0)
+        return 1;
+
+    table = &tables[tableName];
+    read_scm(filename.c_str(), table->attrList);
+    index_attrs(*table);
+    return 0;
+}
+
+
+//
+// set 'info' to the definition of given column
+// return 0 if success
+// return 1 if no such table
+// return -1 if no such column
+//
+RC SM_Catalog::GetAttr(string &tableName, string &colName, attrInfo &info)
+{
+    SM_TableInfo *table;
+    if (GetTable(tableName, table) != 0)
+        return 1;
+
+    auto iter = table->attrIndex.find(colName);
+    if (iter == table->attrIndex.end())
+        return -1;
+    info = table->attrList[iter->second];
+    return 0;
+}
+
+
+bool SM_Catalog::isValidTable(string &tableName)
+{
+    SM_TableInfo *table;
+    return GetTable(tableName, table) == 0;
+}
+
+
+bool SM_Catalog::isValidColumn(string &tableName, string &colName)
+{
+    SM_TableInfo *table;
+    if (GetTable(tableName, table) != 0)
+        return 0;
+    return table->attrIndex.count(colName) != 0;
+}
+
+
+//
+// write the .scm file of a new table
+// return 1 if table already exists
+// return 0 if success
+//
+RC SM_Catalog::CreateTable(string &tableName, vector<attrInfo> &attrList)
+{
+    string filename;
+    GetScmFile(filename, tableName);
+    if (access(filename.c_str(), 0) == 0)
+        return 1;
+
+    SM_TableInfo &table = tables[tableName];
+    table.attrList = attrList;
+    index_attrs(table);
+    write_scm(filename.c_str(), attrList);
+    return 0;
+}
+
+
+//
+// replace the columns of given table and rewrite its .scm file
+// return 0 if success
+// return 1 if no such table
+//
+RC SM_Catalog::UpdateTable(string &tableName, vector<attrInfo> &attrList)
+{
+    SM_TableInfo *table;
+    if (GetTable(tableName, table) != 0)
+        return 1;
+
+    string filename;
+    GetScmFile(filename, tableName);
+    table->attrList = attrList;
+    index_attrs(*table);
+    write_scm(filename.c_str(), attrList);
+    return 0;
+}
+
+
+//
+// remove the .scm file of given table
+// return 0 if success
+// return 1 if it can not be removed
+//
+RC SM_Catalog::DropTable(string &tableName)
+{
+    string filename;
+    GetScmFile(filename, tableName);
+    tables.erase(tableName);
+    if (remove(filename.c_str()) != 0)
+        return 1;
+    return 0;
+}
+
+
+//
+// rename the .scm file of given table
+// return 0 if success
+// return SM_TABLEEXISTS if a table 'newName' already exists
+// return SM_UNIX if the .scm file can not be renamed
+//
+RC SM_Catalog::RenameTable(string &oldName, string &newName)
+{
+    string oldFile, newFile;
+    GetScmFile(oldFile, oldName);
+    GetScmFile(newFile, newName);
+    if (access(newFile.c_str(), 0) == 0)
+        return SM_TABLEEXISTS;
+    if (rename(oldFile.c_str(), newFile.c_str()) != 0)
+        return SM_UNIX;
+    tables.erase(oldName);
+    tables.erase(newName);
+    return 0;
+}
@@ -0,0 +1,171 @@
+//
+// File:        sm_ridlist.cc
+//
+// Description: SM_RidList class implementation
+//
+// Author:     Haris Wang (dynmiw@gmail.com)
+//
+//
+#include "sm.h"
+#include <bits/stdc++.h>
+
+
+static inline uint64_t pack_rid(const RID &rid)
+{
+    return ((uint64_t)(uint32_t)rid.page << 32) | (uint32_t)rid.slot;
+}
+
+
+static inline RID unpack_rid(uint64_t v)
+{
+    return RID((PageNum)(v >> 32), (SlotNum)(v & 0xffffffff));
+}
+
+
+SM_RidList::SM_RidList(size_t _maxMem)
+{
+    this->maxMem = max(_maxMem, (size_t)1);
+    this->numRids = 0;
+    this->bSorted = true;
+    this->memPos = 0;
+}
+
+
+SM_RidList::~SM_RidList()
+{
+    Clear();
+}
+
+
+//
+// remove all RIDs
+//
+void SM_RidList::Clear()
+{
+    for (int i = 0; i < runs.size(); i++)
+        fclose(runs[i]);
+    runs.clear();
+    runHeads.clear();
+    runLive.clear();
+    mem.clear();
+    numRids = 0;
+    bSorted = true;
+    memPos = 0;
+}
+
+
+void SM_RidList::Swap(SM_RidList &rhs)
+{
+    mem.swap(rhs.mem);
+    runs.swap(rhs.runs);
+    runHeads.swap(rhs.runHeads);
+    runLive.swap(rhs.runLive);
+    swap(maxMem, rhs.maxMem);
+    swap(numRids, rhs.numRids);
+    swap(bSorted, rhs.bSorted);
+    swap(memPos, rhs.memPos);
+}
+
+
+//
+// write the RIDs in memory to a new sorted run
+// return 0 if success
+// return -1 if the run can not be written
+//
+RC SM_RidList::Spill()
+{
+    sort(mem.begin(), mem.end());
+    FILE *fp = tmpfile();
+    if (fp == NULL)
+        return -1;
+    if (fwrite(mem.data(), sizeof(uint64_t), mem.size(), fp) != mem.size())
+    {
+        fclose(fp);
+        return -1;
+    }
+    runs.push_back(fp);
+    mem.clear();
+    bSorted = true;
+    return 0;
+}
+
+
+//
+// add 'rid' to the list
+// return 0 if success
+// return -1 if the list can not spill to disk
+//
+RC SM_RidList::Add(const RID &rid)
+{
+    RC rc;
+    if (mem.size() == maxMem && (rc = Spill()))
+        return rc;
+
+    uint64_t v = pack_rid(rid);
+    if (!mem.empty() && v < mem.back())
+        bSorted = false;
+    mem.push_back(v);
+    numRids++;
+    return 0;
+}
+
+
+//
+// sort the list and start reading from its first RID.
+// RIDs added afterwards are only seen after the next Rewind.
+// return 0 if success
+//
+RC SM_RidList::Rewind()
+{
+    if (!bSorted)
+    {
+        sort(mem.begin(), mem.end());
+        bSorted = true;
+    }
+    memPos = 0;
+
+    runHeads.assign(runs.size(), 0);
+    runLive.assign(runs.size(), false);
+    for (int i = 0; i < runs.size(); i++)
+    {
+        rewind(runs[i]);
+        runLive[i] = fread(&runHeads[i], sizeof(uint64_t), 1, runs[i]) == 1;
+    }
+    return 0;
+}
+
+
+//
+// set 'rid' to the next RID in sorted order
+// return false if there is no more RID
+//
+bool SM_RidList::Next(RID &rid)
+{
+    if (runs.empty())
+    {
+        if (memPos >= mem.size())
+            return false;
+        rid = unpack_rid(mem[memPos++]);
+        return true;
+    }
+
+    // merge the runs with the RIDs still in memory
+    int best = -1;
+    for (int i = 0; i < runs.size(); i++)
+    {
+        if (runLive[i] && (best == -1 || runHeads[i] < runHeads[best]))
+            best = i;
+    }
+    if (memPos < mem.size()
+        && (best == -1 || mem[memPos] < runHeads[best]))
+    {
+        rid = unpack_rid(mem[memPos++]);
+        return true;
+    }
+    if (best == -1)
+        return false;
+
+    rid = unpack_rid(runHeads[best]);
+    runLive[best] = fread(&runHeads[best], sizeof(uint64_t), 1, runs[best]) == 1;
+    return true;
+}
@@ -0,0 +1,346 @@
+//
+// File:        sm_ridset.cc
+//
+// Description: SM_RidSet class implementation
+//
+// Author:     Haris Wang (dynmiw@gmail.com)
+//
+//
+#include "sm.h"
+#include <bits/stdc++.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// the slot bitmaps are padded to a multiple of this many bytes
+#define SM_RIDSET_ALIGN 16
+
+enum { SET_AND, SET_OR, SET_ANDNOT };
+
+
+//
+// dst = dst op src over n bytes, n a multiple of SM_RIDSET_ALIGN.
+// return whether any bit of dst is left set
+//
+template <int op>
+static inline bool combine_block(uint8_t *dst, const uint8_t *src, int n)
+{
+#ifdef __SSE2__
+    __m128i any = _mm_setzero_si128();
+    for (int i = 0; i < n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        switch (op)
+        {
+        case SET_AND:    a = _mm_and_si128(a, b); break;
+        case SET_OR:     a = _mm_or_si128(a, b); break;
+        case SET_ANDNOT: a = _mm_andnot_si128(b, a); break;
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+        any = _mm_or_si128(any, a);
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF;
+#else
+    uint64_t any = 0;
+    for (int i = 0; i < n; i += 8)
+    {
+        uint64_t a, b;
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        switch (op)
+        {
+        case SET_AND:    a &= b; break;
+        case SET_OR:     a |= b; break;
+        case SET_ANDNOT: a &= ~b; break;
+        }
+        memcpy(dst + i, &a, 8);
+        any |= a;
+    }
+    return any != 0;
+#endif
+}
+
+
+SM_RidSet::SM_RidSet()
+{
+    this->mapBytes = SM_RIDSET_ALIGN;
+    this->bSorted = true;
+    this->iterBlock = 0;
+    this->iterSlot = 0;
+}
+
+
+SM_RidSet::~SM_RidSet()
+{
+
+}
+
+
+void SM_RidSet::Clear()
+{
+    pages.clear();
+    bits.clear();
+    blockOf.clear();
+    bSorted = true;
+    iterBlock = 0;
+    iterSlot = 0;
+}
+
+
+void SM_RidSet::Swap(SM_RidSet &rhs)
+{
+    pages.swap(rhs.pages);
+    bits.swap(rhs.bits);
+    blockOf.swap(rhs.blockOf);
+    swap(mapBytes, rhs.mapBytes);
+    swap(bSorted, rhs.bSorted);
+    swap(iterBlock, rhs.iterBlock);
+    swap(iterSlot, rhs.iterSlot);
+}
+
+
+//
+// pad the slot bitmaps to hold at least 'numBytes' bytes
+//
+void SM_RidSet::Widen(int numBytes)
+{
+    if (numBytes <= mapBytes)
+        return;
+    int newBytes = (numBytes + SM_RIDSET_ALIGN - 1) / SM_RIDSET_ALIGN * SM_RIDSET_ALIGN;
+    vector<uint8_t> grown(pages.size() * newBytes, 0);
+    for (size_t i = 0; i < pages.size(); i++)
+        memcpy(&grown[i * newBytes], &bits[i * mapBytes], mapBytes);
+    bits.swap(grown);
+    mapBytes = newBytes;
+}
+
+
+//
+// return the slot bitmap of page 'p', added empty if not in the set
+//
+uint8_t *SM_RidSet::GetBlock(PageNum p)
+{
+    auto iter = blockOf.find(p);
+    if (iter != blockOf.end())
+        return &bits[iter->second * mapBytes];
+
+    if (!pages.empty() && p < pages.back())
+        bSorted = false;
+    blockOf[p] = pages.size();
+    pages.push_back(p);
+    bits.resize(bits.size() + mapBytes, 0);
+    return &bits[(pages.size() - 1) * mapBytes];
+}
+
+
+//
+// order the pages by number
+//
+void SM_RidSet::Sort()
+{
+    if (bSorted)
+        return;
+    vector<int> order(pages.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    sort(order.begin(), order.end(),
+         [this](int a, int b) { return pages[a] < pages[b]; });
+
+    vector<PageNum> sortedPages(pages.size());
+    vector<uint8_t> sortedBits(bits.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        sortedPages[i] = pages[order[i]];
+        memcpy(&sortedBits[i * mapBytes], &bits[order[i] * mapBytes], mapBytes);
+        blockOf[sortedPages[i]] = i;
+    }
+    pages.swap(sortedPages);
+    bits.swap(sortedBits);
+    bSorted = true;
+}
+
+
+RC SM_RidSet::Add(const RID &rid)
+{
+    Widen(rid.slot / 8 + 1);
+    uint8_t *block = GetBlock(rid.page);
+    block[rid.slot / 8] |= 1 << (rid.slot % 8);
+    return 0;
+}
+
+
+//
+// add the RIDs of page 'p' given by the slot map of its RM page header
+//
+void SM_RidSet::AddPage(PageNum p, const char *slotMap, int numSlots)
+{
+    int numBytes = (numSlots + 7) / 8;
+    Widen(numBytes);
+    uint8_t *block = GetBlock(p);
+    for (int i = 0; i < numBytes; i++)
+        block[i] |= (uint8_t)slotMap[i];
+}
+
+
+bool SM_RidSet::Contains(const RID &rid) const
+{
+    auto iter = blockOf.find(rid.page);
+    if (iter == blockOf.end() || rid.slot / 8 >= mapBytes)
+        return false;
+    return bits[iter->second * mapBytes + rid.slot / 8] & (1 << (rid.slot % 8));
+}
+
+
+//
+// combine this set with 'rhs' page by page; pages left without RIDs
+// are dropped
+//
+template <int op>
+void SM_RidSet::Combine(SM_RidSet &rhs)
+{
+    Widen(rhs.mapBytes);
+    Sort();
+    rhs.Sort();
+
+    vector<PageNum> outPages;
+    vector<uint8_t> outBits;
+    outPages.reserve(op == SET_AND ? min(pages.size(), rhs.pages.size())
+                                   : pages.size());
+    size_t i = 0, j = 0;
+    while (i < pages.size() || j < rhs.pages.size())
+    {
+        bool bMine = j == rhs.pages.size()
+                     || (i < pages.size() && pages[i] <= rhs.pages[j]);
+        bool bTheirs = i == pages.size()
+                       || (j < rhs.pages.size() && rhs.pages[j] <= pages[i]);
+        size_t at = outBits.size();
+        if (bMine && bTheirs)
+        {
+            // both sets hold this page
+            outBits.insert(outBits.end(), &bits[i * mapBytes],
+                           &bits[i * mapBytes] + mapBytes);
+            bool bAny = combine_block<op>(&outBits[at], &rhs.bits[j * rhs.mapBytes],
+                                          rhs.mapBytes);
+            // bits past the end of rhs' bitmaps are zero in rhs
+            if (op == SET_AND && rhs.mapBytes < mapBytes)
+                memset(&outBits[at + rhs.mapBytes], 0, mapBytes - rhs.mapBytes);
+            else if (op != SET_AND && !bAny)
+                bAny = any_of(&outBits[at], &outBits[at] + mapBytes,
+                              [](uint8_t b) { return b != 0; });
+            if (bAny)
+                outPages.push_back(pages[i]);
+            else
+                outBits.resize(at);
+            i++;
+            j++;
+        }else if (bMine) {
+            if (op != SET_AND)
+            {
+                outPages.push_back(pages[i]);
+                outBits.insert(outBits.end(), &bits[i * mapBytes],
+                               &bits[i * mapBytes] + mapBytes);
+            }
+            i++;
+        }else {
+            if (op == SET_OR)
+            {
+                outPages.push_back(rhs.pages[j]);
+                outBits.resize(at + mapBytes, 0);
+                memcpy(&outBits[at], &rhs.bits[j * rhs.mapBytes], rhs.mapBytes);
+            }
+            j++;
+        }
+    }
+
+    pages.swap(outPages);
+    bits.swap(outBits);
+    blockOf.clear();
+    for (size_t k = 0; k < pages.size(); k++)
+        blockOf[pages[k]] = k;
+}
+
+
+void SM_RidSet::And(SM_RidSet &rhs)
+{
+    Combine<SET_AND>(rhs);
+}
+
+
+void SM_RidSet::Or(SM_RidSet &rhs)
+{
+    Combine<SET_OR>(rhs);
+}
+
+
+void SM_RidSet::AndNot(SM_RidSet &rhs)
+{
+    Combine<SET_ANDNOT>(rhs);
+}
+
+
+long long SM_RidSet::GetNumRids() const
+{
+    long long cnt = 0;
+    for (size_t i = 0; i + 8 <= bits.size(); i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, &bits[i], 8);
+        cnt += __builtin_popcountll(w);
+    }
+    return cnt;
+}
+
+
+//
+// start reading from the first RID, in order of page then slot
+//
+RC SM_RidSet::Rewind()
+{
+    Sort();
+    iterBlock = 0;
+    iterSlot = 0;
+    return 0;
+}
+
+
+//
+// set 'rid' to the next RID
+// return false if there is no more RID
+//
+bool SM_RidSet::Next(RID &rid)
+{
+    while (iterBlock < pages.size())
+    {
+        // skip to the next set bit a word at a time
+        const char *block = (const char *)&bits[iterBlock * mapBytes];
+        int s = bitmap::FindSet(block, mapBytes * 8, iterSlot);
+        if (s >= 0)
+        {
+            iterSlot = s + 1;
+            rid = RID(pages[iterBlock], s);
+            return true;
+        }
+        iterBlock++;
+        iterSlot = 0;
+    }
+    return false;
+}
+
+
+//
+// add all RIDs of this set to 'rids'
+// return 0 if success
+//
+RC SM_RidSet::ToList(SM_RidList &rids)
+{
+    RC rc;
+    RID rid;
+    Rewind();
+    while (Next(rid))
+    {
+        if ((rc = rids.Add(rid)))
+            return rc;
+    }
+    return 0;
+}
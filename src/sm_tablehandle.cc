@@ -27,80 +27,41 @@ void list_files(const char *PATH, vector<string> &list)
 }
 
 
-void read_scm(const char *scmPath, vector<attrInfo> &attrList)
-{
-    int attrNum;
-    FILE *fp = fopen(scmPath, "r");
-    fscanf(fp, "%d", &attrNum);
-    attrInfo tmp;
-    char *cname = new char[256];
-    for (int i = 0; i < attrNum; i++)
-    {
-        fscanf(fp, "%s %d %d", 
-                 cname, 
-                 &(tmp.type), 
-                 &(tmp.length));
-        tmp.name = cname;
-        attrList.push_back(tmp);
-    }
-    delete cname;
-    fclose(fp);
-}
-
-
-void write_scm(const char *scmPath, vector<attrInfo> &attrList)
-{
-    FILE *fp = fopen(scmPath, "w");
-    fprintf(fp, "%d\n", attrList.size());
-    for (int i = 0; i < attrList.size(); i++)
-    {
-        fprintf(fp, "%s %d %d\n", 
-                    attrList[i].name.c_str(), 
-                    attrList[i].type, 
-                    attrList[i].length);
-    }
-    fclose(fp);
-}
-
-
-RC get_attr_from_scm(const char *scmPath, string &name, attrInfo &info)
+//
+// add the RIDs of all records in given .data file to 'rids'
+// return 0 if success
+//
+static RC collect_rids(RM_FileHandle *rmfh, SM_RidList &rids)
 {
-    FILE *fp = fopen(scmPath, "r");
-    int num;
-    fscanf(fp, "%d", &num);
-    int p = 0;
-    char *cname = new char[256];
-    while (p < num)
-    {
-        fscanf(fp, "%s %d %d", 
-                 cname, 
-                 &(info.type), 
-                 &(info.length));
-        if (cname == name)
-            break;
-        p++;
-    }
-    delete cname;
-    fclose(fp);
-
-    if (p == num)
+    RC rc;
+    PageNum p = -1;
+    int numRids;
+    RID *pageRids = new RID[rmfh->GetNumSlots()];
+    while ((rc = rmfh->GetNextRids(p, pageRids, numRids)) == 0)
     {
-        return -1;
-    }else {
-        return 0;
+        for (int i = 0; i < numRids && rc == 0; i++)
+            rc = rids.Add(pageRids[i]);
+        if (rc != 0) break;
     }
+    delete[] pageRids;
+    return rc == PF_EOF ? 0 : rc;
 }
 
 
-SM_TableHandle::SM_TableHandle(string &database_path)
+SM_TableHandle::SM_TableHandle(string &database_path, int _maxOpenFiles)
+    : catalog(database_path)
 {
     this->dbPath = database_path;
+    // a column may need its .data and .index file open at the same time
+    this->maxOpenFiles = max(_maxOpenFiles, 2);
+    this->pinDepth = 0;
 }
 
 
 SM_TableHandle::~SM_TableHandle()
 {
-    
+    while (!openFiles.empty())
+        CloseCachedFile(openFiles.begin());
 }
 
 
@@ -123,6 +84,142 @@ void SM_TableHandle::GetIXFile(string &retName, string &tableName, string &colum
 }
 
 
+//
+// Open files are kept in 'openFiles', most recently used first, so that
+// statements touching the same columns do not open and close them (and
+// re-read their headers) each time.  When more than 'maxOpenFiles' are
+// open the least recently used one is closed, unless it is pinned by an
+// SM_FilePins of the running operation: then the cache grows past
+// 'maxOpenFiles' until the operation is done.  DDL closes every file of
+// the table before changing it.
+//
+
+SM_FilePins::SM_FilePins(SM_TableHandle &_th)
+    : th(_th)
+{
+    th.pinDepth++;
+}
+
+SM_FilePins::~SM_FilePins()
+{
+    if (--th.pinDepth > 0)
+        return;
+    for (auto iter = th.openFiles.begin(); iter != th.openFiles.end(); iter++)
+        iter->pinned = false;
+}
+
+// set 'rmfh' to the open .data file of given column
+RC SM_TableHandle::GetRMHandle(string &tableName, string &columnName, RM_FileHandle *&rmfh)
+{
+    RC rc;
+    string filename;
+    list<SM_OpenFile>::iterator iter;
+    GetRMFile(filename, tableName, columnName);
+    if ((rc = OpenCachedFile(tableName, filename, false, iter)))
+        return rc;
+    rmfh = iter->rmfh;
+    return 0;
+}
+
+// set 'ixfh' to the open .index file of given column
+RC SM_TableHandle::GetIXHandle(string &tableName, string &columnName, IX_IndexHandle *&ixfh)
+{
+    RC rc;
+    string filename;
+    list<SM_OpenFile>::iterator iter;
+    GetIXFile(filename, tableName, columnName);
+    if ((rc = OpenCachedFile(tableName, filename, true, iter)))
+        return rc;
+    ixfh = iter->ixfh;
+    return 0;
+}
+
+// find 'fileName' in the cache or open it, and move it to the front
+RC SM_TableHandle::OpenCachedFile(string &tableName, string &fileName, bool bIndex,
+                                  list<SM_OpenFile>::iterator &iter)
+{
+    RC rc;
+    auto found = openFileMap.find(fileName);
+    if (found != openFileMap.end())
+    {
+        iter = found->second;
+        openFiles.splice(openFiles.begin(), openFiles, iter);
+        iter->pinned = pinDepth > 0;
+        return 0;
+    }
+
+    // close the least recently used files that are not pinned
+    auto victim = openFiles.end();
+    while (openFiles.size() >= maxOpenFiles && victim != openFiles.begin())
+    {
+        auto cur = prev(victim);
+        if (cur->pinned)
+            victim = cur;
+        else if ((rc = CloseCachedFile(cur)))
+            return rc;
+    }
+
+    SM_OpenFile file;
+    file.tableName = tableName;
+    file.fileName = fileName;
+    file.rmfh = NULL;
+    file.ixfh = NULL;
+    file.pinned = pinDepth > 0;
+    if (bIndex)
+    {
+        file.ixfh = new IX_IndexHandle;
+        rc = file.ixfh->OpenIndex(fileName.c_str());
+    }else {
+        file.rmfh = new RM_FileHandle;
+        rc = file.rmfh->OpenRMFile(fileName.c_str());
+    }
+    if (rc != 0)
+    {
+        delete file.ixfh;
+        delete file.rmfh;
+        return rc;
+    }
+
+    openFiles.push_front(file);
+    iter = openFiles.begin();
+    openFileMap[fileName] = iter;
+    return 0;
+}
+
+// close the file and drop it from the cache
+RC SM_TableHandle::CloseCachedFile(list<SM_OpenFile>::iterator iter)
+{
+    RC rc;
+    if (iter->ixfh != NULL)
+    {
+        rc = iter->ixfh->CloseIndex();
+        delete iter->ixfh;
+    }else {
+        rc = iter->rmfh->CloseRMFile();
+        delete iter->rmfh;
+    }
+    openFileMap.erase(iter->fileName);
+    openFiles.erase(iter);
+    return rc;
+}
+
+// close every cached file of given table
+RC SM_TableHandle::CloseTableFiles(string &tableName)
+{
+    RC rc = 0, tmp;
+    auto iter = openFiles.begin();
+    while (iter != openFiles.end())
+    {
+        auto next_iter = next(iter);
+        if (iter->tableName == tableName
+            && (tmp = CloseCachedFile(iter)) != 0)
+            rc = tmp;
+        iter = next_iter;
+    }
+    return rc;
+}
+
+
 // 
 // create table as instructed. 
 // <tableName>.scm file will be created. For each attribution in attrList, 
@@ -136,16 +233,11 @@ RC SM_TableHandle::CreateTable(string &tableName, vector<attrInfo> *attrList)
 {
     RC rc = 0;
     string filename;
-    GetScmFile(filename, tableName);
-    int fexist = access(filename.c_str(), 0);
-    if (fexist == 0) return 1;
-    if (attrList == NULL)
+    vector<attrInfo> noAttrs;
+    if (catalog.CreateTable(tableName, attrList == NULL ? noAttrs : *attrList))
+        return 1;
+    if (attrList != NULL)
     {
-        FILE *fp = fopen(filename.c_str(), "w");
-        fprintf(fp, "0\n");
-        fclose(fp);
-    }else {
-        write_scm(filename.c_str(), *attrList);
         for (auto iter = attrList->begin(); iter != attrList->end(); iter++)
         {
             GetRMFile(filename, tableName, iter->name);
@@ -175,11 +267,14 @@ RC SM_TableHandle::DropTable(string &tableName)
 {
     RC rc = 0;
     string filename;
+    if ((rc = CloseTableFiles(tableName)))
+        return rc;
 
-    vector<attrInfo> attrList;
-    GetScmFile(filename, tableName);
-    read_scm(filename.c_str(), attrList);
-    rc = remove(filename.c_str());
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> attrList = table->attrList;
+    rc = catalog.DropTable(tableName);
     if (rc != 0) return 1;
 
     for (auto iter = attrList.begin(); iter != attrList.end(); iter++)
@@ -204,9 +299,12 @@ RC SM_TableHandle::ClearTable(string &tableName)
 {
     RC rc = 0;
     string filename;
-    vector<attrInfo> attrList;
-    GetScmFile(filename, tableName);
-    read_scm(filename.c_str(), attrList);
+    if ((rc = CloseTableFiles(tableName)))
+        return rc;
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> &attrList = table->attrList;
 
     for (auto iter = attrList.begin(); iter != attrList.end(); iter++)
     {
@@ -231,6 +329,10 @@ RC SM_TableHandle::RenameTable(string &oldName, string &newName)
     string cmpStr = oldName + ".";
     int len_cmpStr = cmpStr.size();
     vector<string> files;
+    if ((rc = CloseTableFiles(oldName)) || (rc = CloseTableFiles(newName)))
+        return rc;
+    if ((rc = catalog.RenameTable(oldName, newName)))
+        return rc;
     list_files(dbPath.c_str(), files);
     for (int i = 0; i < files.size(); i++)
     {
@@ -243,8 +345,8 @@ RC SM_TableHandle::RenameTable(string &oldName, string &newName)
         suffix = files[i].substr(len_cmpStr-1);
         oldFile = dbPath + oldName + suffix;
         newFile = dbPath + newName + suffix;
-        rc = rename(oldFile.c_str(), newFile.c_str());
-        if (rc != 0) return rc;
+        if (rename(oldFile.c_str(), newFile.c_str()) != 0)
+            return SM_UNIX;
     }
 
     return rc;
@@ -261,14 +363,18 @@ RC SM_TableHandle::AddColumn(string &tableName, attrInfo &colinfo)
 {
     RC rc;
     string filename;
+    if ((rc = CloseTableFiles(tableName)))
+        return rc;
 
     // modify .scm file
-    GetScmFile(filename, tableName);
-    vector<attrInfo> attrList;
-    read_scm(filename.c_str(), attrList);
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> attrList = table->attrList;
     string testfile = attrList[0].name;
     attrList.push_back(colinfo);
-    write_scm(filename.c_str(), attrList);
+    if ((rc = catalog.UpdateTable(tableName, attrList)))
+        return rc;
     vector<attrInfo>().swap(attrList);
 
     // create .data and .index file
@@ -315,11 +421,14 @@ RC SM_TableHandle::DropColumn(string &tableName, string &colName)
 {
     RC rc = 0;
     string filename;
+    if ((rc = CloseTableFiles(tableName)))
+        return rc;
 
     // update .scm file
-    vector<attrInfo> attrList;
-    GetScmFile(filename, tableName);
-    read_scm(filename.c_str(), attrList);
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> attrList = table->attrList;
     auto iter = attrList.begin();
     while (iter != attrList.end() && iter->name != colName)
         iter++;
@@ -329,7 +438,8 @@ RC SM_TableHandle::DropColumn(string &tableName, string &colName)
     }else {
         attrList.erase(iter);
     }
-    write_scm(filename.c_str(), attrList);
+    if ((rc = catalog.UpdateTable(tableName, attrList)))
+        return rc;
 
     // delete .data and .index file
     GetRMFile(filename, tableName, colName);
@@ -353,11 +463,14 @@ RC SM_TableHandle::RenameColumn(string &tableName, string &oldName, string &newN
 {
     RC rc = 0;
     string filename;
+    if ((rc = CloseTableFiles(tableName)))
+        return rc;
     
     // update .scm file
-    vector<attrInfo> attrList;
-    GetScmFile(filename, tableName);
-    read_scm(filename.c_str(), attrList);
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> attrList = table->attrList;
     auto iter = attrList.begin();
     while (iter != attrList.end() && iter->name != oldName)
         iter++;
@@ -367,7 +480,8 @@ RC SM_TableHandle::RenameColumn(string &tableName, string &oldName, string &newN
     }else {
         iter->name = newName;
     }
-    write_scm(filename.c_str(), attrList);
+    if ((rc = catalog.UpdateTable(tableName, attrList)))
+        return rc;
 
     // update .data and .index file
     string oldFile, newFile;
@@ -385,6 +499,253 @@ RC SM_TableHandle::RenameColumn(string &tableName, string &oldName, string &newN
 }
 
 
+//
+// rebuild the .index file of given column from its .data file
+// in one pass
+// return 0 if success
+// return 1 if no such table
+// return -1 if no such column
+//
+RC SM_TableHandle::RebuildIndex(string &tableName, string &colName)
+{
+    SM_FilePins pins(*this);
+    RC rc = 0;
+    string filename;
+    attrInfo info;
+    if ((rc = catalog.GetAttr(tableName, colName, info)))
+        return rc;
+    if ((rc = CloseTableFiles(tableName)))
+        return rc;
+
+    RM_FileHandle *rmfh;
+    if ((rc = GetRMHandle(tableName, colName, rmfh)))
+        return rc;
+    SM_RidList rids;
+    if ((rc = collect_rids(rmfh, rids))
+        || (rc = rids.Rewind()))
+        return rc;
+
+    IX_BulkLoader loader(info.type, info.length);
+    RM_RecordView rec;
+    RID rid;
+    const char *pData;
+    while (rids.Next(rid))
+    {
+        if ((rc = rmfh->GetRec(rid, rec)))
+            break;
+        // NULL values are not indexed, see DeleteEntry
+        if (rec.IsNullValue())
+            continue;
+        if ((rc = rec.GetData(pData))
+            || (rc = loader.AddEntry((void *)pData, rid)))
+            break;
+    }
+    rec.Reset();
+    if (rc != 0) return rc;
+
+    // build next to the old index and only replace it once complete,
+    // so that a failed build leaves the old index in place
+    GetIXFile(filename, tableName, colName);
+    string tmpname = filename + ".tmp";
+    if (access(tmpname.c_str(), F_OK) == 0)
+        DestroyIXFile(tmpname.c_str());
+    if ((rc = CreateIXFile(tmpname.c_str(), info.type, info.length,
+                           IX_PAGE_SIZE, &loader)))
+        return rc;
+    if (rename(tmpname.c_str(), filename.c_str()) != 0)
+    {
+        rc = IX_UNIX;
+        IX_PrintError(rc);
+        DestroyIXFile(tmpname.c_str());
+        return rc;
+    }
+
+    return rc;
+}
+
+
+//
+// read the next line of 'fp' that is not empty into 'line', 'size'
+// bytes, without its end of line
+// return 0 if success
+// return 1 at the end of the file
+// return 2 if the line does not fit in 'line'
+//
+static int read_csv_line(FILE *fp, char *line, int size, long long &lineNo)
+{
+    while (fgets(line, size, fp) != NULL)
+    {
+        lineNo++;
+        int len = strlen(line);
+        if (len == size - 1 && line[len-1] != '\n' && !feof(fp))
+            return 2;
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+            line[--len] = '\0';
+        if (len > 0)
+            return 0;
+    }
+    return 1;
+}
+
+
+//
+// parse a csv line into row 'row' of the column buffers 'colBuf', or
+// only check it if 'colBuf' is NULL.  'line' is changed.
+// return false if the line does not hold one value per column
+//
+static bool parse_csv_line(char *line, vector<attrInfo> &attrList,
+                           vector<char *> *colBuf, int row)
+{
+    int numCols = attrList.size();
+    char *field = line;
+    int c;
+    for (c = 0; c < numCols && field != NULL; c++)
+    {
+        char *next = strchr(field, ',');
+        if (next != NULL)
+            *next++ = '\0';
+        if (colBuf != NULL)
+        {
+            while (*field == ' ' || *field == '"')
+                field++;
+            int flen = strlen(field);
+            while (flen > 0 && (field[flen-1] == ' ' || field[flen-1] == '"'))
+                field[--flen] = '\0';
+
+            char *pVal = (*colBuf)[c] + row * attrList[c].length;
+            memset(pVal, 0, attrList[c].length);
+            if (flen > 0)
+            {
+                switch (attrList[c].type)
+                {
+                case INT:{
+                    int val = atoi(field);
+                    memcpy(pVal, &val, sizeof(int));
+                }break;
+                case FLOAT:{
+                    float val = atof(field);
+                    memcpy(pVal, &val, sizeof(float));
+                }break;
+                case STRING:{
+                    // cut off value if too long
+                    memcpy(pVal, field, min(flen, attrList[c].length - 1));
+                }break;
+                default:
+                    break;
+                }
+            }
+        }
+        field = next;
+    }
+    return c == numCols && field == NULL;
+}
+
+
+//
+// append the rows of a csv file to this table.
+// Each line holds the values of all columns in order, separated by
+// ','; an empty value is NULL.  The whole file is checked first, so a
+// malformed line, or one longer than MAXSTRINGLEN bytes per column,
+// loads no row.  Rows are then parsed SM_LOAD_CHUNK_ROWS at a time and
+// appended to each .data file a page at a time.  The indexes are
+// rebuilt once all rows are loaded.
+// return 0 if success
+// return 1 if no such table
+// return 2 if the file can not be read or a line is malformed
+//
+RC SM_TableHandle::LoadData(string &tableName, string &csvFile, long long &numRows)
+{
+    SM_FilePins pins(*this);
+    RC rc = 0;
+    numRows = 0;
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> &attrList = table->attrList;
+    int numCols = attrList.size();
+    if (numCols == 0)
+        return 2;
+
+    FILE *fp = fopen(csvFile.c_str(), "r");
+    if (fp == NULL)
+        return 2;
+
+    int lineSize = MAXSTRINGLEN * numCols + 2;
+    char *line = new char[lineSize];
+    long long lineNo = 0;
+    int res;
+    while ((res = read_csv_line(fp, line, lineSize, lineNo)) == 0)
+    {
+        if (!parse_csv_line(line, attrList, NULL, 0))
+        {
+            printf("line %lld: expected %d values\n", lineNo, numCols);
+            rc = 2;
+            break;
+        }
+    }
+    if (res == 2)
+    {
+        printf("line %lld: longer than %d characters\n", lineNo, lineSize - 2);
+        rc = 2;
+    }
+    if (rc != 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        delete[] line;
+        return 2;
+    }
+
+    vector<char *> colBuf(numCols);
+    for (int c = 0; c < numCols; c++)
+        colBuf[c] = new char[SM_LOAD_CHUNK_ROWS * attrList[c].length];
+
+    lineNo = 0;
+    bool bEOF = false;
+    while (!bEOF && rc == 0)
+    {
+        // parse one chunk of rows
+        int numChunk = 0;
+        while (numChunk < SM_LOAD_CHUNK_ROWS)
+        {
+            if (read_csv_line(fp, line, lineSize, lineNo) != 0)
+            {
+                bEOF = true;
+                break;
+            }
+            parse_csv_line(line, attrList, &colBuf, numChunk);
+            numChunk++;
+        }
+
+        // append the chunk to each column
+        if (numChunk == 0)
+            continue;
+        for (int c = 0; c < numCols && rc == 0; c++)
+        {
+            RM_FileHandle *rmfh;
+            if ((rc = GetRMHandle(tableName, attrList[c].name, rmfh)) == 0)
+                rc = rmfh->InsertRecs(colBuf[c], numChunk);
+        }
+        if (rc == 0)
+            numRows += numChunk;
+    }
+
+    fclose(fp);
+    delete[] line;
+    for (int c = 0; c < numCols; c++)
+        delete[] colBuf[c];
+    if (numRows == 0)
+        return rc;
+
+    // deferred index build
+    for (int c = 0; c < numCols; c++)
+    {
+        RC tmp = RebuildIndex(tableName, attrList[c].name);
+        if (tmp != 0) return tmp;
+    }
+    return rc;
+}
+
+
 //
 // insert entry to this table
 // .data files and .index files will be updated.
@@ -392,21 +753,21 @@ RC SM_TableHandle::RenameColumn(string &tableName, string &oldName, string &newN
 // 
 RC SM_TableHandle::InsertEntry(string &tableName, map<string,string> &entry, RID &_rid)
 {
+    SM_FilePins pins(*this);
     RC rc = 0;
     string filename;
-    vector<attrInfo> attrList;
-    GetScmFile(filename, tableName);
-    read_scm(filename.c_str(), attrList);
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> &attrList = table->attrList;
 
-    RM_FileHandle *rmfh = new RM_FileHandle;
-    IX_IndexHandle *ixfh = new IX_IndexHandle;
+    RM_FileHandle *rmfh;
+    IX_IndexHandle *ixfh;
     for (auto iter = attrList.begin(); iter != attrList.end(); iter++)
     {            
-        GetRMFile(filename, tableName, iter->name);
-        rc = rmfh->OpenRMFile(filename.c_str());
+        rc = GetRMHandle(tableName, iter->name, rmfh);
         assert(rc == 0);
-        GetIXFile(filename, tableName, iter->name);
-        rc = ixfh->OpenIndex(filename.c_str());
+        rc = GetIXHandle(tableName, iter->name, ixfh);
         assert(rc == 0);
         if (entry.find(iter->name) == entry.end())
         {
@@ -446,14 +807,7 @@ RC SM_TableHandle::InsertEntry(string &tableName, map<string,string> &entry, RID
             
         }
         //cout << "insert at " << _rid.page << " " << _rid.slot << endl;
-
-        rc = ixfh->CloseIndex();
-        assert(rc == 0);
-        rc = rmfh->CloseRMFile();
-        assert(rc == 0);
     }
-    delete rmfh;
-    delete ixfh;
 
     return rc;
 }
@@ -466,25 +820,25 @@ RC SM_TableHandle::InsertEntry(string &tableName, map<string,string> &entry, RID
 //
 RC SM_TableHandle::DeleteEntry(string &tableName, vector<RID> &rids)
 {
+    SM_FilePins pins(*this);
     RC rc = 0;
     string filename;
     char *_key;
     RID _rid;
     RM_Record rec;
-    vector<attrInfo> attrList;
-    GetScmFile(filename, tableName);
-    read_scm(filename.c_str(), attrList);
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> &attrList = table->attrList;
 
-    RM_FileHandle *rmfh = new RM_FileHandle;
-    IX_IndexHandle *ixfh = new IX_IndexHandle;
+    RM_FileHandle *rmfh;
+    IX_IndexHandle *ixfh;
     for (auto iter = attrList.begin(); iter != attrList.end(); iter++)
     {            
-        GetRMFile(filename, tableName, iter->name);
-        rc = rmfh->OpenRMFile(filename.c_str());
+        rc = GetRMHandle(tableName, iter->name, rmfh);
         if (rc != 0) return rc;
 
-        GetIXFile(filename, tableName, iter->name);
-        rc = ixfh->OpenIndex(filename.c_str());
+        rc = GetIXHandle(tableName, iter->name, ixfh);
         if (rc != 0) return rc;
 
         for (int i = 0; i < rids.size(); i++)
@@ -498,48 +852,42 @@ RC SM_TableHandle::DeleteEntry(string &tableName, vector<RID> &rids)
             rc = rmfh->DeleteRec(rids[i]);
             if (rc != 0) return rc;
         }
-        rc = ixfh->CloseIndex();
-        if (rc != 0) return rc;
-        rc = rmfh->CloseRMFile();
-        if (rc != 0) return rc;
     }
-    delete rmfh;
-    delete ixfh;
 
     return rc;
 }
 
 
 //
-// Delete all records according to 'RidFile'
+// Delete all records in 'rids'
 //
-RC SM_TableHandle::DeleteEntry(string &tableName, string &RidFile)
+RC SM_TableHandle::DeleteEntry(string &tableName, SM_RidList &rids)
 {
+    SM_FilePins pins(*this);
     RC rc = 0;
     string filename;
     char *_key;
     RID _rid;
     RM_Record rec;
-    vector<attrInfo> attrList;
-    GetScmFile(filename, tableName);
-    read_scm(filename.c_str(), attrList);
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> &attrList = table->attrList;
 
-    RM_FileHandle *rmfh = new RM_FileHandle;
-    IX_IndexHandle *ixfh = new IX_IndexHandle;
-    FILE *fp = fopen(RidFile.c_str(), "r");
+    RM_FileHandle *rmfh;
+    IX_IndexHandle *ixfh;
     for (auto iter = attrList.begin(); iter != attrList.end(); iter++)
     {            
-        GetRMFile(filename, tableName, iter->name);
-        rc = rmfh->OpenRMFile(filename.c_str());
+        rc = GetRMHandle(tableName, iter->name, rmfh);
         if (rc != 0) return rc;
 
-        GetIXFile(filename, tableName, iter->name);
-        rc = ixfh->OpenIndex(filename.c_str());
+        rc = GetIXHandle(tableName, iter->name, ixfh);
         if (rc != 0) return rc;
 
-        rewind(fp);
+        if ((rc = rids.Rewind()))
+            return rc;
         RID rid;
-        while (fscanf(fp, "%d %d", &(rid.page), &(rid.slot)) != EOF)
+        while (rids.Next(rid))
         {
             if ((rc = rmfh->GetRec(rid, rec))
                 || (rc = rec.GetData(_key)))
@@ -550,14 +898,7 @@ RC SM_TableHandle::DeleteEntry(string &tableName, string &RidFile)
             rc = rmfh->DeleteRec(rid);
             if (rc != 0) return rc;
         }
-        rc = ixfh->CloseIndex();
-        if (rc != 0) return rc;
-        rc = rmfh->CloseRMFile();
-        if (rc != 0) return rc;
     }
-    fclose(fp);
-    delete rmfh;
-    delete ixfh;
 
     return rc;
 }
@@ -570,24 +911,25 @@ RC SM_TableHandle::DeleteEntry(string &tableName, string &RidFile)
 //
 RC SM_TableHandle::UpdateEntry(string &tableName, RID rid, map<string,string> &entry)
 {
+    SM_FilePins pins(*this);
     RC rc = 0;
     string filename;
     RM_Record rec;
     char *pData;
-    vector<attrInfo> attrList;
-    GetScmFile(filename, tableName);
-    read_scm(filename.c_str(), attrList);
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> &attrList = table->attrList;
 
-    RM_FileHandle *rmfh = new RM_FileHandle;
-    IX_IndexHandle *ixfh = new IX_IndexHandle;
+    RM_FileHandle *rmfh;
+    IX_IndexHandle *ixfh;
     for (auto iter = attrList.begin(); iter != attrList.end(); iter++)
     {
         if (entry.find(iter->name) == entry.end())
             continue;
-        GetRMFile(filename, tableName, iter->name);
-        rmfh->OpenRMFile(filename.c_str());
-        GetIXFile(filename, tableName, iter->name);
-        ixfh->OpenIndex(filename.c_str());
+        if ((rc = GetRMHandle(tableName, iter->name, rmfh))
+            || (rc = GetIXHandle(tableName, iter->name, ixfh)))
+            return rc;
         switch (iter->type)
         {
         case INT:{
@@ -620,221 +962,369 @@ RC SM_TableHandle::UpdateEntry(string &tableName, RID rid, map<string,string> &e
         default:
             break;
         }
-        rmfh->CloseRMFile();
-        ixfh->CloseIndex();
     }
-    delete ixfh;
-    delete rmfh;
 
     return rc;
 }
 
 
-RC SM_TableHandle::SelectEntry(string &tableName, string &retFile, string &column, CompOp &op, string &value)
+//
+// return the key of a value given as text, parsed by the type of the
+// column.  'ival' and 'fval' hold the parsed number.
+// return NULL if the column has no type
+//
+static void *parse_key(attrInfo &info, string &value, int &ival, float &fval)
 {
-    RC rc = 0;
-    string filename;
-
-    attrInfo info;
-    GetScmFile(filename, tableName);
-    rc = get_attr_from_scm(filename.c_str(), column, info);
-    if (rc != 0) return 1;
-
     switch (info.type)
     {
-        case STRING:{
-            auto *val = const_cast<char *>(value.c_str());
-            void *ptr = (void *)val;
-            return this->SelectEntry(tableName, retFile, column, op, ptr);
-        }break;
-        case INT:{
-            int val = atoi(value.c_str());
-            void *ptr = (void *)&val;
-            return this->SelectEntry(tableName, retFile, column, op, ptr);
-        }break;
-        case FLOAT:{
-            float val = atof(value.c_str());
-            void *ptr = (void *)&val;
-            return this->SelectEntry(tableName, retFile, column, op, ptr);
-        }break;
+        case STRING:
+            return (void *)const_cast<char *>(value.c_str());
+        case INT:
+            ival = atoi(value.c_str());
+            return (void *)&ival;
+        case FLOAT:
+            fval = atof(value.c_str());
+            return (void *)&fval;
         default:
-            return 0;
+            return NULL;
     }
 }
 
 
+//
+// select entry by a value given as text.
+// RidsT is SM_RidList or SM_RidSet.
+//
+template <typename RidsT>
+static RC select_value(SM_TableHandle &th, attrInfo &info, string &tableName,
+                       RidsT &rids, string &column, CompOp &op, string &value)
+{
+    int ival;
+    float fval;
+    void *ptr = parse_key(info, value, ival, fval);
+    if (ptr == NULL)
+        return 0;
+    return th.SelectEntry(tableName, rids, column, op, ptr);
+}
+
+
+//
+// add the RID of the index entries satisfying 'op cmpKey' to 'rids'
+//
+template <typename RidsT>
+static RC scan_index(IX_IndexHandle *ixfh, CompOp &op, void *&cmpKey, RidsT &rids)
+{
+    RC rc;
+    RID rid;
+    rc = ixfh->OpenScan(op, cmpKey);
+    if (rc != 0) return rc;
+    while (ixfh->GetNextEntry(rid) != IX_EOF)
+    {
+        if ((rc = rids.Add(rid)))
+            break;
+    }
+    RC rc2 = ixfh->CloseScan();
+    return rc != 0 ? rc : rc2;
+}
+
+
+RC SM_TableHandle::SelectEntry(string &tableName, SM_RidList &rids, string &column, CompOp &op, string &value)
+{
+    attrInfo info;
+    if (catalog.GetAttr(tableName, column, info) != 0)
+        return 1;
+    return select_value(*this, info, tableName, rids, column, op, value);
+}
+
+
+RC SM_TableHandle::SelectEntry(string &tableName, SM_RidSet &rids, string &column, CompOp &op, string &value)
+{
+    attrInfo info;
+    if (catalog.GetAttr(tableName, column, info) != 0)
+        return 1;
+    return select_value(*this, info, tableName, rids, column, op, value);
+}
+
+
 //
 // select entry
-// write the RID of those entries which satisfy given condition 
-// to temporary file
+// add the RID of those entries which satisfy given condition
+// to 'rids'
 // return 0 if success
 // return 1 if there is no such column
 //
-RC SM_TableHandle::SelectEntry(string &tableName, string &retFile, string &column, CompOp &op, void *&cmpKey)
+RC SM_TableHandle::SelectEntry(string &tableName, SM_RidList &rids, string &column, CompOp &op, void *&cmpKey)
 {
+    SM_FilePins pins(*this);
     RC rc = 0;
-    string filename;
+    IX_IndexHandle *ixfh;
+    if (!catalog.isValidColumn(tableName, column))
+        return 1;
+    if ((rc = GetIXHandle(tableName, column, ixfh)))
+        return rc;
+    return scan_index(ixfh, op, cmpKey, rids);
+}
 
-    attrInfo info;
-    GetScmFile(filename, tableName);
-    rc = get_attr_from_scm(filename.c_str(), column, info);
-    if (rc != 0) return 1;
-    
-    RID rid;
-    GetIXFile(filename, tableName, column);
-    IX_IndexHandle *ixfh = new IX_IndexHandle;
-    rc = ixfh->OpenIndex(filename.c_str());
-    if (rc != 0) return rc;
 
-    rc = ixfh->OpenScan(op, cmpKey);
-    if (rc != 0) return rc;
-    FILE *fp = fopen(retFile.c_str(), "w");
-    while (ixfh->GetNextEntry(rid) != IX_EOF)
-        fprintf(fp, "%d %d\n", rid.page, rid.slot);
-    fclose(fp);
-    rc = ixfh->CloseScan();
-    if (rc != 0) return rc;
+//
+// select entry into a set, so that the results of several predicates
+// can be combined without fetching any record
+// return 0 if success
+// return 1 if there is no such column
+//
+RC SM_TableHandle::SelectEntry(string &tableName, SM_RidSet &rids, string &column, CompOp &op, void *&cmpKey)
+{
+    SM_FilePins pins(*this);
+    RC rc = 0;
+    IX_IndexHandle *ixfh;
+    if (!catalog.isValidColumn(tableName, column))
+        return 1;
+    if ((rc = GetIXHandle(tableName, column, ixfh)))
+        return rc;
+    return scan_index(ixfh, op, cmpKey, rids);
+}
 
-    rc = ixfh->CloseIndex();
-    if (rc != 0) return rc;
-    delete ixfh;
-    return rc;
+
+//
+// compKEY returns whether 'a op b' holds for two keys of given type.
+// The comparison is resolved once per scan, see get_compKEY.
+//
+typedef bool (*CompKeyFn)(void *a, void *b);
+
+template <typename KeyT, CompOp op>
+static bool compKEY(void *a, void *b)
+{
+    int res = CmpKeyT<KeyT>(a, b);
+    switch (op)
+    {
+    case EQ_OP: return res == 0;
+    case NE_OP: return res != 0;
+    case LT_OP: return res < 0;
+    case GT_OP: return res > 0;
+    case LE_OP: return res <= 0;
+    case GE_OP: return res >= 0;
+    default:    return 0;
+    }
 }
 
+template <typename KeyT>
+static CompKeyFn get_compKEY(CompOp op)
+{
+    switch (op)
+    {
+    case EQ_OP: return compKEY<KeyT, EQ_OP>;
+    case NE_OP: return compKEY<KeyT, NE_OP>;
+    case LT_OP: return compKEY<KeyT, LT_OP>;
+    case GT_OP: return compKEY<KeyT, GT_OP>;
+    case LE_OP: return compKEY<KeyT, LE_OP>;
+    case GE_OP: return compKEY<KeyT, GE_OP>;
+    default:    return compKEY<KeyT, NO_OP>;
+    }
+}
 
-bool compKEY(CompOp &op, void *a, void *b, AttrType type)
+static CompKeyFn get_compKEY(CompOp op, AttrType type)
 {
     switch (type)
     {
-    case STRING: {
-        int res = strcmp((char *)a, (char *)b);
-        switch (op)
-        {
-        case EQ_OP: {
-            if (res == 0) return 1;
-        }break;
-        case NE_OP: {
-            if (res != 0) return 1;
-        }break;
-        case LT_OP: {
-            if (res < 0) return 1;
-        }break;
-        case GT_OP: {
-            if (res > 0) return 1;
-        }break;
-        case LE_OP: {
-            if (res <= 0) return 1;
-        }break;        
-        case GE_OP: {
-            if (res >= 0) return 1;
-        }break;   
-        }
-        return 0;
-    }break;
-    case INT: {
-        switch (op)
-        {
-        case EQ_OP: {
-            if (*(int *)a == *(int *)b) return 1;
-        }break;
-        case NE_OP: {
-            if (*(int *)a != *(int *)b) return 1;
-        }break;
-        case LT_OP: {
-            if (*(int *)a < *(int *)b) return 1;
-        }break;
-        case GT_OP: {
-            if (*(int *)a > *(int *)b) return 1;
-        }break;
-        case LE_OP: {
-            if (*(int *)a <= *(int *)b) return 1;
-        }break;        
-        case GE_OP: {
-            if (*(int *)a >= *(int *)b) return 1;
-        }break;   
-        }
-        return 0;
-    }break;
-    case FLOAT: {
-        switch (op)
-        {
-        case EQ_OP: {
-            if (*(float *)a == *(float *)b) return 1;
-        }break;
-        case NE_OP: {
-            if (*(float *)a != *(float *)b) return 1;
-        }break;
-        case LT_OP: {
-            if (*(float *)a < *(float *)b) return 1;
-        }break;
-        case GT_OP: {
-            if (*(float *)a > *(float *)b) return 1;
-        }break;
-        case LE_OP: {
-            if (*(float *)a <= *(float *)b) return 1;
-        }break;        
-        case GE_OP: {
-            if (*(float *)a >= *(float *)b) return 1;
-        }break;   
-        }
-        return 0;
-    }break;    
-    default:
-        break;
+    case STRING: return get_compKEY<char *>(op);
+    case INT:    return get_compKEY<int>(op);
+    case FLOAT:  return get_compKEY<float>(op);
+    default:     return compKEY<int, NO_OP>;
     }
+}
 
+//
+// keep the RIDs in 'rids' whose record in 'rmfh' satisfies
+// 'compKey(record, cmpKey)'.  RidsT is SM_RidList or SM_RidSet.
+//
+template <typename RidsT>
+static RC filter_rids(RM_FileHandle *rmfh, CompKeyFn compKey, void *cmpKey, RidsT &rids)
+{
+    RC rc;
+    RM_RecordView rec;
+    RID rid;
+    const char *pData;
+    if ((rc = rids.Rewind()))
+        return rc;
+    RidsT kept;
+    while (rids.Next(rid))
+    {
+        if ((rc = rmfh->GetRec(rid, rec))
+            || (rc = rec.GetData(pData)))
+            return rc;
+
+        if (compKey((void *)pData, cmpKey)
+            && (rc = kept.Add(rid)))
+            return rc;
+    }
+    rids.Swap(kept);
     return 0;
 }
 
+
 //
-// select entry from file
-// delete RID which doesn't satisfy given condition in 'retFile' 
+// select entry from list
+// remove the RIDs which don't satisfy given condition from 'rids'
 // return 0 if success
+// return 1 if there is no such column
 //
-RC SM_TableHandle::SelectEntry_from_file(string &tableName, string &retFile, string &column, CompOp &op, void *&cmpKey)
+RC SM_TableHandle::SelectEntry_from_list(string &tableName, SM_RidList &rids, string &column, CompOp &op, void *&cmpKey)
 {
+    SM_FilePins pins(*this);
     RC rc = 0;
-    string filename;
+    attrInfo info;
+    rc = catalog.GetAttr(tableName, column, info);
+    if (rc != 0) return 1;
+
+    RM_FileHandle *rmfh;
+    if ((rc = GetRMHandle(tableName, column, rmfh)))
+        return rc;
+    return filter_rids(rmfh, get_compKEY(op, info.type), cmpKey, rids);
+}
+
 
+//
+// select entry from set
+// remove the RIDs which don't satisfy given condition from 'rids'
+// return 0 if success
+// return 1 if there is no such column
+//
+RC SM_TableHandle::SelectEntry_from_set(string &tableName, SM_RidSet &rids, string &column, CompOp &op, string &value)
+{
+    SM_FilePins pins(*this);
+    RC rc = 0;
     attrInfo info;
-    GetScmFile(filename, tableName);
-    rc = get_attr_from_scm(filename.c_str(), column, info);
+    rc = catalog.GetAttr(tableName, column, info);
     if (rc != 0) return 1;
 
-    RM_Record rec;
-    RID rid;
-    char *pData;
-    RM_FileHandle *rmfh = new RM_FileHandle;
-    GetRMFile(filename, tableName, column);
-    rc = rmfh->OpenRMFile(filename.c_str());
-    assert(rc == 0);
-    FILE *fp = fopen(retFile.c_str(), "r");
-    string tmp = retFile + "x";
-    FILE *fpw = fopen(tmp.c_str(), "w");
-    while (fscanf(fp, "%d %d", &(rid.page), &(rid.slot)) != EOF)
-    {
-        rc = rmfh->GetRec(rid, rec);
-        assert(rc == 0);
-        rc = rec.GetData(pData);
-        assert(rc == 0);
+    int ival;
+    float fval;
+    void *cmpKey = parse_key(info, value, ival, fval);
+    RM_FileHandle *rmfh;
+    if ((rc = GetRMHandle(tableName, column, rmfh)))
+        return rc;
+    return filter_rids(rmfh, get_compKEY(op, info.type), cmpKey, rids);
+}
+
+
+// whether an index scan can return the RIDs satisfying 'op'
+static bool is_scan_op(CompOp op)
+{
+    return op == EQ_OP || op == GT_OP || op == GE_OP;
+}
+
+
+// order of the predicates of a conjunction, the most selective first
+static int cond_rank(const SM_Cond &cond)
+{
+    if (cond.op == EQ_OP)
+        return 0;
+    return is_scan_op(cond.op) ? 1 : 2;
+}
 
-        if (compKEY(op, (void *)pData, cmpKey, info.type))
-            fprintf(fpw, "%d %d\n", rid.page, rid.slot);
+
+//
+// set 'rids' to the RIDs satisfying a where clause, an OR of
+// conjunctions.  Each conjunction starts from an index scan of its most
+// selective predicate.  The next predicate is checked on the records of
+// the candidates while they are few, otherwise its index is scanned and
+// the two sets are intersected.  Predicates the index can not scan
+// (!=, <, <=) are always checked on the records.
+// return 0 if success
+// return 1 if there is no such column
+//
+RC SM_TableHandle::SelectWhere(string &tableName, vector<vector<SM_Cond>> &where, SM_RidSet &rids)
+{
+    SM_FilePins pins(*this);
+    RC rc = 0;
+    for (int d = 0; d < where.size(); d++)
+    {
+        vector<SM_Cond> conds = where[d];
+        for (int c = 0; c < conds.size(); c++)
+        {
+            if (!catalog.isValidColumn(tableName, conds[c].column))
+                return 1;
+        }
+        stable_sort(conds.begin(), conds.end(),
+                    [](const SM_Cond &a, const SM_Cond &b) {
+                        return cond_rank(a) < cond_rank(b);
+                    });
+
+        SM_RidSet cand;
+        for (int c = 0; c < conds.size(); c++)
+        {
+            SM_Cond &cond = conds[c];
+            bool bScan = is_scan_op(cond.op);
+            if (c == 0 && bScan)
+            {
+                rc = SelectEntry(tableName, cand, cond.column, cond.op, cond.value);
+            }else if (c == 0) {
+                if ((rc = SelectAll(tableName, cand)) == 0)
+                    rc = SelectEntry_from_set(tableName, cand, cond.column, cond.op, cond.value);
+            }else if (bScan && cand.GetNumRids() > SM_FILTER_MAX_RIDS) {
+                SM_RidSet part;
+                rc = SelectEntry(tableName, part, cond.column, cond.op, cond.value);
+                cand.And(part);
+            }else {
+                rc = SelectEntry_from_set(tableName, cand, cond.column, cond.op, cond.value);
+            }
+            if (rc != 0) return rc;
+            if (cand.GetNumRids() == 0)
+                break;
+        }
+        rids.Or(cand);
     }
-    fclose(fpw);
-    fclose(fp);
-    rc = rmfh->CloseRMFile();
-    assert(rc == 0);
-    delete rmfh;
-/* 
-    rc = remove(retFile.c_str());
-    assert(rc == 0);
-    rc = rename(tmp.c_str(), retFile.c_str());
-    assert(rc == 0); */
     return rc;
 }
 
 
+//
+// add the RIDs of all records in this table to 'rids'
+// return 0 if success
+// return 1 if no such table
+//
+RC SM_TableHandle::SelectAll(string &tableName, SM_RidList &rids)
+{
+    SM_FilePins pins(*this);
+    RC rc = 0;
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table) || table->attrList.empty())
+        return 1;
+
+    RM_FileHandle *rmfh;
+    if ((rc = GetRMHandle(tableName, table->attrList[0].name, rmfh)))
+        return rc;
+    return collect_rids(rmfh, rids);
+}
+
+
+//
+// add the RIDs of all records in this table to 'rids', a page of slot
+// map at a time
+// return 0 if success
+// return 1 if no such table
+//
+RC SM_TableHandle::SelectAll(string &tableName, SM_RidSet &rids)
+{
+    SM_FilePins pins(*this);
+    RC rc = 0;
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table) || table->attrList.empty())
+        return 1;
+
+    RM_FileHandle *rmfh;
+    if ((rc = GetRMHandle(tableName, table->attrList[0].name, rmfh)))
+        return rc;
+    int numSlots = rmfh->GetNumSlots();
+    char *slotMap = new char[RM_PageView::MapSize(numSlots)];
+    PageNum p = -1;
+    while ((rc = rmfh->GetNextSlotMap(p, slotMap)) == 0)
+        rids.AddPage(p, slotMap, numSlots);
+    delete[] slotMap;
+    return rc == PF_EOF ? 0 : rc;
+}
+
+
 //
 // show the column information of given table
 // return 0 if success
@@ -845,11 +1335,10 @@ RC SM_TableHandle::DetailTable(string &tableName)
     RC rc = 0;
     string filename;
 
-    GetScmFile(filename, tableName);
-    vector<attrInfo> attrList;
-    int fexist = access(filename.c_str(), 0);
-    if (fexist != 0) return 1;
-    read_scm(filename.c_str(), attrList);
+    SM_TableInfo *table;
+    if (catalog.GetTable(tableName, table))
+        return 1;
+    vector<attrInfo> &attrList = table->attrList;
 
     printf("\n");
     printf("   %s  \n", tableName.c_str());
@@ -866,69 +1355,53 @@ RC SM_TableHandle::DetailTable(string &tableName)
 
 
 //
-// Write value at given RIDs in 'RidFile' to 'outFile'
+// Write value at given RIDs in 'rids' to 'fp'
 //
-RC SM_TableHandle::WriteValue(string &tableName, vector<string> &colList, string &outFile, string &RidFile)
+RC SM_TableHandle::WriteValue(string &tableName, vector<string> &colList, FILE *fp, SM_RidList &rids)
 {
+    SM_FilePins pins(*this);
     RC rc = 0;
-    RM_FileHandle rmfh;
-    string filename;
+    RM_FileHandle *rmfh;
     RID rid;
 
-    if (RidFile == "")
-    {
-        GetRMFile(filename, tableName, colList[0]);
-        rmfh.OpenRMFile(filename.c_str());
-        RidFile = tableName + ".where";
-        rc = rmfh.WriteAllRids(RidFile.c_str());
-        rmfh.CloseRMFile();
-    }
-
-    FILE *fpw = fopen(outFile.c_str(), "w"),
-         *fpr = fopen(RidFile.c_str(), "r");
+    if ((rc = rids.Rewind()))
+        return rc;
 
-    fprintf(fpw, "\n");
-    fprintf(fpw, "#---------------------------------------------#\n");  
-    fprintf(fpw, "| ");  
+    fprintf(fp, "\n");
+    fprintf(fp, "#---------------------------------------------#\n");  
+    fprintf(fp, "| ");  
     for (int c = 0; c < colList.size(); c++)
-        fprintf(fpw, "%s    ", colList[c].c_str());
-    fprintf(fpw, "\n");
-    fprintf(fpw, "#---------------------------------------------#\n");    
-    while (fscanf(fpr, "%d %d", &(rid.page), &(rid.slot)) != EOF)
+        fprintf(fp, "%s    ", colList[c].c_str());
+    fprintf(fp, "\n");
+    fprintf(fp, "#---------------------------------------------#\n");    
+    while (rids.Next(rid))
     {
-        fprintf(fpw, "| ");
+        fprintf(fp, "| ");
         for (int c = 0; c < colList.size(); c++)
         {
-            GetRMFile(filename, tableName, colList[c]);
-            rc = rmfh.OpenRMFile(filename.c_str());
+            rc = GetRMHandle(tableName, colList[c], rmfh);
             assert(rc == 0);
-            rc = rmfh.WriteValue(fpw, rid);
-            assert(rc == 0);
-            rc = rmfh.CloseRMFile();
+            rc = rmfh->WriteValue(fp, rid);
             assert(rc == 0);
         }
-        fprintf(fpw, "\n");
+        fprintf(fp, "\n");
     }
-    fprintf(fpw, "#---------------------------------------------#\n");    
-    fclose(fpr);
-    fclose(fpw);
+    fprintf(fp, "#---------------------------------------------#\n");    
 
     return rc;
 }
 
 
 //
-// Write all records to 'outFile'
+// Write all records to 'fp'
 //
-RC SM_TableHandle::WriteValue(string &tableName, vector<string> &colList, string &outFile)
+RC SM_TableHandle::WriteValue(string &tableName, vector<string> &colList, FILE *fp)
 {
     RC rc = 0;
-    FILE *fp = fopen(outFile.c_str(), "w");
-    RM_FileHandle rmfh;
-    rmfh.OpenRMFile(tableName.c_str());
-    rmfh.CloseRMFile();
-    fclose(fp);
-    return rc;
+    SM_RidList rids;
+    if ((rc = SelectAll(tableName, rids)))
+        return rc;
+    return WriteValue(tableName, colList, fp, rids);
 }
 
 
@@ -937,11 +1410,7 @@ RC SM_TableHandle::WriteValue(string &tableName, vector<string> &colList, string
 //
 bool SM_TableHandle::isValidTable(string &tableName)
 {
-    string filename;
-    this->GetScmFile(filename, tableName);
-    if (access(filename.c_str(), 0) == 0)
-        return 1;
-    return 0;
+    return catalog.isValidTable(tableName);
 }
 
 
@@ -950,27 +1419,5 @@ bool SM_TableHandle::isValidTable(string &tableName)
 //
 bool SM_TableHandle::isValidColumn(string &tableName, string &columnName)
 {
-    string filename;
-    this->GetScmFile(filename, tableName);
-    FILE *fp = fopen(filename.c_str(), "r");
-    int attrNum;
-    fscanf(fp, "%d", &attrNum);
-    attrInfo tmp;
-    char *cname = new char[256];
-    for (int i = 0; i < attrNum; i++)
-    {
-        fscanf(fp, "%s %d %d", 
-                 cname, 
-                 &(tmp.type), 
-                 &(tmp.length));
-        if (cname == columnName)
-        {
-            delete cname;
-            fclose(fp);
-            return 1;
-        }
-    }
-    delete cname;
-    fclose(fp);
-    return 0;
+    return catalog.isValidColumn(tableName, columnName);
 }
@@ -47,6 +47,9 @@ string logostr[25] = {
 "                                                                                                           \n"
 };
 
+// max number of .data and .index files a database keeps open, see -f
+static int maxOpenFiles = SM_MAX_OPEN_FILES;
+
 
 void inline clear_screen()
 {
@@ -79,6 +82,42 @@ void list_files(const char *PATH, vector<string> &list)
 }
 
 
+//
+// upgrade the .data and .index files of a database to the current PF
+// file format
+// return false if a file could not be upgraded
+//
+bool upgrade_database(const char *path)
+{
+    vector<string> files;
+    if (access(path, 0) != 0)
+    {
+        cout << "No such directory " << path << endl;
+        return false;
+    }
+    list_files(path, files);
+
+    bool bOk = true;
+    for (auto &file : files)
+    {
+        size_t dot = file.rfind('.');
+        if (dot == string::npos
+            || (file.substr(dot) != ".data" && file.substr(dot) != ".index"))
+            continue;
+        string fileName = string(path) + "/" + file;
+        RC rc = PF_UpgradeFile(fileName.c_str());
+        if (rc)
+        {
+            cout << "Failed to upgrade " << fileName << ": ";
+            cout.flush();
+            PF_PrintError(rc);
+            bOk = false;
+        }
+    }
+    return bOk;
+}
+
+
 bool is_char_valid(const char c)
 {
 
@@ -130,7 +169,7 @@ void string_to_CompOp(string &str, CompOp &op)
         op = EQ_OP;
     }else if (str == ">")
     {
-        op = GE_OP;
+        op = GT_OP;
     }else if (str == "<")
     {
         op = LT_OP;
@@ -193,60 +232,51 @@ void string_to_attrList(string &cmd, vector<attrInfo> *attrList)
 }
 
 
-void load_AttrType_from_scm(string &scm_file, string &colName, AttrType &type)
-{
-    FILE *fp = fopen(scm_file.c_str(), "r");
-    int attrNum;
-    fscanf(fp, "%d", &attrNum);
-    char name[256];
-    int a,b,c;
-    for (int i = 0; i < attrNum; i++)
-    {
-        fscanf(fp, "%s %d %d %d", name, &a, &b, &c);
-        if (name == colName)
-        {
-            type = (AttrType)a;
-            break;
-        }
-    }
-    fclose(fp);
-}
-
-
-void load_columns_from_scm(string &scm_file, vector<string> &colList)
-{
-    FILE *fp = fopen(scm_file.c_str(), "r");
-    int attrNum;
-    fscanf(fp, "%d", &attrNum);
-    char name[256];
-    int a,b,c;
-    for (int i = 0; i < attrNum; i++)
-    {
-        fscanf(fp, "%s %d %d %d", name, &a, &b, &c);
-        colList.push_back(name);
-    }
-    fclose(fp);
-}
-
-
 //
-// get where file 
+// get the RIDs satisfying where condition
+// 'column op value' predicates joined by 'and' / 'or', 'and' binding
+// tighter than 'or'
 // return 0 if success
 // return -1 if wrong syntax
 //
-RC table_where(string &cmd, string &whereFile,
+RC table_where(string &cmd, SM_RidList &rids,
             string &tableName, SM_TableHandle &th)
 {
+    RC rc;
     stringstream ss(cmd);
-    string column, opr, filename, value;
-    ss >> column;
-    ss >> opr; 
-    ss >> value;
-    CompOp op;
-    string_to_CompOp(opr, op);
-    
-    whereFile = tableName + ".where";
-    return th.SelectEntry(tableName, whereFile, column, op, value);
+    vector<vector<SM_Cond>> where(1);
+    string column, opr, value, conj;
+    bool bNeedCond = true;      // a predicate must follow
+    while (ss >> column)
+    {
+        if (!(ss >> opr >> value))
+            return -1;
+        SM_Cond cond;
+        cond.op = NO_OP;
+        string_to_CompOp(opr, cond.op);
+        if (cond.op == NO_OP)
+            return -1;
+        cond.column = column;
+        cond.value = value;
+        where.back().push_back(cond);
+        bNeedCond = false;
+
+        if (!(ss >> conj))
+            break;
+        bNeedCond = true;
+        transform(conj.begin(), conj.end(), conj.begin(), ::tolower);
+        if (conj == "or")
+            where.push_back(vector<SM_Cond>());
+        else if (conj != "and")
+            return -1;
+    }
+    if (bNeedCond)
+        return -1;
+
+    SM_RidSet set;
+    if ((rc = th.SelectWhere(tableName, where, set)))
+        return rc;
+    return set.ToList(rids);
 }
 
 
@@ -408,6 +438,82 @@ RC dml_rename_table(string &cmd, SM_TableHandle &th)
 }
 
 
+//
+// load data '<file.csv>' into <table name>
+// return 0 if success
+// return 1 if invalid table name
+// return 2 if invalid csv file
+// return -1 if wrong syntax
+//
+RC dml_load_data(string &cmd, SM_TableHandle &th)
+{
+    RC rc = 0;
+    string::size_type l_quote = cmd.find('\'');
+    string::size_type r_quote = cmd.find('\'', l_quote + 1);
+    if (l_quote == string::npos || r_quote == string::npos)
+        return -1;
+    string csvFile = cmd.substr(l_quote + 1, r_quote - l_quote - 1);
+
+    stringstream ss(cmd.substr(r_quote + 1));
+    string plhd, tableName;
+    ss >> plhd; if (plhd != "into"){return -1;}
+    ss >> tableName;
+    if (!th.isValidTable(tableName))
+        return 1;
+
+    printf("\n------------------------------------------\n");
+    printf("LOADING DATA INTO TABLE %s\n", tableName.c_str());
+    printf("------------------------------------------\n");
+
+    long long numRows;
+    rc = th.LoadData(tableName, csvFile, numRows);
+    printf("%lld rows loaded\n", numRows);
+    return rc;
+}
+
+
+//
+// rebuild the index of given column, or of all columns
+// return 0 if success
+// return 1 if invalid table name
+// return 2 if invalid column name
+//
+RC dml_rebuild_index(string &cmd, SM_TableHandle &th)
+{
+    RC rc = 0;
+    stringstream ss(cmd);
+    string tableName, colName;
+    ss >> tableName;
+    if (!th.isValidTable(tableName))
+        return 1;
+
+    vector<string> colList;
+    if (ss >> colName)
+    {
+        if (!th.isValidColumn(tableName, colName))
+            return 2;
+        colList.push_back(colName);
+    }else {
+        SM_TableInfo *table;
+        if ((rc = th.GetCatalog().GetTable(tableName, table)))
+            return rc;
+        for (auto iter = table->attrList.begin(); iter != table->attrList.end(); iter++)
+            colList.push_back(iter->name);
+    }
+
+    printf("\n------------------------------------------\n");
+    printf("REBUILDING INDEX OF TABLE %s\n", tableName.c_str());
+    printf("------------------------------------------\n");
+
+    for (int p = 0; p < colList.size(); p++)
+    {
+        rc = th.RebuildIndex(tableName, colList[p]);
+        if (rc != 0) return rc;
+    }
+    return rc;
+}
+
+
 //
 // return 0 if success
 // return 1 if invalid table name
@@ -462,19 +568,19 @@ RC dml_update(string &cmd, SM_TableHandle &th)
     delete colStr;
     delete valStr;
 
-    string whereFile;
+    SM_RidList rids;
     string cmdstr; getline(ss, cmdstr); 
-    rc = table_where(cmdstr, whereFile, tableName, th);
+    rc = table_where(cmdstr, rids, tableName, th);
     if (rc != 0) return 0;
 
     RID rid;
-    FILE *fp = fopen(whereFile.c_str(), "r");
-    while (fscanf(fp, "%d %d", &(rid.page), &(rid.slot)) != EOF)
+    if ((rc = rids.Rewind()))
+        return rc;
+    while (rids.Next(rid))
     {
         rc = th.UpdateEntry(tableName, rid, entries);
         if (rc != 0) break;
     }
-    fclose(fp);
 
     return rc;
 }
@@ -549,14 +655,14 @@ RC dml_delete(string &cmd, SM_TableHandle &th)
     if (!th.isValidTable(tableName))
         return 1;
     
-    // get where file
+    // get where condition
     ss >> plhd; if (plhd != "where"){return -1;}
     getline(ss, whereCondition);
-    string whereFile;
-    rc = table_where(whereCondition, whereFile, tableName, th);
+    SM_RidList rids;
+    rc = table_where(whereCondition, rids, tableName, th);
     if (rc != 0) return 0;
 
-    return th.DeleteEntry(tableName, whereFile);
+    return th.DeleteEntry(tableName, rids);
 }
 
 
@@ -580,9 +686,11 @@ RC dml_select(string &cmd, SM_TableHandle &th)
     vector<string> colList;
     if (colstr == "*")
     {
-        string filename;
-        th.GetScmFile(filename, tableName);
-        load_columns_from_scm(filename, colList);
+        SM_TableInfo *table;
+        if ((rc = th.GetCatalog().GetTable(tableName, table)))
+            return rc;
+        for (auto iter = table->attrList.begin(); iter != table->attrList.end(); iter++)
+            colList.push_back(iter->name);
     }else {
         string_split(&colList, colstr);
         if (colList.size() == 0)
@@ -598,42 +706,28 @@ RC dml_select(string &cmd, SM_TableHandle &th)
     printf("SELECT FROM TABLE %s\n", tableName.c_str());
     printf("------------------------------------------\n");
 
-    string outFile = tableName + ".select";
-
-    string whereCondition, whereFile;
+    string whereCondition;
     ss >> plhd;
     if (plhd == "where")
     {
         getline(ss, whereCondition);
-        rc = table_where(whereCondition, whereFile, tableName, th);
+        SM_RidList rids;
+        rc = table_where(whereCondition, rids, tableName, th);
         if (rc != 0) return 0;
-        rc = th.WriteValue(tableName, colList, outFile, whereFile);
+        rc = th.WriteValue(tableName, colList, stdout, rids);
     }else {
         // no where condition is given
-        whereFile = "";
-        rc = th.WriteValue(tableName, colList, outFile, whereFile);
+        rc = th.WriteValue(tableName, colList, stdout);
         if (rc == 1) return rc;
     }
 
-#ifdef _WIN32
-    //define something for Windows (32-bit and 64-bit, this part is common)
-    string syscmd = "type " + outFile; 
-#elif __APPLE__
-    // apple
-#elif __linux__
-    string syscmd = "cat " + outFile;
-#else
-#   error "Unknown compiler"
-#endif
-
-    system(syscmd.c_str());
     return rc;
 }
 
 
 void database_handle(string &dbName, string &dbPath)
 {
-    SM_TableHandle th(dbPath);
+    SM_TableHandle th(dbPath, maxOpenFiles);
     string cmd;
     while (1)
     {
@@ -678,6 +772,14 @@ void database_handle(string &dbName, string &dbPath)
         {
             cmd = cmd.substr(13);
             rc = dml_rename_table(cmd, th);
+        }else if (strncmp(cmd.c_str(), "load data ", 10) == 0) 
+        {
+            cmd = cmd.substr(10);
+            rc = dml_load_data(cmd, th);
+        }else if (strncmp(cmd.c_str(), "rebuild index ", 14) == 0) 
+        {
+            cmd = cmd.substr(14);
+            rc = dml_rebuild_index(cmd, th);
         }else if (strncmp(cmd.c_str(), "update ", 7) == 0)
         {
             cmd = cmd.substr(7);
@@ -754,6 +856,63 @@ void write_dbInfo(map<string, string> &dbList)
 
 int main(int argc, char* argv[])
 {
+    // -b <pages>: size of the shared buffer pool
+    // -r lru|clock|2q: its replacement policy
+    // -m: scans read the pages of the tables in place, mapped
+    // -d: tables and indexes bypass the OS page cache, direct I/O
+    // -f <files>: max number of .data and .index files kept open
+    // -u <dir>: upgrade the files of the database in dir, then exit
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-m") == 0)
+        {
+            PF_SetMappedReads(true);
+            continue;
+        }
+        if (strcmp(argv[i], "-d") == 0)
+        {
+            PF_SetDirectIO(true);
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            cout << "Missing value for option " << argv[i] << endl;
+            return 1;
+        }
+        if (strcmp(argv[i], "-b") == 0)
+        {
+            if (PF_SetBufferSize(atoi(argv[i + 1])) != 0)
+            {
+                cout << "Invalid buffer size " << argv[i + 1] << endl;
+                return 1;
+            }
+        }else if (strcmp(argv[i], "-f") == 0) {
+            maxOpenFiles = atoi(argv[i + 1]);
+            if (maxOpenFiles <= 0)
+            {
+                cout << "Invalid number of open files " << argv[i + 1] << endl;
+                return 1;
+            }
+        }else if (strcmp(argv[i], "-u") == 0) {
+            return upgrade_database(argv[i + 1]) ? 0 : 1;
+        }else if (strcmp(argv[i], "-r") == 0) {
+            if (strcasecmp(argv[i + 1], "lru") == 0)
+                PF_SetReplacePolicy(PF_REPLACE_LRU);
+            else if (strcasecmp(argv[i + 1], "clock") == 0)
+                PF_SetReplacePolicy(PF_REPLACE_CLOCK);
+            else if (strcasecmp(argv[i + 1], "2q") == 0)
+                PF_SetReplacePolicy(PF_REPLACE_2Q);
+            else {
+                cout << "Invalid replacement policy " << argv[i + 1] << endl;
+                return 1;
+            }
+        }else {
+            cout << "Unknown option " << argv[i] << endl;
+            return 1;
+        }
+        i++;
+    }
+
     // load databases info
     static map<string, string> dbList;
     int dbNum;
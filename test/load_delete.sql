@@ -0,0 +1,17 @@
+create database db;
+@DIR@/
+use db;
+create table t (id INT, age INT, h FLOAT, name STRING[8]);
+load data '@TEST@/load_delete.csv' into t;
+select * from t where age >= 0;
+delete from t where id = 2;
+delete from t where id = 3;
+delete from t where id = 5;
+insert into t (id,age,h,name):(7,8,5,fay);
+select * from t where age = 0;
+select * from t where age >= 0;
+select * from t where h >= 0;
+select * from t where name >= a;
+select * from t where id >= 0;
+exit;
+exit;
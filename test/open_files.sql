@@ -0,0 +1,16 @@
+create database db;
+@DIR@/
+use db;
+create table t (a INT, b INT, c INT, d FLOAT, e STRING[8]);
+insert into t (a,b,c,d,e):(1,10,100,1,one);
+insert into t (a,b,c,d,e):(2,20,200,2,two);
+insert into t (a,b,c,d,e):(3,30,300,3,three);
+insert into t (a,b,c,d,e):(4,40,400,4,four);
+select * from t where a >= 1;
+select e,d,c,b,a from t where a >= 2 and b <= 30 and c != 200 or e = four;
+insert into t (a,b,c,d,e):(5,50,500,5,five);
+delete from t where d = 3;
+select * from t where a >= 1 and b >= 10 and c >= 100 and d >= 1 and e >= a;
+select * from t;
+exit;
+exit;
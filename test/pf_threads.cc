@@ -0,0 +1,287 @@
+//
+// File:        pf_threads.cc
+// Description: threads sharing the PF buffer pool
+//
+// Built and run by "make test".  Threads pin random pages of one file,
+// latch them and either count in them or check them, while another
+// thread forces the dirty pages to disk.  Readers hint the next page
+// with PrefetchPage, so reads and writes go through the I/O engine
+// while pages are pinned and latched.  Each setting of the pool (size,
+// replacement policy, direct I/O, mapped reads) is run in turn; the
+// counts on disk must add up to the increments made, and no reader may
+// see a page half changed.
+//
+//   ./pf_threads [file]
+//
+// Exits with 1 if any run fails.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "pf.h"
+
+using namespace std;
+
+const int THREADS_PAGE_SIZE = PF_BLOCK_SIZE;
+const int THREADS_FILE_PAGES = 64;
+const int THREADS_NUM = 8;
+const int THREADS_ITERS = 20000;
+
+static atomic<long> numIncs, numErrs, numRetries;
+static atomic<bool> bStop;
+
+static void Error(const char *what, RC rc)
+{
+   if (numErrs++ < 10)
+      printf("  %s: rc %d\n", what, rc);
+}
+
+//
+// Pin random pages; write ones add one to the count at the start of the
+// page and copy it into the second word, read ones check both words are
+// the same.
+//
+static void Work(PF_FileHandle *fh, unsigned seed)
+{
+   for (int i = 0; i < THREADS_ITERS; i++) {
+      PageNum p = rand_r(&seed) % THREADS_FILE_PAGES;
+      int bWrite = rand_r(&seed) % 2;
+      PF_PageHandle ph;
+      char *pData;
+      RC rc;
+
+      // the page is pinned read-only in the mapping by another thread
+      while ((rc = fh->GetThisPage(p, ph, !bWrite)) == PF_PAGEMAPPED) {
+         numRetries++;
+         this_thread::yield();
+      }
+      if (rc) {
+         Error("GetThisPage", rc);
+         continue;
+      }
+      ph.GetData(pData);
+      if ((rc = fh->LatchPage(p, bWrite)))
+         Error("LatchPage", rc);
+
+      long *count = (long *)pData;
+      if (bWrite) {
+         count[0] = count[0] + 1;
+         count[1] = count[0];
+         numIncs++;
+         if ((rc = fh->MarkDirty(p)))
+            Error("MarkDirty", rc);
+      }
+      else {
+         if (count[0] != count[1])
+            Error("torn page", p);
+         fh->PrefetchPage((p + 1) % THREADS_FILE_PAGES);
+      }
+
+      if ((rc = fh->UnlatchPage(p)))
+         Error("UnlatchPage", rc);
+      if ((rc = fh->UnpinPage(p)))
+         Error("UnpinPage", rc);
+   }
+}
+
+static void Force(PF_FileHandle *fh)
+{
+   RC rc;
+   while (!bStop) {
+      if ((rc = fh->ForcePages()))
+         Error("ForcePages", rc);
+      usleep(500);
+   }
+}
+
+//
+// Add up the counts of the pages on disk
+//
+static RC SumFile(const char *fileName, long &sum)
+{
+   RC rc;
+   PF_FileHandle fh;
+   if ((rc = fh.OpenFile(fileName)))
+      return (rc);
+   sum = 0;
+   for (PageNum p = 0; p < THREADS_FILE_PAGES; p++) {
+      PF_PageHandle ph;
+      char *pData;
+      if ((rc = fh.GetThisPage(p, ph, true)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+      sum += ((long *)pData)[0];
+      if ((rc = fh.UnpinPage(p)))
+         return (rc);
+   }
+   // the pages must be read from disk by the next run
+   return (fh.CloseFile());
+}
+
+static RC MakeFile(const char *fileName)
+{
+   RC rc;
+   PF_FileHandle fh;
+   unlink(fileName);
+   if ((rc = PF_CreateFile(fileName, THREADS_PAGE_SIZE)) ||
+         (rc = fh.OpenFile(fileName)))
+      return (rc);
+   for (int i = 0; i < THREADS_FILE_PAGES; i++) {
+      PF_PageHandle ph;
+      PageNum p;
+      char *pData;
+      if ((rc = fh.AllocatePage(ph)) ||
+            (rc = ph.GetPageNum(p)) ||
+            (rc = ph.GetData(pData)))
+         return (rc);
+      memset(pData, 0, THREADS_PAGE_SIZE);
+      if ((rc = fh.MarkDirty(p)) ||
+            (rc = fh.UnpinPage(p)))
+         return (rc);
+   }
+   return (fh.CloseFile());
+}
+
+//
+// One run: the threads against a file of zeroed pages
+//
+static bool Run(const char *fileName, int numPages, PF_ReplacePolicy policy,
+                int bDirect, int bMapped)
+{
+   static const char *policies[] = { "lru", "clock", "2q" };
+   RC rc;
+   long sum = -1;
+   printf("%-5s %4d pages%s%s: ", policies[policy], numPages,
+          bDirect ? ", direct" : "", bMapped ? ", mapped" : "");
+   fflush(stdout);
+
+   numIncs = numErrs = numRetries = 0;
+   bStop = false;
+   PF_SetDirectIO(bDirect);
+   PF_SetMappedReads(bMapped);
+   if ((rc = PF_SetBufferSize(numPages)) ||
+         (rc = PF_SetReplacePolicy(policy)) ||
+         (rc = MakeFile(fileName))) {
+      Error("setup", rc);
+      return (false);
+   }
+
+   PF_FileHandle fh;
+   if ((rc = fh.OpenFile(fileName))) {
+      Error("OpenFile", rc);
+      return (false);
+   }
+   vector<thread> threads;
+   for (int t = 0; t < THREADS_NUM; t++)
+      threads.push_back(thread(Work, &fh, t + 1));
+   thread forcer(Force, &fh);
+   for (auto &t : threads)
+      t.join();
+   bStop = true;
+   forcer.join();
+   if ((rc = fh.CloseFile()) ||
+         (rc = SumFile(fileName, sum)))
+      Error("close", rc);
+
+   PF_SetDirectIO(false);
+   PF_SetMappedReads(false);
+   unlink(fileName);
+
+   bool bOk = (sum == numIncs && numErrs == 0);
+   printf("%ld increments, %ld on disk, %ld retried%s\n", numIncs.load(),
+          sum, numRetries.load(), bOk ? "" : ", FAILED");
+   return (bOk);
+}
+
+//
+// The latches of one page: a thread can not take its latch twice or
+// release another thread's, and a writer gets in between readers that
+// keep the page latched shared back to back.
+//
+static bool Latches(const char *fileName)
+{
+   RC rc, rcSelf, rcOther, rcOwn;
+   printf("latches: ");
+   fflush(stdout);
+   numErrs = 0;
+   if ((rc = MakeFile(fileName))) {
+      Error("setup", rc);
+      return (false);
+   }
+
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   if ((rc = fh.OpenFile(fileName)) ||
+         (rc = fh.GetThisPage(0, ph))) {
+      Error("open", rc);
+      return (false);
+   }
+   fh.LatchPage(0, true);
+   rcSelf = fh.LatchPage(0, false);
+   thread([&] { rcOther = fh.UnlatchPage(0); }).join();
+   rcOwn = fh.UnlatchPage(0);
+   if (rcSelf != PF_LATCHHELD)
+      Error("latch taken twice", rcSelf);
+   if (rcOther != PF_LATCHNOTHELD)
+      Error("latch released by another thread", rcOther);
+   if (rcOwn != 0)
+      Error("UnlatchPage", rcOwn);
+   if ((rc = fh.UnlatchPage(0)) != PF_PAGEUNLATCHED)
+      Error("latch released twice", rc);
+
+   atomic<bool> bGot(false);
+   bStop = false;
+   vector<thread> readers;
+   for (int t = 0; t < 4; t++)
+      readers.push_back(thread([&] {
+         while (!bStop) {
+            fh.LatchPage(0, false);
+            usleep(200);
+            fh.UnlatchPage(0);
+         }
+      }));
+   usleep(10000);
+   thread writer([&] {
+      fh.LatchPage(0, true);
+      bGot = true;
+      fh.UnlatchPage(0);
+   });
+   for (int i = 0; i < 1000 && !bGot; i++)
+      usleep(1000);
+   if (!bGot)
+      Error("writer starved", 0);
+   bStop = true;
+   for (auto &t : readers)
+      t.join();
+   writer.join();
+
+   if ((rc = fh.UnpinPage(0)) ||
+         (rc = fh.CloseFile()))
+      Error("close", rc);
+   unlink(fileName);
+   printf("%s\n", numErrs == 0 ? "ok" : "FAILED");
+   return (numErrs == 0);
+}
+
+int main(int argc, char *argv[])
+{
+   const char *fileName = argc > 1 ? argv[1] : "pf_threads.data";
+   bool bOk = Latches(fileName);
+
+   // 16 pages: all but the pinned ones are replaced all the time
+   static const int sizes[] = { 16, 256 };
+   for (int s = 0; s < 2; s++)
+      for (int policy = PF_REPLACE_LRU; policy <= PF_REPLACE_2Q; policy++)
+         bOk &= Run(fileName, sizes[s], (PF_ReplacePolicy)policy, false, false);
+   bOk &= Run(fileName, 16, PF_REPLACE_2Q, true, false);
+   bOk &= Run(fileName, 256, PF_REPLACE_2Q, true, false);
+   bOk &= Run(fileName, 16, PF_REPLACE_2Q, false, true);
+   bOk &= Run(fileName, 256, PF_REPLACE_LRU, false, true);
+
+   return (bOk ? 0 : 1);
+}
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# run_sql.sh <case>.sql
+#
+# Run a case through ./wsql in a scratch directory and compare the
+# result rows of its selects with <case>.out.  In the case, @DIR@ is
+# replaced by the scratch directory and @TEST@ by this directory.
+# <case>.args, if there is one, holds more options for ./wsql.
+#
+
+CASE=$1
+TEST=$(cd "$(dirname "$CASE")" && pwd)
+ROOT=$(cd "$TEST/.." && pwd)
+NAME=$(basename "$CASE" .sql)
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+ARGS=$WSQL_ARGS
+if [ -f "$TEST/$NAME.args" ]; then
+    ARGS="$ARGS $(cat "$TEST/$NAME.args")"
+fi
+
+ln -s "$ROOT/lib" "$DIR/lib"
+sed -e "s|@DIR@|$DIR|g" -e "s|@TEST@|$TEST|g" "$CASE" > "$DIR/in.txt"
+(cd "$DIR" && "$ROOT/wsql" $ARGS < in.txt > out.txt 2>&1)
+RC=$?
+awk '/^SELECT FROM TABLE/ { s = 1 } s && /^(SELECT FROM TABLE|\| )/' \
+    "$DIR/out.txt" > "$DIR/rows.txt"
+if [ $RC -ne 0 ] || ! diff -u "$TEST/$NAME.out" "$DIR/rows.txt"; then
+    echo "$NAME: FAILED (exit $RC)"
+    tail -5 "$DIR/out.txt"
+    exit 1
+fi
+echo "$NAME: ok"